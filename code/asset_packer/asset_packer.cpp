@@ -11,6 +11,8 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <iterator>
+#include <math.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <SDL2/SDL.h>
@@ -22,6 +24,27 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "image.cpp"
 
+// The game's wav parsing and sample conversion, so packed sounds come out exactly as the game converts the wav files it loads.
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef float    f32;
+
+u32
+u32_min(u32 a, u32 b)
+{
+	return a < b ? a : b;
+}
+
+#define READ_AND_ADVANCE_STREAM(type, stream) *((type *)stream); stream += sizeof(type);
+#define log_print(type, fmt, ...) printf("**** " fmt "\n", ## __VA_ARGS__)
+#define ASSET_PACKER
+#include "../sample_conversion.cpp"
+#undef log_print
+
 Asset_Id current_asset_id = 0;
 
 FILE *log_file = NULL;
@@ -119,6 +142,35 @@ read_entire_file(std::string path)
 	return buffer;
 }
 
+// Converts a wav file's samples to PACKED_SOUND_NUM_CHANNELS channels at PACKED_SOUND_SAMPLE_RATE with the game's own
+// conversion, so the game doesn't have to. Returns false if it isn't a wav file the game could convert.
+bool
+convert_wav(std::string path, Sound_Header *header, std::vector<int16_t> *samples)
+{
+	std::ifstream t(path, std::ios::binary);
+	std::string file((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+
+	Sample_Source source;
+	if (!parse_wav(path.c_str(), file.data(), file.size(), PACKED_SOUND_SAMPLE_RATE, &source)) {
+		return false;
+	}
+	if (source.num_output_frames == 0) {
+		printf("**** The wav file %s has no samples.\n", path.c_str());
+		return false;
+	}
+
+	samples->resize((size_t)source.num_output_frames * PACKED_SOUND_NUM_CHANNELS);
+	convert_sample_frames(samples->data(), PACKED_SOUND_NUM_CHANNELS, &source, 0, source.num_output_frames);
+
+	header->num_frames      = source.num_output_frames;
+	header->num_channels    = PACKED_SOUND_NUM_CHANNELS;
+	header->sample_rate     = PACKED_SOUND_SAMPLE_RATE;
+	header->bits_per_sample = 16;
+
+	printf("Converted sound %s, %u frames to %u frames at %u Hz.\n", path.c_str(), source.num_frames, source.num_output_frames, PACKED_SOUND_SAMPLE_RATE);
+	return true;
+}
+
 Asset_Type_Info
 do_pack(std::string directory_relative_path, std::string base_directory_base_name, Asset_Type *at)
 {
@@ -419,6 +471,29 @@ do_pack(std::string directory_relative_path, std::string base_directory_base_nam
 
 			fseek(asset_file, texture_offset, SEEK_SET);
 			add_asset(asset_id_string, *at, dependency, tags, &tex_header, sizeof(tex_header), pixels, texture_width * texture_height * 4, &tinfo.count);
+		} else if (base_directory_base_name == "sounds") {
+			if (file_extension != "wav") {
+				log_print("Skipping file %s: not a wav file.\n", file_absolute_path.c_str());
+				continue;
+			}
+
+			*at = SOUND_ASSET_TYPE;
+
+			Sound_Header sound_header;
+			std::vector<int16_t> samples;
+			if (!convert_wav(file_absolute_path, &sound_header, &samples)) {
+				log_print("Skipping file %s: could not convert it.\n", file_absolute_path.c_str());
+				continue;
+			}
+
+			// The game mixes straight out of the mapped asset file, so keep the samples aligned for it.
+			while (ftell(asset_file) % 16 != 0) {
+				fputc(0, asset_file);
+			}
+
+			std::string asset_id_string = to_upper(file_base_name) + std::string("_SOUND");
+
+			add_asset(asset_id_string, *at, ASSET_DOES_NOT_EXIST, tags, &sound_header, sizeof(sound_header), samples.data(), samples.size() * sizeof(int16_t), &tinfo.count);
 		} else {
 			log_print("Skipping unrecognized asset directory %s.\n", base_directory_base_name.c_str());
 		}
@@ -578,6 +653,8 @@ main(int, char **)
 
 	pack_asset_directory("../../data/sprite");
 
+	pack_asset_directory("../../data/sounds");
+
 	//fprintf(gen_header_file, "\tNUM_ASSETS\n");
 	//fprintf(gen_header_file, "};\n\n");
 
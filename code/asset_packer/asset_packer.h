@@ -55,6 +55,18 @@ struct Sprite_Header {
 	uint32_t texture_pixel_height;
 };
 
+// Sounds are packed already in the format the game opens the sound device with, so they play straight out of the asset file.
+#define PACKED_SOUND_SAMPLE_RATE  44100
+#define PACKED_SOUND_NUM_CHANNELS 2
+
+// Followed by num_frames interleaved frames of 16 bit samples.
+struct Sound_Header {
+	uint32_t num_frames;
+	uint32_t num_channels;
+	uint32_t sample_rate;
+	uint32_t bits_per_sample;
+};
+
 struct Asset_File_Sprite_Frame {
 	int32_t x;
 	int32_t y;
@@ -24,7 +24,7 @@ struct Asset_Catalog {
 Asset_Catalog<Sprite_Asset>  sprite_catalog(MAX_SPRITES);
 Asset_Catalog<Texture_Asset> texture_catalog(MAX_TEXTURES);
 
-GLuint gpu_make_texture(u32 gl_tex_unit, s32 texture_format, s32 pixel_format, s32 pixel_width, s32 pixel_height, u8 *pixels);
+Gpu_Texture_Handle gpu_make_texture(u32 gl_tex_unit, s32 texture_format, s32 pixel_format, s32 pixel_width, s32 pixel_height, u8 *pixels);
 
 void add_load_sprite_job(const char *, const char *);
 void add_load_texture_job(const char *, const char *);
@@ -341,6 +341,7 @@ load_sprite(const char *sprite_path, const char *collider_path, const char *file
 	}
 }
 
+#ifndef HEADLESS
 void
 load_texture(const char *path, const char *base_name)
 {
@@ -354,10 +355,16 @@ load_texture(const char *path, const char *base_name)
 	u32 num_texture_bytes = texture_width * texture_height * texture_channels;
 
 	Texture_Asset t;
-	t.gpu_handle = gpu_make_texture(GL_TEXTURE0, GL_RGBA, GL_RGBA, texture_width, texture_height, pixels);
+	t.pixel_width            = texture_width;
+	t.pixel_height           = texture_height;
+	t.pixels                 = pixels;
+	t.gpu_handle             = gpu_make_texture(GL_TEXTURE0, GL_RGBA, GL_RGBA, texture_width, texture_height, pixels);
+	t.texture_array_layer    = NO_TEXTURE_ARRAY_LAYER;
+	t.texture_array_uv_scale = { 1.0f, 1.0f };
 
 	add_texture(t, 0, base_name);
 }
+#endif
 
 void
 load_ase(const char *asset_path)
@@ -388,6 +395,8 @@ load_ase(const char *asset_path)
 
 	printf("Loading ase file %s\n", base_name);
 
+	// Headless runs read the sprite data a normal run exported, so batch machines don't need aseprite.
+#ifndef HEADLESS
 	char buffer[buffer_size];
 
 	char *aseprite_gen_command = buffer;
@@ -397,12 +406,15 @@ load_ase(const char *asset_path)
 
 	sprintf(aseprite_gen_command, "aseprite -b --data %s/%s_collider.json --trim --ignore-empty --layer collider %s", json_directory, base_name, asset_path);
 	system(aseprite_gen_command);
+#endif
 
 	//add_load_texture_job(texture_directory, base_name);
 	//add_load_sprite_job(json_directory, base_name);
 	char b1[256], b2[256], b3[256];
+#ifndef HEADLESS
 	sprintf(b1, "%s/%s.png", texture_directory, base_name);
 	load_texture(b1, base_name);
+#endif
 	sprintf(b1, "%s/%s.json", json_directory, base_name);
 	sprintf(b2, "%s/%s_collider.json", json_directory, base_name);
 	load_sprite(b1, b2, base_name);
@@ -20,8 +20,10 @@
 void application_entry();
 
 #ifdef __linux__ 
+#ifndef HEADLESS
 #include <GL/gl.h>
 #include <GL/glx.h>
+#endif
 #include "linux.cpp"
 
 #elif _WIN32
@@ -58,15 +60,23 @@ struct Job_Queue {
 #include "math.cpp"
 #include "memory.cpp"
 #include "library.cpp"
+#include "spatial_grid.cpp"
+#include "colliders.cpp"
+#include "tile_colliders.cpp"
+#ifndef HEADLESS
+#include "sample_conversion.cpp"
 #include "sound.cpp"
+#endif
 
 #include "assets.cpp"
 #include "threads.cpp"
 
+#ifndef HEADLESS
 #include "opengl.cpp"
 
 #include <freetype2/ft2build.h>
 #include FT_FREETYPE_H
+#endif
 
 Color black{ 0.0f, 0.0f, 0.0f };
 Color white{ 1.0f, 1.0f, 1.0f };
@@ -102,6 +112,9 @@ f32 ROPE_CAST_POINT_DISTANCE_FROM_PLAYER = 0.2f;
 f32 CAMERA_SPEED       = 14.0f;
 f32 CAMERA_SMOOTH_TIME = 0.20f;
 
+f32 SIMULATION_TICK_HZ             = 60.0f;
+u32 MAX_SIMULATION_TICKS_PER_FRAME = 5; // If we fall further behind than this, drop the time rather than spiral.
+
 f32 TILE_SIDE_IN_METERS = 0;
 
 bool debug_mode_bend_test = false;
@@ -139,24 +152,22 @@ time_spec_to_milliseconds(Time_Spec ts)
 	return (ts.tv_sec * 1000) + round(ts.tv_nsec / 1.0e6);
 }
 
-Collider_Id
-add_collider(f32 x, f32 y, f32 w, f32 h, Array<Rectangle> *colliders)
+Rectangle
+bounding_rectangle(V2 a, V2 b)
 {
-	Collider_Id id = colliders->size;
-	printf("%f %f %f %f\n", x, y, w, h);
-	colliders->push({x, y, w, h});
-	return id;
+	return { fmin(a.x, b.x), fmin(a.y, b.y), fabs(a.x - b.x), fabs(a.y - b.y) };
 }
 
-Collider_Id
-add_collider(Rectangle c, Array<Rectangle> *colliders)
+Rectangle
+bounding_rectangle(Rectangle a, Rectangle b)
 {
-	print_rectangle(c);
-	return add_collider(c.x, c.y, c.w, c.h, colliders);
+	f32 min_x = fmin(a.x, b.x), min_y = fmin(a.y, b.y);
+	f32 max_x = fmax(a.x + a.w, b.x + b.w), max_y = fmax(a.y + a.h, b.y + b.h);
+	return { min_x, min_y, max_x - min_x, max_y - min_y };
 }
 
 Collider_Id
-add_sprite_collider(const char *sprite_name, Array<Rectangle> *colliders)
+add_sprite_collider(const char *sprite_name, Collider_Store *colliders)
 {
 	Sprite_Asset *a = get_sprite(sprite_name);
 	if (!a) {
@@ -196,128 +207,193 @@ intersect_line_segments(V2 oa, V2 ea, V2 ob, V2 eb)
 	return INFINITY;
 }
 
-Axis_Collision_Check_Result
-check_collision_x(Rectangle minkowski_sum, f32 dx)
+bool
+check_collision(Rectangle us, Collider_Store *colliders, Collider_Id exclude = NO_COLLIDER_ID)
 {
-	// Test if if the move will put the origin inside the minkowski aabb.
-	f32 minkowski_l = minkowski_sum.x;
-	f32 minkowski_r = minkowski_sum.x + minkowski_sum.w;
-	f32 minkowski_b = minkowski_sum.y;
-	f32 minkowski_t = minkowski_sum.y + minkowski_sum.h;
-
-	if (minkowski_l <= 0.0f && minkowski_r >= 0.0f && minkowski_b <= 0.0f && minkowski_t >= 0.0f) {
-		return dx > 0.0f ? (Axis_Collision_Check_Result){ minkowski_l - COLLISION_GAP, RIGHT_COLLISION }
-		                 : (Axis_Collision_Check_Result){ minkowski_r + COLLISION_GAP, LEFT_COLLISION };
-	}
-
-	return { 0.0f, NO_COLLISION };
+	static Array<Collider_Id> hits = make_array<Collider_Id>(64, 0);
+	overlapping_colliders(us, MINKOWSKI_HALF_OPEN, exclude, colliders, &hits);
+	return hits.size > 0;
 }
 
-Axis_Collision_Check_Result
-check_collision_y(Rectangle minkowski_sum, f32 dy)
+bool
+check_collision(V2 point, Collider_Store *colliders, Collider_Id exclude = NO_COLLIDER_ID)
 {
-	// Test if if the move will put the origin inside the minkowski aabb.
-	f32 minkowski_l = minkowski_sum.x;
-	f32 minkowski_r = minkowski_sum.x + minkowski_sum.w;
-	f32 minkowski_b = minkowski_sum.y;
-	f32 minkowski_t = minkowski_sum.y + minkowski_sum.h;
+	static Array<Collider_Id> hits = make_array<Collider_Id>(64, 0);
+	overlapping_colliders({ point.x, point.y, 0.0f, 0.0f }, MINKOWSKI_HALF_OPEN, exclude, colliders, &hits);
+	return hits.size > 0;
+}
 
-	if (minkowski_l <= 0.0f && minkowski_r >= 0.0f && minkowski_b <= 0.0f && minkowski_t >= 0.0f) {
-		return dy > 0.0f ? (Axis_Collision_Check_Result){ minkowski_b - COLLISION_GAP, TOP_COLLISION }
-		                 : (Axis_Collision_Check_Result){ minkowski_t + COLLISION_GAP, BOTTOM_COLLISION };
+// When the move starts with us already inside a collider, push us out the shortest way. Returns the direction of the
+// collision from our side, or NO_COLLISION if we weren't inside it.
+Collision_Direction
+push_out_of_collider(Rectangle them, Rectangle *us)
+{
+	// Touching or sitting within the gap isn't overlapping.
+	if (us->x + us->w <= them.x || us->x >= them.x + them.w || us->y + us->h <= them.y || us->y >= them.y + them.h) {
+		return NO_COLLISION;
 	}
 
-	return { 0.0f, NO_COLLISION };
-}
+	f32 push_l = them.x - us->w - COLLISION_GAP - us->x;
+	f32 push_r = them.x + them.w + COLLISION_GAP - us->x;
+	f32 push_d = them.y - us->h - COLLISION_GAP - us->y;
+	f32 push_u = them.y + them.h + COLLISION_GAP - us->y;
 
-bool
-check_collision(Rectangle us, Array<Rectangle> colliders, Collider_Id exclude = NO_COLLIDER_ID)
-{
-	for (u32 i = 0; i < colliders.size; ++i) {
-		if (exclude != NO_COLLIDER_ID && i == exclude)
-			continue;
+	f32 push_x = (fabs(push_l) < fabs(push_r)) ? push_l : push_r;
+	f32 push_y = (fabs(push_d) < fabs(push_u)) ? push_d : push_u;
 
-		Rectangle them = colliders[i];
+	if (fabs(push_x) < fabs(push_y)) {
+		us->x += push_x;
+		return (push_x < 0.0f) ? RIGHT_COLLISION : LEFT_COLLISION;
+	}
+	us->y += push_y;
+	return (push_y < 0.0f) ? TOP_COLLISION : BOTTOM_COLLISION;
+}
 
-		Rectangle minkowski_sum = { them.x - us.x - us.w,
-		                            them.y - us.y - us.h,
-		                            us.w + them.w,
-		                            us.h + them.h };
-		
-		if (intersect_point_rectangle({ 0.0f, 0.0f }, minkowski_sum)) {
-			return true;
+// Slab test of us moving by d against them, done in the Minkowski sum of the two so us shrinks to its bottom left corner.
+// Returns the fraction of d at which us first touches them, or INFINITY if it doesn't within the move, and which axis was hit.
+f32
+swept_time_of_impact(Rectangle us, V2 d, Rectangle them, u32 *hit_axis)
+{
+	f32 minkowski_l = them.x - us.w;
+	f32 minkowski_r = them.x + them.w;
+	f32 minkowski_b = them.y - us.h;
+	f32 minkowski_t = them.y + them.h;
+
+	f32 entry[2], exit[2];
+	f32 origin[2] = { us.x, us.y };
+	f32 lo[2]     = { minkowski_l, minkowski_b };
+	f32 hi[2]     = { minkowski_r, minkowski_t };
+
+	for (u32 axis = 0; axis < 2; ++axis) {
+		if (d[axis] == 0.0f) {
+			// Not moving on this axis, so we have to be strictly inside the slab already. Sliding along a face we are
+			// touching doesn't hit it.
+			if (origin[axis] <= lo[axis] || origin[axis] >= hi[axis]) {
+				return INFINITY;
+			}
+			entry[axis] = -INFINITY;
+			exit[axis]  = INFINITY;
+		} else if (d[axis] > 0.0f) {
+			entry[axis] = (lo[axis] - origin[axis]) / d[axis];
+			exit[axis]  = (hi[axis] - origin[axis]) / d[axis];
+		} else {
+			entry[axis] = (hi[axis] - origin[axis]) / d[axis];
+			exit[axis]  = (lo[axis] - origin[axis]) / d[axis];
 		}
 	}
 
-	return false;
+	f32 t_entry = fmax(entry[0], entry[1]);
+	f32 t_exit  = fmin(exit[0], exit[1]);
+	if (t_entry > t_exit || t_entry > 1.0f || t_exit <= 0.0f) {
+		return INFINITY;
+	}
+
+	// Ties go to y, so landing exactly on a corner lands rather than stops us.
+	*hit_axis = (entry[0] > entry[1]) ? 0 : 1;
+
+	// We can start a hair inside after float error. Treat that as touching now.
+	return fmax(t_entry, 0.0f);
 }
 
-bool
-check_collision(V2 point, Array<Rectangle> colliders, Collider_Id exclude = NO_COLLIDER_ID)
+void
+add_collision_report(Collision_Report r, Collision_Report *reports, u32 *num_reports)
 {
-	for (u32 i = 0; i < colliders.size; ++i) {
-		if (exclude != NO_COLLIDER_ID && i == exclude)
-			continue;
-
-		if (intersect_point_rectangle(point, colliders[i])) {
-			return true;
-		}
+	if (*num_reports < MAX_COLLISION_REPORTS) {
+		reports[(*num_reports)++] = r;
 	}
-
-	return false;
 }
 
-// @NOTE: This continually registers collisions even if the colliders are just touching without moving.
-// Not sure if that is what we want.
+// Swept AABB collision with sliding. Us travels along delta_position until the first time of impact, stops COLLISION_GAP
+// short of the collider on the axis it hit, and spends the rest of the move sliding along the other axis. Nothing is
+// skipped however far a tick moves us, so speed never tunnels through thin colliders.
+//
+// The broadphase runs once, over the bounds of the whole move. Sliding only ever shortens the move on each axis, so every
+// later leg stays inside those bounds.
+//
+// @NOTE: Moving into a collider we are already within the gap of registers a collision every tick, even without moving.
+// player_move() counts on this for grounding.
 Collision_Check_Result
-check_collision(Collider_Id id, V2 delta_position, Array<Rectangle> colliders)
+check_collision(Collider_Id id, V2 delta_position, Collider_Store *colliders)
 {
-	V2 dp = delta_position;
+	static Array<Collider_Id> hits = make_array<Collider_Id>(64, 0);
 
 	Collision_Check_Result result;
-	result.delta_position        = dp;
+	result.delta_position        = delta_position;
 	result.x_collision_direction = NO_COLLISION;
 	result.y_collision_direction = NO_COLLISION;
-	result.x_collisions          = make_array<Collision_Report>(256, 0); // @TEMP
-	result.y_collisions          = make_array<Collision_Report>(256, 0); // @TEMP
-
-	Rectangle us = colliders[id];
+	result.num_x_collisions      = 0;
+	result.num_y_collisions      = 0;
+
+	Rectangle start = get_collider(id, colliders);
+	Rectangle end   = { start.x + delta_position.x, start.y + delta_position.y, start.w, start.h };
+	overlapping_colliders(bounding_rectangle(start, end), MINKOWSKI_CLOSED, id, colliders, &hits);
+
+	Rectangle us = start;
+	for (Collider_Id i : hits) {
+		Rectangle them = get_collider(i, colliders);
+		Rectangle before = us;
+		Collision_Direction d = push_out_of_collider(them, &us);
+		if (d == LEFT_COLLISION || d == RIGHT_COLLISION) {
+			result.x_collision_direction = d;
+			add_collision_report({ them, us.x - before.x }, result.x_collisions, &result.num_x_collisions);
+		} else if (d != NO_COLLISION) {
+			result.y_collision_direction = d;
+			add_collision_report({ them, us.y - before.y }, result.y_collisions, &result.num_y_collisions);
+		}
+	}
 
-	for (u32 i = 0; i < colliders.size; ++i) {
-		if (i == id)
-			continue;
-		Rectangle them = colliders[i];
-		Rectangle minkowski_sum = { them.x - (us.x + dp.x) - us.w,
-		                            them.y - us.y - us.h,
-		                            us.w + them.w,
-		                            us.h + them.h };
-		auto x = check_collision_x(minkowski_sum, dp.x);
-		if (x.direction != NO_COLLISION) {
-			if (result.x_collision_direction == NO_COLLISION) {
-				result.x_collision_direction = x.direction;
-				result.delta_position.x += x.penetration;
+	// One leg per axis is all it can take: each impact zeroes the move along the axis it hit.
+	V2 remaining = delta_position;
+	for (u32 leg = 0; leg < 2 && (remaining.x != 0.0f || remaining.y != 0.0f); ++leg) {
+		f32         first_time = INFINITY;
+		u32         first_axis = 0;
+		Collider_Id first_hit  = NO_COLLIDER_ID;
+		for (Collider_Id i : hits) {
+			u32 axis = 0;
+			f32 t = swept_time_of_impact(us, remaining, get_collider(i, colliders), &axis);
+			if (t < first_time) {
+				first_time = t;
+				first_axis = axis;
+				first_hit  = i;
 			}
-			result.x_collisions.push((Collision_Report){ them, x.penetration });
 		}
-	}
-	for (u32 i = 0; i < colliders.size; ++i) {
-		if (i == id)
-			continue;
-		Rectangle them = colliders[i];
-		Rectangle minkowski_sum = { them.x - (us.x + result.delta_position.x) - us.w,
-		                           them.y - (us.y + dp.y) - us.h,
-		                           us.w + them.w,
-		                           us.h + them.h };
-		auto y = check_collision_y(minkowski_sum, dp.y);
-		if (y.direction != NO_COLLISION) {
-			if (result.y_collision_direction == NO_COLLISION) {
-				result.y_collision_direction = y.direction;
-				result.delta_position.y += y.penetration;
+
+		if (first_hit == NO_COLLIDER_ID) {
+			us.x += remaining.x;
+			us.y += remaining.y;
+			break;
+		}
+
+		Rectangle them = get_collider(first_hit, colliders);
+		V2 intended_end = { us.x + remaining.x, us.y + remaining.y };
+
+		us.x += first_time * remaining.x;
+		us.y += first_time * remaining.y;
+		if (first_axis == 0) {
+			if (remaining.x > 0.0f) {
+				us.x = them.x - us.w - COLLISION_GAP;
+				result.x_collision_direction = RIGHT_COLLISION;
+			} else {
+				us.x = them.x + them.w + COLLISION_GAP;
+				result.x_collision_direction = LEFT_COLLISION;
 			}
-			result.y_collisions.push((Collision_Report){ them, y.penetration });
+			add_collision_report({ them, us.x - intended_end.x }, result.x_collisions, &result.num_x_collisions);
+			remaining = { 0.0f, (1.0f - first_time) * remaining.y };
+		} else {
+			if (remaining.y > 0.0f) {
+				us.y = them.y - us.h - COLLISION_GAP;
+				result.y_collision_direction = TOP_COLLISION;
+			} else {
+				us.y = them.y + them.h + COLLISION_GAP;
+				result.y_collision_direction = BOTTOM_COLLISION;
+			}
+			add_collision_report({ them, us.y - intended_end.y }, result.y_collisions, &result.num_y_collisions);
+			remaining = { (1.0f - first_time) * remaining.x, 0.0f };
 		}
 	}
 
+	result.delta_position = { us.x - start.x, us.y - start.y };
+
 	return result;
 }
 
@@ -352,24 +428,24 @@ rope_length(Rope *r)
 	
 }
 
+// Casts a short ray down from each bottom corner, both in one batch.
 Check_Grounded_Result
-check_grounded(V2 player_position, f32 player_width, Array<Rectangle> &colliders)
+check_grounded(V2 player_position, f32 player_width, Collider_Store *colliders)
 {
-	Check_Grounded_Result result;
 	f32 ray_length = 0.1f;
-	V2 left_origin = { player_position.x, player_position.y }, left_end = { left_origin.x, left_origin.y - ray_length };
-	V2 right_origin = { player_position.x + player_width, player_position.y }, right_end = { right_origin.x, right_origin.y - ray_length };
-	for (const auto &c : colliders) {
-		V2 top_origin = { c.x, c.y + c.h }, top_end = { c.x + c.w, c.y + c.h };
-		bool l = intersect_line_segments(left_origin, left_end, top_origin, top_end) != INFINITY;
-		bool r = intersect_line_segments(right_origin, right_end, top_origin, top_end) != INFINITY;
-		if (l)
-			result.left = true;
-		if (r)
-			result.right = true;
-		if (l && r)
-			return result;
-	}
+	V2 left_origin  = player_position;
+	V2 right_origin = { player_position.x + player_width, player_position.y };
+
+	Segment_Cast casts[2] = {
+		{ left_origin,  { left_origin.x,  left_origin.y  - ray_length } },
+		{ right_origin, { right_origin.x, right_origin.y - ray_length } },
+	};
+	Segment_Cast_Hit hits[2];
+	cast_segments(casts, 2, NO_COLLIDER_ID, colliders, hits);
+
+	Check_Grounded_Result result;
+	result.left  = hits[0].collider != NO_COLLIDER_ID;
+	result.right = hits[1].collider != NO_COLLIDER_ID;
 	return result;
 }
 
@@ -448,18 +524,20 @@ set_camera_position(Camera *c, V2 p)
 }
 
 void
-player_set_world_position(V2 position, Array<Rectangle> colliders, Player *p)
+player_set_world_position(V2 position, Collider_Store *colliders, Player *p)
 {
 	p->world_position = position;
 
-	colliders[p->collider_id].x = position.x + get_sprite(p->sprite.name)->collider.x;
-	colliders[p->collider_id].y = position.y + get_sprite(p->sprite.name)->collider.y;
+	Rectangle c = get_collider(p->collider_id, colliders);
+	c.x = position.x + get_sprite(p->sprite.name)->collider.x;
+	c.y = position.y + get_sprite(p->sprite.name)->collider.y;
+	set_collider(p->collider_id, c, colliders);
 
-	p->collider = colliders[p->collider_id];
+	p->collider = c;
 }
 
 void
-player_set_world_position_and_update_camera(V2 position, Array<Rectangle> colliders, Camera *c, Player *p)
+player_set_world_position_and_update_camera(V2 position, Collider_Store *colliders, Camera *c, Player *p)
 {
 	player_set_world_position(position, colliders, p);
 
@@ -467,7 +545,7 @@ player_set_world_position_and_update_camera(V2 position, Array<Rectangle> collid
 }
 
 void
-player_set_world_position_resolve_collisions_and_update_camera(V2 position, Array<Rectangle> colliders, Camera *c, Player *p)
+player_set_world_position_resolve_collisions_and_update_camera(V2 position, Collider_Store *colliders, Camera *c, Player *p)
 {
 	player_set_world_position(position, colliders, p);
 
@@ -498,8 +576,10 @@ player_clamp_acceleration(V2 accel, Player *p)
 //void debug_draw_rectangle(Rectangle r, Color c, f32 zlevel, bool is_screen_space, bool asdf = false);
 
 Collision_Check_Result
-player_move(V2 delta_position, s32 input_x, s32 input_y, Array<Rectangle> colliders, Player *p)
+player_move(V2 delta_position, s32 input_x, s32 input_y, Collider_Store *colliders, Player *p)
 {
+	static Array<Collider_Id> candidates = make_array<Collider_Id>(64, 0);
+
 	auto collision_check_result = check_collision(p->collider_id, delta_position, colliders);
 
 	V2 new_player_position = p->world_position + collision_check_result.delta_position;
@@ -513,7 +593,7 @@ player_move(V2 delta_position, s32 input_x, s32 input_y, Array<Rectangle> collid
 	}
 
 	if (was_grounded && !p->grounded) {
-		timer_set(PLAYER_JUMP_GRACE_MS, &p->jump_grace_timer);
+		p->jump_grace_ticks_left = ceil(PLAYER_JUMP_GRACE_MS * SIMULATION_TICK_HZ / 1000.0f);
 	}
 
 	if (p->velocity.y < 0.0f && input_y != -1) {
@@ -527,22 +607,25 @@ player_move(V2 delta_position, s32 input_x, s32 input_y, Array<Rectangle> collid
 		//debug_draw_rectangle(ledge_grab_check_rect, green, 0.1f, false);
 
 		// @TODO: Make this part of the regular collision checking system?
-		for (u32 i = 0; i < colliders.size; ++i) {
+		// Only colliders that overlap the check rectangle can have a corner inside of it.
+		query_colliders(ledge_grab_check_rect, colliders, &candidates);
+		for (Collider_Id i : candidates) {
 			if (i == p->collider_id) {
 				continue;
 			}
 
-			V2 ledge_corner = (p->facing == 1) ? (V2){ colliders[i].x, colliders[i].y + colliders[i].h }
-			                                   : (V2){ colliders[i].x + colliders[i].w, colliders[i].y + colliders[i].h };
+			Rectangle c = get_collider(i, colliders);
+			V2 ledge_corner = (p->facing == 1) ? (V2){ c.x, c.y + c.h }
+			                                   : (V2){ c.x + c.w, c.y + c.h };
 
 			// Check slightly above the ledge we want to grab onto to make sure it isn't blocked by another collider.
 			// And check to make sure the corner actually falls inside of our ledge grab check rectangle.
 			if (!check_collision((V2){ ledge_corner.x, ledge_corner.y + COLLISION_GAP }, colliders, p->collider_id)
 		          && intersect_point_rectangle(ledge_corner, ledge_grab_check_rect)) {
 				if (p->facing == 1) {
-					new_player_position = { colliders[i].x - p->collider.w - COLLISION_GAP, colliders[i].y + colliders[i].h - p->collider.h };
+					new_player_position = { c.x - p->collider.w - COLLISION_GAP, c.y + c.h - p->collider.h };
 				} else {
-					new_player_position = { colliders[i].x + colliders[i].w + COLLISION_GAP, colliders[i].y + colliders[i].h - p->collider.h };
+					new_player_position = { c.x + c.w + COLLISION_GAP, c.y + c.h - p->collider.h };
 				}
 
 				p->grabbing_ledge = true;
@@ -568,7 +651,7 @@ player_move(V2 delta_position, s32 input_x, s32 input_y, Array<Rectangle> collid
 }
 
 void
-player_clamp_and_apply_rope_acceleration(V2 accel, s32 input_x, s32 input_y, Array<Rectangle> colliders, Rope *r, Player *p)
+player_clamp_and_apply_rope_acceleration(V2 accel, s32 input_x, s32 input_y, Collider_Store *colliders, Rope *r, Player *p)
 {
 	accel = player_clamp_acceleration(accel, p);
 
@@ -626,7 +709,7 @@ player_clamp_and_apply_rope_acceleration(V2 accel, s32 input_x, s32 input_y, Arr
 }
 
 void
-player_clamp_and_apply_velocity(V2 accel, s32 input_x, s32 input_y, Array<Rectangle> colliders, Player *p)
+player_clamp_and_apply_velocity(V2 accel, s32 input_x, s32 input_y, Collider_Store *colliders, Player *p)
 {
 	accel = player_clamp_acceleration(accel, p);
 
@@ -636,14 +719,11 @@ player_clamp_and_apply_velocity(V2 accel, s32 input_x, s32 input_y, Array<Rectan
 }
 
 bool
-sweep_rope(V2 sweep_anchor, V2 sweep_start, V2 sweep_end, V2 player_position, Collider_Id player_cid, Array<Rectangle> colliders, bool s, Rope *r)
+sweep_rope(V2 sweep_anchor, V2 sweep_start, V2 sweep_end, V2 player_position, Collider_Store *colliders, bool s, Rope *r)
 {
-	bool sweep_hit = false;
+	static Array<V2> corners = make_array<V2>(64, 0);
 
-	V2  hit_corners[4];
-	V2  first_hit_corner;
-	u32 first_hit_collider_num_hit_corners = 0;
-	f32 first_hit_distance                 = INFINITY;
+	bool sweep_hit = false;
 
 	Sweep sweeps[256]; // @TEMP
 	u32   num_sweeps = 0;
@@ -704,93 +784,69 @@ sweep_rope(V2 sweep_anchor, V2 sweep_start, V2 sweep_end, V2 player_position, Co
 
 	debug_draw_sweeps(sweeps, num_sweeps);
 
-	do {
-		first_hit_collider_num_hit_corners = 0;
-		first_hit_distance = INFINITY;
-
-		for (u32 sweep_i = 0; sweep_i < num_sweeps; ++sweep_i) { 
-			V2 v0 = sweeps[sweep_i].anchor, v1 = sweeps[sweep_i].start, v2 = sweeps[sweep_i].end;
-
-			for (u32 col_i = 0; col_i < colliders.size; ++col_i) {
-				if (col_i == player_cid)
+	for (u32 sweep_i = 0; sweep_i < num_sweeps; ++sweep_i) {
+		V2 v0 = sweeps[sweep_i].anchor, v1 = sweeps[sweep_i].start, v2 = sweeps[sweep_i].end;
+
+		// Any corner the rope can catch on this sweep is inside the triangle's bounds, so the tile corner index is only
+		// queried once per sweep. Each bend moves the anchor inside the old triangle, so the next triangle is inside the old
+		// one, and every pass can throw away the corners that fell outside the last one. Which corner the sweep line reaches
+		// first depends on the pivot, so every pass scans what's left for it again rather than walking an order sorted once.
+		corners.size = 0;
+		query_tile_corners(&colliders->tiles, bounding_rectangle(bounding_rectangle(v0, v1), bounding_rectangle(v1, v2)), &corners);
+
+		while (corners.size > 0) {
+			V2  first_hit_corner;
+			f32 first_hit_distance = INFINITY;
+			u32 first_hit_index    = 0;
+
+			u32 num_inside = 0;
+			for (u32 i = 0; i < corners.size; ++i) {
+				V2 c = corners[i];
+				if (!intersect_point_triangle_ccw(c, v0, v1, v2)) {
 					continue;
-
-				auto c = colliders[col_i];
-
-				// We only care about corner tiles. (Nothing above and below or left and right.)
-				//if (check_collision(colliders, c.x - TILE_SIDE / 2.0f) || check_collision(colliders, c.x + c.w + TILE_SIDE / 2.0f)
-				//&& check_collision(colliders, c.y - TILE_SIDE / 2.0f) || check_collision(colliders, c.y + c.h + TILE_SIDE / 2.0f))
-				//	continue;
-
-				u32 num_hit_corners = 0;
-				V2 col_left_start = { c.x, c.y }, col_left_end = { col_left_start.x, col_left_start.y + c.h };
-				V2 col_right_start = { c.x + c.w, c.y }, col_right_end = { col_right_start.x, col_right_start.y + c.h };
-
-				if (intersect_point_triangle_ccw(col_left_start, v0, v1, v2)) {
-					print_v2(col_left_start);
-					printf("%f %f %f %f\n", c.x, c.y, c.w, c.h);
-					hit_corners[num_hit_corners++] = col_left_start + (V2){ -COLLISION_GAP, -COLLISION_GAP };
-				}
-				if (intersect_point_triangle_ccw(col_left_end, v0, v1, v2)) {
-					print_v2(col_left_end);
-					printf("%f %f %f %f\n", c.x, c.y, c.w, c.h);
-					hit_corners[num_hit_corners++] = col_left_end + (V2){ -COLLISION_GAP, COLLISION_GAP };
-				}
-				if (intersect_point_triangle_ccw(col_right_start, v0, v1, v2)) {
-					print_v2(col_right_start);
-					hit_corners[num_hit_corners++] = col_right_start + (V2){ COLLISION_GAP, -COLLISION_GAP };
 				}
-				if (intersect_point_triangle_ccw(col_right_end, v0, v1, v2)) {
-					print_v2(col_right_end);
-					hit_corners[num_hit_corners++] = col_right_end + (V2){ COLLISION_GAP, COLLISION_GAP };
-				}
-
-				assert(num_hit_corners >= 0 && num_hit_corners <= 4);
-
-				for (u32 j = 0; j < num_hit_corners; ++j) {
-					f32 t = intersect_ray_line_dangerous(hit_corners[j] - v0, v0, v1, v2);
-
-					printf("Checking corner: index: %u dist: %.9g min_dist: %.9g x: %.9g y: %.9g\n", j, t, first_hit_distance, hit_corners[j].x, hit_corners[j].y);
-					if (fabs(t - first_hit_distance) < 0.000001f) {
-						f32 len1 = length2(player_position - first_hit_corner);
-						f32 len2 = length2(player_position - hit_corners[j]);
-
-						printf("LENGTHS %f %f\n", len1, len2);
-
-						if (len2 < len1) {
-							first_hit_corner   = hit_corners[j];
-							first_hit_collider_num_hit_corners = num_hit_corners;
-						}
-					} else if (t < first_hit_distance) {
-						first_hit_corner   = hit_corners[j];
-						first_hit_distance = t;
-						first_hit_collider_num_hit_corners = num_hit_corners;
+				corners[num_inside] = c;
+
+				// The corner the sweep line reaches first is where the rope catches.
+				f32 t = intersect_ray_line_dangerous(c - v0, v0, v1, v2);
+				if (fabs(t - first_hit_distance) < 0.000001f) {
+					if (length2(player_position - c) < length2(player_position - first_hit_corner)) {
+						first_hit_corner = c;
+						first_hit_index  = num_inside;
 					}
+				} else if (t < first_hit_distance) {
+					first_hit_corner   = c;
+					first_hit_distance = t;
+					first_hit_index    = num_inside;
 				}
+				num_inside += 1;
 			}
+			corners.size = num_inside;
 
-			if (first_hit_distance != INFINITY) {
-				printf("Added:\n\t");
-				print_v2(first_hit_corner);
-				if (s) {
-					add_control_point(first_hit_corner, 1, r);
-				} else {
-					add_control_point(first_hit_corner, r->end, r);
-				}
+			if (first_hit_distance == INFINITY) {
+				break;
+			}
 
-				// Get rid of anchor??????
-				sweeps[sweep_i].anchor = first_hit_corner;
-				sweep_hit = true;
+			if (s) {
+				add_control_point(first_hit_corner, 1, r);
+			} else {
+				add_control_point(first_hit_corner, r->end, r);
 			}
+
+			// The rest of the sweep pivots around the new bend.
+			v0 = first_hit_corner;
+			sweeps[sweep_i].anchor = first_hit_corner;
+			corners.remove(first_hit_index);
+			sweep_hit = true;
 		}
-	} while(first_hit_collider_num_hit_corners > 1);
+	}
 
 	return sweep_hit;
 }
 
 // @TODO: Get rid of end_moving?
 void
-add_and_remove_bends(Array<Rectangle> &colliders, V2 prev_rope_start_pos, V2 prev_rope_end_pos, V2 player_position, Collider_Id player_cid, Rope *r)
+add_and_remove_bends(Collider_Store *colliders, V2 prev_rope_start_pos, V2 prev_rope_end_pos, V2 player_position, Rope *r)
 {
 	if (r->extending) {
 		// If the end is moving, we also want to sweep the triangle formed by its movement.
@@ -800,7 +856,7 @@ add_and_remove_bends(Array<Rectangle> &colliders, V2 prev_rope_start_pos, V2 pre
 		V2   end_sweep_0      = prev_rope_end_pos;
 		V2   end_sweep_1      = r->control_points[r->end];
 
-		bool sweep_hit = sweep_rope(end_sweep_anchor, end_sweep_0, end_sweep_1, player_position, player_cid, colliders, false, r);
+		bool sweep_hit = sweep_rope(end_sweep_anchor, end_sweep_0, end_sweep_1, player_position, colliders, false, r);
 		if (sweep_hit && no_bends) {
 			return;
 		}
@@ -810,7 +866,7 @@ add_and_remove_bends(Array<Rectangle> &colliders, V2 prev_rope_start_pos, V2 pre
 	V2 start_sweep_0      = prev_rope_start_pos;
 	V2 start_sweep_1      = r->control_points[0];
 
-	sweep_rope(start_sweep_anchor, start_sweep_0, start_sweep_1, player_position, player_cid, colliders, true, r);
+	sweep_rope(start_sweep_anchor, start_sweep_0, start_sweep_1, player_position, colliders, true, r);
 }
 
 void
@@ -841,8 +897,12 @@ update(const Input &i, Game_State *game_state)
 	Player *p = &game_state->player;
 	Rope   *r = &game_state->rope;
 
+	if (p->jump_grace_ticks_left > 0) {
+		p->jump_grace_ticks_left -= 1;
+	}
+
 	if (i.keyboard.keys[platform_keysym_to_scancode(R_KEY)].pressed) {
-		player_set_world_position_resolve_collisions_and_update_camera(player_start_position, game_state->colliders, &game_state->camera, p);
+		player_set_world_position_resolve_collisions_and_update_camera(player_start_position, &game_state->colliders, &game_state->camera, p);
 		p->velocity = { 0.0f, 0.0f };
 	}
 
@@ -923,13 +983,13 @@ update(const Input &i, Game_State *game_state)
 
 		walk = input_x;
 
-		if ((p->grounded || timer_check_one_shot(&p->jump_grace_timer) == false) && input_jump_pressed) {
+		if ((p->grounded || p->jump_grace_ticks_left > 0) && input_jump_pressed) {
 			accel.y += JUMP_ACCELERATION;
 		}
 		accel.y -= GRAVITY;
 	}
 
-	player_clamp_and_apply_velocity(accel, input_x, input_y, game_state->colliders, p);
+	player_clamp_and_apply_velocity(accel, input_x, input_y, &game_state->colliders, p);
 
 	// @TODO: What order do we apply the rope/movement operations in? Use last frame's position as the start position of the
 	// rope, which prevents us from starting the rope in the wall, but it's kind of stale. Use next frame's position in rope force
@@ -1025,7 +1085,7 @@ update(const Input &i, Game_State *game_state)
 
 		// Should happen after the attach test?
 		if (!debug_mode_bend_test)
-			add_and_remove_bends(game_state->colliders, old_rope_start_position, old_rope_end_position, p->world_position, p->collider_id, r);
+			add_and_remove_bends(&game_state->colliders, old_rope_start_position, old_rope_end_position, p->world_position, r);
 
 		//if (changed_bends) // Update the cast point.
 			//r->start->data.position = player_center(p) + CAST_POINT_DISTANCE_FROM_PLAYER * normalize(r->start->next->data.position - player_center(p));
@@ -1034,43 +1094,16 @@ update(const Input &i, Game_State *game_state)
 	// Recheck to make sure we haven't fully retracted.
 	if (r->out) {
 		// Check for end hits.
-		if (!r->was_attached && !r->was_released)
-		{
-			if (r->cast_direction.x != 0.0f) {
-				print_v2(r->control_points[r->end]);
-				for (u32 i = 0; i < game_state->colliders.size; ++i) {
-					if (i == p->collider_id)
-						continue;
-					auto c  = game_state -> colliders[i];
-					V2   ls = r->cast_direction.x > 0.0f ? (V2){ c.x, c.y } : (V2){ c.x + c.w, c.y };
-					V2   le = { ls.x, ls.y + c.h };
-					f32  t  = intersect_line_segments(old_rope_end_position, r->control_points[r->end], ls, le);
-					printf("%f\n", t);
-					if (t != INFINITY) {
-						// Offset the attach point a bit to create a gap and prevent the rope from creating spurious bends.
-						V2 gap          = r->cast_direction.x > 0.0f ? (V2){ -COLLISION_GAP, 0 } : (V2){ COLLISION_GAP, 0 };
-						V2 attach_point = old_rope_end_position + t * (r->control_points[r->end] - old_rope_end_position) + gap;
-						print_v2(attach_point);
-						rope_attach(attach_point, r);
-					}
-				}
-			}
-			if (r->cast_direction.y != 0.0f) {
-				for (u32 i = 0; i < game_state->colliders.size; ++i) {
-					if (i == p->collider_id)
-						continue;
-					auto c  = game_state -> colliders[i];
-					V2   ls = r->cast_direction.y > 0.0f ? (V2){ c.x, c.y } : (V2){ c.x, c.y + c.h };
-					V2   le = { ls.x + c.w, ls.y };
-					f32  t  = intersect_line_segments(old_rope_end_position, r->control_points[r->end], ls, le);
-					if (t != INFINITY) {
-						// Offset the attach point a bit to create a gap and prevent the rope from creating spurious bends.
-						V2 gap          = r->cast_direction.y > 0.0f ? (V2){0, -COLLISION_GAP} : (V2){0, COLLISION_GAP};
-						V2 attach_point = old_rope_end_position + t * (r->control_points[r->end] - old_rope_end_position) + gap;
-						print_v2(attach_point);
-						rope_attach(attach_point, r);
-					}
-				}
+		if (!r->was_attached && !r->was_released) {
+			Segment_Cast     cast = { old_rope_end_position, r->control_points[r->end] };
+			Segment_Cast_Hit hit;
+			cast_segments(&cast, 1, p->collider_id, &game_state->colliders, &hit);
+
+			if (hit.collider != NO_COLLIDER_ID) {
+				// Offset the attach point a bit to create a gap and prevent the rope from creating spurious bends.
+				V2 d   = cast.end - cast.start;
+				V2 gap = (hit.axis == 0) ? (V2){ -sign(d.x) * COLLISION_GAP, 0.0f } : (V2){ 0.0f, -sign(d.y) * COLLISION_GAP };
+				rope_attach(cast.start + hit.t * d + gap, r);
 			}
 		}
 
@@ -1111,7 +1144,7 @@ update(const Input &i, Game_State *game_state)
 					p->velocity += accel_due_to_rope;
 				}
 */
-				player_clamp_and_apply_rope_acceleration(accel_due_to_stretch, input_x, input_y, game_state->colliders, r, p);
+				player_clamp_and_apply_rope_acceleration(accel_due_to_stretch, input_x, input_y, &game_state->colliders, r, p);
 			}
 
 		}
@@ -1120,10 +1153,10 @@ update(const Input &i, Game_State *game_state)
 	move_camera_towards_player(&game_state->camera, p);
 }
 
-void add_tile(Asset_Id sprite, V2 p, Array<Tile> *tiles, Array<Rectangle> *colliders);
+void add_tile(Asset_Id sprite, V2 p, Array<Tile> *tiles, Collider_Store *colliders);
 
 V2
-set_level_collision_test(Array<Tile> *tiles, Array<Rectangle> *colliders)
+set_level_collision_test(Array<Tile> *tiles, Collider_Store *colliders)
 {
 	f32 tile_side = 36.0f * meters_per_pixel; // @TEMP: Need a better way to figure this out.
 
@@ -1141,7 +1174,7 @@ set_level_collision_test(Array<Tile> *tiles, Array<Rectangle> *colliders)
 }
 
 V2
-set_level_rope_test_one(Array<Tile> *tiles, Array<Rectangle> *colliders)
+set_level_rope_test_one(Array<Tile> *tiles, Collider_Store *colliders)
 {
 	f32 horizontal_gap_width = TILE_SIDE_IN_METERS * 5;
 	f32 vertical_gap_width = TILE_SIDE_IN_METERS * 3;
@@ -1193,158 +1226,649 @@ align_to_tile_grid(V2 world_position)
 	return world_position;
 }
 
+// What a tile is filed under in the tile grid: a point in the middle of it, so it only goes in the cell it sits in.
+inline Rectangle
+tile_grid_rectangle(V2 tile_position)
+{
+	return { tile_position.x + (TILE_SIDE_IN_METERS / 2.0f), tile_position.y + (TILE_SIDE_IN_METERS / 2.0f), 0.0f, 0.0f };
+}
+
+// Tile collisions only change the tile map; update_tile_colliders merges the touched regions afterwards.
 void
 move_tile(V2 dp, u32 tile_index, Game_State *gs)
 {
-	Tile *     t = &gs->tiles[tile_index];
-	Rectangle *c = &gs->colliders[t->collider_id];
+	Tile *t = &gs->tiles[tile_index];
+
+	if (!(t->flags & HIDE_TILE_FLAG)) {
+		tile_collision_remove(&gs->colliders.tiles, t->world_position);
+	}
 
+	V2 old_position = t->world_position;
 	t->world_position.x = (t->world_position.x + dp.x);
 	t->world_position.y = (t->world_position.y + dp.y);
+	spatial_grid_move(&gs->colliders.tile_grid, tile_index, tile_grid_rectangle(old_position), tile_grid_rectangle(t->world_position));
 
-	c->x = t->world_position.x + get_sprite(t->sprite.name)->collider.x;
-	c->y = t->world_position.y + get_sprite(t->sprite.name)->collider.y;
+	if (!(t->flags & HIDE_TILE_FLAG)) {
+		tile_collision_add(&gs->colliders.tiles, t->world_position);
+	}
+}
+
+void
+add_tile(const char *sprite_name, V2 p, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	array_add(tiles, (Tile){ make_sprite_instance(sprite_name, false), p, 0 });
+	tile_collision_add(&colliders->tiles, p);
+	spatial_grid_insert(&colliders->tile_grid, tiles->size - 1, tile_grid_rectangle(p));
 }
 
+// Appends the indices of the tiles overlapping the area, hidden or not, in increasing order.
 void
-add_tile(const char *sprite_name, V2 p, Array<Tile> *tiles, Array<Rectangle> *colliders)
+query_tiles(Rectangle area, Array<Tile> *tiles, Collider_Store *colliders, Array<u32> *results)
 {
-	tiles->push((Tile){ make_sprite_instance(sprite_name, false), p, add_collider(p.x, p.y, TILE_SIDE_IN_METERS, TILE_SIDE_IN_METERS, colliders) });
-	//Rectangle collider = assets.associated_data[id].sprite_collider;
-	//if (collider != NO_COLLIDER)
-		//add_collider(tile.x + collider.x, tile.y + collider.y, collider.w, collider.h, colliders);
-	//(*tiles)[tiles->size - 1].collider_id ;
+	static Array<u32> candidates = make_array<u32>(256, 0);
+	candidates.size = 0;
+
+	// Tiles are filed by their middle, so any tile overlapping the area has its middle within half a tile of it.
+	f32 half_side = TILE_SIDE_IN_METERS / 2.0f;
+	spatial_grid_query(&colliders->tile_grid, { area.x - half_side, area.y - half_side, area.w + TILE_SIDE_IN_METERS, area.h + TILE_SIDE_IN_METERS }, &candidates);
+	qsort(candidates.data, candidates.size, sizeof(u32), [](const void *a, const void *b) {
+		return (*(const u32 *)a > *(const u32 *)b) - (*(const u32 *)a < *(const u32 *)b);
+	});
+
+	for (u32 i : candidates) {
+		Rectangle tile_rect = { (*tiles)[i].world_position.x, (*tiles)[i].world_position.y, TILE_SIDE_IN_METERS, TILE_SIDE_IN_METERS };
+		if (intersect_rectangle_rectangle(area, tile_rect)) {
+			array_add(results, i);
+		}
+	}
 }
 
 // @TODO: The memory for the tiles and the tile colliders should probably live in the same place. Also move the player out of the colliders.
 u32
-remove_tile(Array<Tile> *tiles, Array<Rectangle> *colliders, u32 index)
+remove_tile(Array<Tile> *tiles, Collider_Store *colliders, u32 index)
 {
-	array_remove(colliders, (*tiles)[index].collider_id);
-	array_remove(tiles, index);
+	if (!((*tiles)[index].flags & HIDE_TILE_FLAG)) {
+		tile_collision_remove(&colliders->tiles, (*tiles)[index].world_position);
+	}
+
+	// The last tile takes its place, so it's the only other tile whose index changes.
+	u32 last = tiles->size - 1;
+	spatial_grid_remove(&colliders->tile_grid, index, tile_grid_rectangle((*tiles)[index].world_position));
+	if (index != last) {
+		Rectangle r = tile_grid_rectangle((*tiles)[last].world_position);
+		spatial_grid_remove(&colliders->tile_grid, last, r);
+		spatial_grid_insert(&colliders->tile_grid, index, r);
+		(*tiles)[index] = (*tiles)[last];
+	}
+	tiles->size -= 1;
 
-	// @TODO: Figure out a proper data structure for the tiles that will allow us to remove without having to mess with the index!
+	// The index now holds the tile that was last, so a loop over the tiles has to look at it again.
 	return index - 1;
 }
 
+// Hidden tiles don't collide.
 void
-hide_tile(Array<Tile> *tiles, u32 index)
+hide_tile(Array<Tile> *tiles, Collider_Store *colliders, u32 index)
 {
-	(*tiles)[index].flags |= HIDE_TILE_FLAG;
+	Tile *t = &(*tiles)[index];
+	if (!(t->flags & HIDE_TILE_FLAG)) {
+		tile_collision_remove(&colliders->tiles, t->world_position);
+	}
+	t->flags |= HIDE_TILE_FLAG;
 }
 
 void
-unhide_tile(Array<Tile> *tiles, u32 index)
+unhide_tile(Array<Tile> *tiles, Collider_Store *colliders, u32 index)
 {
-	(*tiles)[index].flags &= ~HIDE_TILE_FLAG;
+	Tile *t = &(*tiles)[index];
+	if (t->flags & HIDE_TILE_FLAG) {
+		tile_collision_add(&colliders->tiles, t->world_position);
+	}
+	t->flags &= ~HIDE_TILE_FLAG;
 }
 
-#include "editor.cpp"
+#define LEVEL_PATH        "../data/level.lvl"
+#define LEGACY_LEVEL_PATH "../data/level.txt"
+
+inline u32
+align_level_offset(u32 offset)
+{
+	return (offset + 3) & ~3u;
+}
+
+// The text format levels used to be saved in. Only read if there's no level file yet, the editor saves the new format.
+bool
+load_legacy_level(Array<Tile> *tiles, Collider_Store *colliders)
+{
+	FILE *fh = fopen(LEGACY_LEVEL_PATH, "r");
+	if (!fh) {
+		return false;
+	}
+	DEFER(fclose(fh));
+
+	u32 num_tiles = 0;
+	fscanf(fh, "%u", &num_tiles);
+
+	char name_buf[256];
+	for (u32 i = 0; i < num_tiles; ++i) {
+		s32 tile_x = 0, tile_y = 0;
+		fscanf(fh, "%255s %d %d", name_buf, &tile_x, &tile_y);
+
+		add_tile(name_buf, (V2){ tile_x * TILE_SIDE_IN_METERS, tile_y * TILE_SIDE_IN_METERS }, tiles, colliders);
+	}
+	return true;
+}
+
+// Checks that a section of count records of the given size starting at offset lies inside the file.
+inline bool
+level_section_fits(u32 offset, u32 count, size_t record_size, size_t file_size)
+{
+	return offset <= file_size && count <= (file_size - offset) / record_size;
+}
+
+// Adds the tiles of a level file (or chunk file) to the level, using the file's memory in place: the sprite names are
+// resolved once each, and the saved colliders are installed as they are instead of merging the tiles again. Nothing is
+// added if the file is bad.
+bool
+load_level_data(const char *file, size_t file_size, const char *path, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	auto *h = (const Level_File_Header *)file;
+	if (file_size < sizeof(*h) || h->magic != LEVEL_FILE_MAGIC) {
+		log_print(MAJOR_ERROR_LOG, "%s is not a level file.", path);
+		return false;
+	}
+	if (h->version != LEVEL_FILE_VERSION) {
+		log_print(MAJOR_ERROR_LOG, "Level file %s has version %u, expected %u.", path, h->version, LEVEL_FILE_VERSION);
+		return false;
+	}
+	if (h->file_size != file_size
+	 || !level_section_fits(h->sprite_names_offset, h->num_sprite_names, sizeof(u32), file_size)
+	 || !level_section_fits(h->strings_offset, h->strings_size, 1, file_size)
+	 || !level_section_fits(h->tiles_offset, h->num_tiles, sizeof(Level_File_Tile), file_size)
+	 || !level_section_fits(h->regions_offset, h->num_regions, sizeof(Level_File_Region), file_size)
+	 || !level_section_fits(h->colliders_offset, h->num_colliders, sizeof(Level_File_Collider), file_size)
+	 || (h->strings_size == 0 && h->num_sprite_names != 0)
+	 || (h->strings_size > 0 && file[h->strings_offset + h->strings_size - 1] != '\0')) {
+		log_print(MAJOR_ERROR_LOG, "Level file %s is truncated.", path);
+		return false;
+	}
+
+	auto *name_offsets   = (const u32 *)(file + h->sprite_names_offset);
+	auto *file_tiles     = (const Level_File_Tile *)(file + h->tiles_offset);
+	auto *file_regions   = (const Level_File_Region *)(file + h->regions_offset);
+	auto *file_colliders = (const Level_File_Collider *)(file + h->colliders_offset);
+
+	static Array<Sprite_Instance> sprites = make_array<Sprite_Instance, false>(16, 0);
+	sprites.size = 0;
+	for (u32 i = 0; i < h->num_sprite_names; ++i) {
+		if (name_offsets[i] >= h->strings_size || strlen(file + h->strings_offset + name_offsets[i]) >= SPRITE_INSTANCE_NAME_BUFFER_LENGTH) {
+			log_print(MAJOR_ERROR_LOG, "Level file %s has a bad sprite name.", path);
+			return false;
+		}
+		array_add(&sprites, make_sprite_instance(file + h->strings_offset + name_offsets[i], false));
+	}
+
+	for (u32 i = 0; i < h->num_tiles; ++i) {
+		if (file_tiles[i].sprite >= sprites.size) {
+			log_print(MAJOR_ERROR_LOG, "Level file %s has a tile with sprite %u, but only %u sprites.", path, file_tiles[i].sprite, (u32)sprites.size);
+			return false;
+		}
+	}
+
+	// Make room for all the tiles up front.
+	u32 first_tile = tiles->size;
+	tiles->resize(first_tile + h->num_tiles);
+	tiles->size = first_tile;
+	for (u32 i = 0; i < h->num_tiles; ++i) {
+		Level_File_Tile ft = file_tiles[i];
+		V2 p = { ft.x * TILE_SIDE_IN_METERS, ft.y * TILE_SIDE_IN_METERS };
+		tiles->push((Tile){ sprites[ft.sprite], p, 0 });
+		tile_collision_add(&colliders->tiles, p);
+		spatial_grid_insert(&colliders->tile_grid, tiles->size - 1, tile_grid_rectangle(p));
+	}
+
+	for (u32 i = 0; i < h->num_regions; ++i) {
+		Level_File_Region fr = file_regions[i];
+		if (fr.first_collider > h->num_colliders || fr.num_colliders > h->num_colliders - fr.first_collider) {
+			continue;
+		}
+		set_tile_region_colliders(&colliders->tiles, fr.x, fr.y, file_colliders + fr.first_collider, fr.num_colliders, colliders);
+	}
+
+	return true;
+}
+
+bool
+load_level_file(const char *path, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	size_t file_size = 0;
+	const char *file = platform_map_file(path, &file_size);
+	if (!file) {
+		return false;
+	}
+	DEFER(platform_unmap_file(file, file_size));
+
+	return load_level_data(file, file_size, path, tiles, colliders);
+}
 
 void
-application_entry()
+load_level(Array<Tile> *tiles, Collider_Store *colliders)
 {
-	assert(ROPE_EXTEND_RATE  > MAX_X_VELOCITY && ROPE_EXTEND_RATE  > MAX_Y_VELOCITY);
-	assert(ROPE_RETRACT_RATE > MAX_X_VELOCITY && ROPE_RETRACT_RATE > MAX_Y_VELOCITY);
+	// Only the tiles' colliders go, the player's collider has to survive a reload.
+	clear_tile_colliders(colliders);
+	array_reset(tiles);
 
-	TILE_SIDE_IN_METERS = 16.0f * meters_per_pixel; // @TEMP: Need a better way to figure this out.
+	u64 start_us = platform_get_time_us();
+	if (!load_level_file(LEVEL_PATH, tiles, colliders) && !load_legacy_level(tiles, colliders)) {
+		log_print(MAJOR_ERROR_LOG, "Could not load a level from %s or %s.", LEVEL_PATH, LEGACY_LEVEL_PATH);
+	}
 
-	// Load font.
-	{
-		FT_Library ft;
-		if (FT_Init_FreeType(&ft))
-			_abort("FREETYPE: Could not init FreeType Library.");
+	update_tile_colliders(colliders);
+	u64 elapsed_us = platform_get_time_us() - start_us;
+
+	u32 num_tile_colliders = 0;
+	for (auto &r : colliders->tiles.regions) {
+		num_tile_colliders += r.colliders.size;
+	}
+	log_print(STANDARD_LOG, "Loaded %u tiles, merged into %u colliders, in %.3f ms.", tiles->size, num_tile_colliders, elapsed_us / 1000.0);
+}
 
-		FT_Face face;
-		if (FT_New_Face(ft, "../data/fonts/arial.ttf", 0, &face))
-			_abort("FREETYPE: Failed to load font.");
+Level_Save level_save;
 
-		FT_Set_Pixel_Sizes(face, 0, 30);
+// Copies the tiles and their merged colliders into the save, so the level can go on changing while a job thread writes it
+// out. Returns false if the last save is still being written.
+bool
+begin_level_save(Level_Save *ls, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	if (__atomic_load_n(&ls->state, __ATOMIC_ACQUIRE) == LEVEL_SAVE_RUNNING) {
+		log_print(MINOR_ERROR_LOG, "Still saving the level, try again when it's done.");
+		return false;
+	}
 
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Disable byte-alignment restriction
+	if (!ls->tiles.data) {
+		ls->tiles          = make_array<Tile, false>(tiles->size, 0);
+		ls->regions        = make_array<Level_File_Region>(64, 0);
+		ls->colliders      = make_array<Level_File_Collider>(256, 0);
+		ls->files          = make_array<Level_Save_File>(16, 0);
+		ls->names          = make_array<const char *>(16, 0);
+		ls->file_tiles     = make_array<Level_File_Tile>(256, 0);
+		ls->file_regions   = make_array<Level_File_Region>(64, 0);
+		ls->file_colliders = make_array<Level_File_Collider>(256, 0);
+	}
+	ls->start_us       = platform_get_time_us();
+	ls->progress       = 0.0f;
+	ls->regions.size   = 0;
+	ls->colliders.size = 0;
+	ls->files.size     = 0;
 
-		for (GLubyte c = 0; c < 128; c++)
-		{
-			// Load character glyph 
-			if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-				log_print(MAJOR_ERROR_LOG, "FREETYTPE: Failed to load glyph '%c'.", c);
-				continue;
-			}
-			// Generate texture
-			GLuint texture;
-			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
-			glTexImage2D(
-					GL_TEXTURE_2D,
-					0,
-					GL_RED,
-					face->glyph->bitmap.width,
-					face->glyph->bitmap.rows,
-					0,
-					GL_RED,
-					GL_UNSIGNED_BYTE,
-					face->glyph->bitmap.buffer
-				    );
-			// Set texture options
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			// Now store character for later use
-			Glyph character = {
-				texture, 
-				{ face->glyph->bitmap.width, face->glyph->bitmap.rows },
-				{ face->glyph->bitmap_left, face->glyph->bitmap_top },
-				face->glyph->advance.x
-			};
-			characters[c] = character;
+	update_tile_colliders(colliders);
+
+	ls->tiles.resize(tiles->size);
+	memcpy(ls->tiles.data, tiles->data, tiles->size * sizeof(Tile));
+
+	f32 side = colliders->tiles.tile_side;
+	for (Tile_Region &r : colliders->tiles.regions) {
+		if (r.colliders.size == 0) {
+			continue;
+		}
+
+		array_add(&ls->regions, (Level_File_Region){ r.x, r.y, (u32)ls->colliders.size, (u32)r.colliders.size });
+		for (Collider_Id id : r.colliders) {
+			Rectangle c = get_collider(id, colliders);
+			array_add(&ls->colliders, (Level_File_Collider){ (s16)lround(c.x / side), (s16)lround(c.y / side), (s16)lround(c.w / side), (s16)lround(c.h / side) });
 		}
 	}
 
-	Game_State game_state;
-	{
-		game_state.colliders = make_array<Rectangle>(2056, 0); // @TEMP
-		game_state.tiles     = make_array<Tile>(2056, 0);      // @TEMP
+	return true;
+}
 
-		game_state.player.sprite         = make_sprite_instance("player_run");
-		game_state.player.world_position = { 0.0f, 0.0f };
-		game_state.player.facing         = 1;
-		game_state.player.velocity       = { 0.0f, 0.0f };
-		game_state.player.collider_id    = add_sprite_collider("player_run", &game_state.colliders);
-		game_state.player.collider       = game_state.colliders[game_state.player.collider_id];
-		game_state.player.grounded       = false;
-		game_state.player.grabbing_ledge = false;
+void
+add_level_save_file(Level_Save *ls, const char *path, V2s min, V2s max, bool remove = false)
+{
+	Level_Save_File f;
+	snprintf(f.path, sizeof(f.path), "%s", path);
+	f.min    = min;
+	f.max    = max;
+	f.remove = remove;
+	array_add(&ls->files, f);
+}
 
-		game_state.camera.view_vector = { 0.0f, 0.0f };
-		game_state.camera.position    = { 0.0f, 0.0f };
+// Writes the data next to the path, syncs it and renames it over the path, so a crash leaves either the old file or the
+// new one, never part of one.
+bool
+replace_file(const char *path, const char *data, size_t size, f32 progress_start, f32 progress_end, Level_Save *ls)
+{
+	char temp_path[256 + 4];
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
 
-		game_state.rope.unstretched_length = 0.0f;
-		game_state.rope.extending          = false;
-		game_state.rope.retracting         = false;
-		game_state.rope.out                = false;
-		game_state.rope.was_attached       = false;
-		game_state.rope.end_moving         = false;
-		game_state.rope.control_points     = make_array<V2>(256, 0); // @TEMP
+	File_Handle fh = platform_open_file(temp_path, O_WRONLY | O_CREAT | O_TRUNC);
+	if (fh == FILE_HANDLE_ERROR) {
+		return false;
 	}
 
-	//player_start_position = set_level_rope_test_one(&game_state.tiles, &game_state.colliders);
-	load_level(&game_state.tiles, &game_state.colliders);
-	player_set_world_position_resolve_collisions_and_update_camera(player_start_position, game_state.colliders, &game_state.camera, &game_state.player);
+	// In pieces, so the editor can show how far along it is.
+	const size_t piece_size = 64 * 1024;
+	bool ok = true;
+	for (size_t written = 0; written < size && ok; written += piece_size) {
+		ok = platform_write_file(fh, fmin(piece_size, size - written), data + written);
+		ls->progress = progress_start + (progress_end - progress_start) * fmin(1.0f, (f32)(written + piece_size) / size);
+	}
+	ok = ok && platform_sync_file(fh);
+	ok = platform_close_file(fh) && ok;
+	ok = ok && platform_rename_file(temp_path, path);
+	ok = ok && platform_sync_directory_of(path);
 
-	set_camera_position(&game_state.camera, player_center(&game_state.player));
+	if (!ok) {
+		platform_remove_file(temp_path);
+	}
+	return ok;
+}
 
-	// @TODO: Use real monitor refresh rate.
-	f32 game_update_hz = 60.0f;
-	f32 target_seconds_per_frame = 1.0f / game_update_hz;
+// Lays out one file of the save in the level file format and writes it.
+bool
+write_level_file(Level_Save *ls, Level_Save_File *f, f32 progress_start, f32 progress_end)
+{
+	ls->names.size = ls->file_tiles.size = ls->file_regions.size = ls->file_colliders.size = 0;
+
+	u32 strings_size = 0;
+	for (Tile &t : ls->tiles) {
+		// Hidden tiles are how the editor deletes them, and the merged colliders already leave them out.
+		if (t.flags & HIDE_TILE_FLAG) {
+			continue;
+		}
+		s32 x = lround(t.world_position.x / TILE_SIDE_IN_METERS);
+		s32 y = lround(t.world_position.y / TILE_SIDE_IN_METERS);
+		if (x < f->min.x || x >= f->max.x || y < f->min.y || y >= f->max.y) {
+			continue;
+		}
+		if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX) {
+			log_print(MAJOR_ERROR_LOG, "Tile at %d %d is too far out to save.", x, y);
+			return false;
+		}
+
+		u32 sprite = 0;
+		while (sprite < ls->names.size && strcmp(ls->names[sprite], t.sprite.name) != 0) {
+			sprite += 1;
+		}
+		if (sprite == ls->names.size) {
+			array_add(&ls->names, (const char *)t.sprite.name);
+			strings_size += strlen(t.sprite.name) + 1;
+		}
+		array_add(&ls->file_tiles, (Level_File_Tile){ (s16)x, (s16)y, (u16)sprite });
+	}
+
+	for (Level_File_Region r : ls->regions) {
+		if (r.x * TILE_REGION_SIDE < f->min.x || (r.x + 1) * TILE_REGION_SIDE > f->max.x || r.y * TILE_REGION_SIDE < f->min.y || (r.y + 1) * TILE_REGION_SIDE > f->max.y) {
+			continue;
+		}
+		array_add(&ls->file_regions, (Level_File_Region){ r.x, r.y, (u32)ls->file_colliders.size, r.num_colliders });
+		for (u32 i = 0; i < r.num_colliders; ++i) {
+			array_add(&ls->file_colliders, ls->colliders[r.first_collider + i]);
+		}
+	}
+
+	Level_File_Header h = {};
+	h.magic               = LEVEL_FILE_MAGIC;
+	h.version             = LEVEL_FILE_VERSION;
+	h.num_sprite_names    = ls->names.size;
+	h.sprite_names_offset = align_level_offset(sizeof(h));
+	h.strings_offset      = h.sprite_names_offset + (ls->names.size * sizeof(u32));
+	h.strings_size        = strings_size;
+	h.num_tiles           = ls->file_tiles.size;
+	h.tiles_offset        = align_level_offset(h.strings_offset + strings_size);
+	h.num_regions         = ls->file_regions.size;
+	h.regions_offset      = align_level_offset(h.tiles_offset + (ls->file_tiles.size * sizeof(Level_File_Tile)));
+	h.num_colliders       = ls->file_colliders.size;
+	h.colliders_offset    = align_level_offset(h.regions_offset + (ls->file_regions.size * sizeof(Level_File_Region)));
+	h.file_size           = h.colliders_offset + (ls->file_colliders.size * sizeof(Level_File_Collider));
+
+	char *buffer = (char *)emalloc(h.file_size);
+	DEFER(free(buffer));
+	memset(buffer, 0, h.file_size);
+
+	memcpy(buffer, &h, sizeof(h));
+	u32 string_offset = 0;
+	for (u32 i = 0; i < ls->names.size; ++i) {
+		memcpy(buffer + h.sprite_names_offset + (i * sizeof(u32)), &string_offset, sizeof(u32));
+		strcpy(buffer + h.strings_offset + string_offset, ls->names[i]);
+		string_offset += strlen(ls->names[i]) + 1;
+	}
+	memcpy(buffer + h.tiles_offset, ls->file_tiles.data, ls->file_tiles.size * sizeof(Level_File_Tile));
+	memcpy(buffer + h.regions_offset, ls->file_regions.data, ls->file_regions.size * sizeof(Level_File_Region));
+	memcpy(buffer + h.colliders_offset, ls->file_colliders.data, ls->file_colliders.size * sizeof(Level_File_Collider));
+
+	return replace_file(f->path, buffer, h.file_size, progress_start, progress_end, ls);
+}
+
+// Runs on a job thread.
+void
+level_save_job_callback(void *job_data)
+{
+	Level_Save *ls = (Level_Save *)job_data;
+
+	bool ok = true;
+	u32 num_tiles_saved = 0;
+	for (u32 i = 0; i < ls->files.size; ++i) {
+		Level_Save_File *f = &ls->files[i];
+		if (f->remove) {
+			ok = platform_remove_file(f->path) && platform_sync_directory_of(f->path) && ok;
+		} else {
+			ok = write_level_file(ls, f, (f32)i / ls->files.size, (f32)(i + 1) / ls->files.size) && ok;
+			num_tiles_saved += ls->file_tiles.size;
+		}
+		ls->progress = (f32)(i + 1) / ls->files.size;
+	}
+
+	if (ok) {
+		log_print(STANDARD_LOG, "Saved %u tiles to %u files in %.3f ms.", num_tiles_saved, (u32)ls->files.size, (platform_get_time_us() - ls->start_us) / 1000.0);
+	} else {
+		log_print(MAJOR_ERROR_LOG, "Could not save the level, the files that failed keep what they had before.");
+	}
+	__atomic_store_n(&ls->state, ok ? LEVEL_SAVE_DONE : LEVEL_SAVE_FAILED, __ATOMIC_RELEASE);
+}
+
+// Hands the save to a job thread. Done with the files added since begin_level_save().
+void
+queue_level_save(Level_Save *ls)
+{
+	__atomic_store_n(&ls->state, LEVEL_SAVE_RUNNING, __ATOMIC_RELEASE);
+	add_job(ls, level_save_job_callback, &job_queue);
+}
+
+bool
+save_level(const char *path, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	if (!begin_level_save(&level_save, tiles, colliders)) {
+		return false;
+	}
+	add_level_save_file(&level_save, path, (V2s){ INT16_MIN, INT16_MIN }, (V2s){ INT16_MAX + 1, INT16_MAX + 1 });
+	queue_level_save(&level_save);
+	return true;
+}
+
+// The keys update() reads. Recorded input only has to store these.
+Key_Symbol game_button_keys[] = { W_KEY, A_KEY, S_KEY, D_KEY, J_KEY, K_KEY, R_KEY };
+#define NUM_GAME_BUTTONS (sizeof(game_button_keys) / sizeof(game_button_keys[0]))
+
+// Packs the state of each game button into a u32: bit i of byte 0 is set if game_button_keys[i] is down, of byte 1 if it was
+// pressed and of byte 2 if it was released. A tap that starts and ends between two ticks shows up as pressed and released.
+u32
+get_game_buttons(const Input &in)
+{
+	u32 buttons = 0;
+	for (u32 i = 0; i < NUM_GAME_BUTTONS; ++i) {
+		const IO_Button &b = in.keyboard.keys[platform_keysym_to_scancode(game_button_keys[i])];
+		buttons |= (b.down     ? 1 : 0) << i;
+		buttons |= (b.pressed  ? 1 : 0) << (i + 8);
+		buttons |= (b.released ? 1 : 0) << (i + 16);
+	}
+	return buttons;
+}
+
+// Rebuilds the keyboard state update() saw from get_game_buttons().
+void
+set_game_buttons(u32 buttons, Input *in)
+{
+	for (u32 i = 0; i < NUM_GAME_BUTTONS; ++i) {
+		IO_Button *b = &in->keyboard.keys[platform_keysym_to_scancode(game_button_keys[i])];
+		b->down     = (buttons >> i) & 1;
+		b->pressed  = (buttons >> (i + 8)) & 1;
+		b->released = (buttons >> (i + 16)) & 1;
+	}
+}
+
+// Hashes everything the simulation carries from one tick to the next. Two runs that agree on this hash every tick have
+// done the same thing. Sprite timing is left out since it runs off the wall clock and doesn't feed back into the physics.
+u64
+hash_game_state(Game_State *gs)
+{
+	Player *p = &gs->player;
+	Rope   *r = &gs->rope;
+
+	u64 h = FNV1A_64_OFFSET_BASIS;
+	h = hash_bytes(&p->collider, sizeof(p->collider), h);
+	h = hash_bytes(&p->facing, sizeof(p->facing), h);
+	h = hash_bytes(&p->world_position, sizeof(p->world_position), h);
+	h = hash_bytes(&p->velocity, sizeof(p->velocity), h);
+	h = hash_bytes(&p->grounded, sizeof(p->grounded), h);
+	h = hash_bytes(&p->grabbing_ledge, sizeof(p->grabbing_ledge), h);
+	h = hash_bytes(&p->jump_grace_ticks_left, sizeof(p->jump_grace_ticks_left), h);
+
+	bool rope_flags[] = { r->out, r->extending, r->retracting, r->was_attached, r->was_released, r->end_moving };
+	h = hash_bytes(rope_flags, sizeof(rope_flags), h);
+	h = hash_bytes(&r->cast_direction, sizeof(r->cast_direction), h);
+	h = hash_bytes(&r->unstretched_length, sizeof(r->unstretched_length), h);
+	h = hash_bytes(&r->end, sizeof(r->end), h);
+	h = hash_bytes(&r->control_points.size, sizeof(r->control_points.size), h);
+	h = hash_bytes(r->control_points.data, r->control_points.size * sizeof(V2), h);
+
+	h = hash_bytes(&gs->camera.position, sizeof(gs->camera.position), h);
+
+	return h;
+}
+
+bool level_chunks_exist();
+void start_level_stream(Level_Stream *ls, V2 camera_position, Array<Tile> *tiles, Collider_Store *colliders);
+
+// Sets up the game and loads the level. Shared by the windowed and headless builds so they start from the same state.
+void
+init_game_state(Game_State *game_state)
+{
+	assert(ROPE_EXTEND_RATE  > MAX_X_VELOCITY && ROPE_EXTEND_RATE  > MAX_Y_VELOCITY);
+	assert(ROPE_RETRACT_RATE > MAX_X_VELOCITY && ROPE_RETRACT_RATE > MAX_Y_VELOCITY);
+
+	TILE_SIDE_IN_METERS = 16.0f * meters_per_pixel; // @TEMP: Need a better way to figure this out.
+
+	game_state->colliders = make_collider_store(2056, TILE_SIDE_IN_METERS, TILE_SIDE_IN_METERS);
+	game_state->tiles     = make_array<Tile>(2056, 0);
+
+	game_state->player.sprite                = make_sprite_instance("player_run");
+	game_state->player.world_position        = { 0.0f, 0.0f };
+	game_state->player.facing                = 1;
+	game_state->player.velocity              = { 0.0f, 0.0f };
+	game_state->player.collider_id           = add_sprite_collider("player_run", &game_state->colliders);
+	game_state->player.collider              = get_collider(game_state->player.collider_id, &game_state->colliders);
+	game_state->player.grounded              = false;
+	game_state->player.grabbing_ledge        = false;
+	game_state->player.jump_grace_ticks_left = 0;
+
+	game_state->camera.view_vector = { 0.0f, 0.0f };
+	game_state->camera.position    = { 0.0f, 0.0f };
+
+	game_state->rope.cast_direction     = { 0.0f, 0.0f };
+	game_state->rope.unstretched_length = 0.0f;
+	game_state->rope.extending          = false;
+	game_state->rope.retracting         = false;
+	game_state->rope.out                = false;
+	game_state->rope.was_attached       = false;
+	game_state->rope.was_released       = false;
+	game_state->rope.end_moving         = false;
+	game_state->rope.control_points     = make_array<V2>(256, 0); // @TEMP
+	game_state->rope.end                = 0;
+
+	//player_start_position = set_level_rope_test_one(&game_state->tiles, &game_state->colliders);
+	game_state->level_stream.enabled = false;
+	if (level_chunks_exist()) {
+		start_level_stream(&game_state->level_stream, game_state->camera.position, &game_state->tiles, &game_state->colliders);
+	} else {
+		load_level(&game_state->tiles, &game_state->colliders);
+	}
+	player_set_world_position_resolve_collisions_and_update_camera(player_start_position, &game_state->colliders, &game_state->camera, &game_state->player);
+
+	set_camera_position(&game_state->camera, player_center(&game_state->player));
+}
+
+#include "level_stream.cpp"
+#include "replay.cpp"
+
+#ifdef HEADLESS
+#include "headless.cpp"
+#else
+#include "editor.cpp"
+
+// Key and button edges from frames that didn't run a simulation tick carry over to the next tick that does, so a quick tap
+// isn't lost on a fast display and isn't seen twice when a frame runs several ticks.
+void
+accumulate_simulation_input(const Input &frame, Input *simulation)
+{
+	for (u32 i = 0; i < MAX_SCANCODES; ++i) {
+		simulation->keyboard.keys[i].down      = frame.keyboard.keys[i].down;
+		simulation->keyboard.keys[i].pressed  |= frame.keyboard.keys[i].pressed;
+		simulation->keyboard.keys[i].released |= frame.keyboard.keys[i].released;
+	}
+	for (u32 i = 0; i < NUM_MOUSE_BUTTONS; ++i) {
+		simulation->mouse.buttons[i].down      = frame.mouse.buttons[i].down;
+		simulation->mouse.buttons[i].pressed  |= frame.mouse.buttons[i].pressed;
+		simulation->mouse.buttons[i].released |= frame.mouse.buttons[i].released;
+	}
+	simulation->mouse.position        = frame.mouse.position;
+	simulation->mouse.delta_position += frame.mouse.delta_position;
+}
+
+void
+consume_simulation_input_edges(Input *simulation)
+{
+	for (u32 i = 0; i < MAX_SCANCODES; ++i) {
+		simulation->keyboard.keys[i].pressed  = 0;
+		simulation->keyboard.keys[i].released = 0;
+	}
+	for (u32 i = 0; i < NUM_MOUSE_BUTTONS; ++i) {
+		simulation->mouse.buttons[i].pressed  = 0;
+		simulation->mouse.buttons[i].released = 0;
+	}
+	simulation->mouse.delta_position = { 0.0f, 0.0f };
+}
+
+void
+application_entry()
+{
+	Game_State game_state;
+	init_game_state(&game_state);
+
+	// The simulation always advances in whole ticks of the same length, whatever the display rate. Rendering interpolates
+	// between the last two ticks to cover the leftover time.
+	f32 seconds_per_tick = 1.0f / SIMULATION_TICK_HZ;
+	f32 tick_accumulator = 0.0f;
 
 	Input input;
+	Input simulation_input;
 	platform_update_mouse_position(&input.mouse);
 	Program_State state = PROGRAM_STATE_RUNNING;
-	delta_time = target_seconds_per_frame;
+	delta_time = seconds_per_tick;
 
 	//debug_set_game_speed(0.02f);
 
-	// @TODO: Figure out what to do if vsync is not enabled!
+	Player previous_player = game_state.player;
+	Camera previous_camera = game_state.camera;
+	Time_Spec previous_frame_time = platform_get_time();
+
+	// F9 starts and stops recording, F10 plays the last recording back from the state it started in and checks every tick
+	// against it.
+	const char *recording_path = "../build/recording.rpin";
+	Input_Recorder recorder  = {};
+	Input_Replay   replay    = {};
+	Input          replay_input;
+	bool           replaying = false;
 
 	while(state != PROGRAM_STATE_EXITING) {
 		state = platform_handle_events(&input, state);
@@ -1353,6 +1877,10 @@ application_entry()
 			break;
 		}
 
+		Time_Spec frame_time = platform_get_time();
+		f32 frame_seconds = platform_get_seconds_elapsed(previous_frame_time, frame_time);
+		previous_frame_time = frame_time;
+
 		if (key_pressed(input.keyboard, P_KEY)) {
 			static u32 temp = 0;
 			if (state == PROGRAM_STATE_RUNNING) {
@@ -1365,25 +1893,109 @@ application_entry()
 			}
 		}
 
+		if (key_pressed(input.keyboard, F9_KEY) && !replaying) {
+			if (recorder.file) {
+				stop_input_recording(&recorder);
+			} else {
+				start_input_recording(recording_path, &game_state, &recorder);
+			}
+		}
+		if (key_pressed(input.keyboard, F10_KEY) && !recorder.file) {
+			free_input_replay(&replay);
+			replaying = load_input_replay(recording_path, &replay);
+			if (replaying) {
+				restore_game_state_snapshot(&replay, &game_state);
+				tick_accumulator = 0.0f;
+				previous_player  = game_state.player;
+				previous_camera  = game_state.camera;
+				consume_simulation_input_edges(&simulation_input);
+				log_print(STANDARD_LOG, "Replaying %u ticks from %s.", replay.header.num_ticks, recording_path);
+			}
+		}
+
 		if (state == PROGRAM_STATE_RUNNING) {
-			update(input, &game_state);
+			accumulate_simulation_input(input, &simulation_input);
+			tick_accumulator += frame_seconds;
+
+			u32 num_ticks = 0;
+			while (tick_accumulator >= seconds_per_tick && num_ticks < MAX_SIMULATION_TICKS_PER_FRAME) {
+				previous_player = game_state.player;
+				previous_camera = game_state.camera;
+
+				if (replaying && !replay_next_tick(&replay, &replay_input)) {
+					replaying = false;
+					if (replay.first_mismatch == replay.header.num_ticks) {
+						log_print(STANDARD_LOG, "Replay matched all %u recorded ticks.", replay.header.num_ticks);
+					}
+				}
+
+				if (replaying) {
+					update(replay_input, &game_state);
+					check_replay_tick(&replay, &game_state);
+				} else {
+					update(simulation_input, &game_state);
+					if (recorder.file) {
+						record_input_tick(get_game_buttons(simulation_input), hash_game_state(&game_state), &recorder);
+					}
+				}
+				consume_simulation_input_edges(&simulation_input);
+
+				tick_accumulator -= seconds_per_tick;
+				num_ticks += 1;
+			}
+			if (num_ticks == MAX_SIMULATION_TICKS_PER_FRAME && tick_accumulator >= seconds_per_tick) {
+				tick_accumulator = fmod(tick_accumulator, seconds_per_tick);
+			}
 
 			try_next_sprite_frame(&game_state.player.sprite);
+		} else {
+			// The editor can change the level while paused, which a recording couldn't replay.
+			stop_input_recording(&recorder);
+
+			// Nothing moves while paused, so don't interpolate or owe any ticks when we come back.
+			tick_accumulator = 0.0f;
+			previous_player  = game_state.player;
+			previous_camera  = game_state.camera;
+			consume_simulation_input_edges(&simulation_input);
 		}
 
 		state = debug_update(input, &game_state);
+		sound_update();
+
+		// Replays run on the tiles their snapshot started with.
+		if (!replaying && update_level_stream(&game_state.level_stream, game_state.camera.position, state == PROGRAM_STATE_RUNNING, false, &game_state.tiles, &game_state.colliders)) {
+			// Dropping a chunk moves the tiles after it, which would break the editor's undo history and selection.
+			reset_level_changes();
+			reset_tile_selection();
+
+			// A recording starts from a snapshot of the tiles, it couldn't replay chunks coming and going.
+			if (recorder.file) {
+				log_print(STANDARD_LOG, "The level streamed in or out, stopping the recording.");
+				stop_input_recording(&recorder);
+			}
+		}
+		update_tile_colliders(&game_state.colliders);
 
-		add_sprite_render_commands(game_state.player.sprite, game_state.player.world_position, game_state.camera.view_vector);
+		f32 tick_alpha = tick_accumulator / seconds_per_tick;
+
+		V2 render_player_position = round_to_nearest_pixel(lerp(previous_player.world_position, game_state.player.world_position, tick_alpha));
+		V2 render_view_vector     = game_state.camera.view_vector;
+		if (state == PROGRAM_STATE_RUNNING) {
+			render_view_vector = make_2d_view_vector(round_to_nearest_pixel(lerp(previous_camera.position, game_state.camera.position, tick_alpha)));
+		}
+
+		add_sprite_render_commands(game_state.player.sprite, render_player_position, render_view_vector);
 
 		for (auto t : game_state.tiles) {
 			if (!(t.flags & HIDE_TILE_FLAG)) {
-				add_sprite_render_commands(t.sprite, t.world_position, game_state.camera.view_vector);
+				add_sprite_render_commands(t.sprite, t.world_position, render_view_vector);
 			}
 		}
 
 		submit_render_commands_and_swap_backbuffer();
 	}
 
+	stop_input_recording(&recorder);
 	platform_exit(EXIT_SUCCESS);
 }
-
+#endif
@@ -0,0 +1,773 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLLIDER_KERNELS_X86
+#endif
+
+//
+// Rectangle SoA.
+//
+
+#define RECTANGLE_SOA_ALIGNMENT 32
+#define RECTANGLE_SOA_WIDTH     8 // Floats per AVX register.
+
+f32 *
+rectangle_soa_allocate_lane(u32 capacity)
+{
+	f32 *lane = (f32 *)aligned_alloc(RECTANGLE_SOA_ALIGNMENT, capacity * sizeof(f32));
+	if (!lane) {
+		_abort("Failed to allocate rectangle lane.");
+	}
+
+	for (u32 i = 0; i < capacity; ++i) {
+		lane[i] = NAN;
+	}
+
+	return lane;
+}
+
+Rectangle_Soa
+make_rectangle_soa(u32 initial_capacity)
+{
+	u32 capacity = (initial_capacity + RECTANGLE_SOA_WIDTH - 1) & ~(RECTANGLE_SOA_WIDTH - 1);
+	if (capacity == 0) {
+		capacity = RECTANGLE_SOA_WIDTH;
+	}
+
+	Rectangle_Soa s;
+	s.x        = rectangle_soa_allocate_lane(capacity);
+	s.y        = rectangle_soa_allocate_lane(capacity);
+	s.w        = rectangle_soa_allocate_lane(capacity);
+	s.h        = rectangle_soa_allocate_lane(capacity);
+	s.size     = 0;
+	s.capacity = capacity;
+	return s;
+}
+
+void
+free_rectangle_soa(Rectangle_Soa *s)
+{
+	free(s->x);
+	free(s->y);
+	free(s->w);
+	free(s->h);
+	*s = {};
+}
+
+void
+rectangle_soa_reserve(Rectangle_Soa *s, u32 capacity)
+{
+	if (capacity <= s->capacity) {
+		return;
+	}
+
+	u32 new_capacity = s->capacity;
+	while (new_capacity < capacity) {
+		new_capacity *= 2;
+	}
+
+	Rectangle_Soa n = make_rectangle_soa(new_capacity);
+	memcpy(n.x, s->x, s->size * sizeof(f32));
+	memcpy(n.y, s->y, s->size * sizeof(f32));
+	memcpy(n.w, s->w, s->size * sizeof(f32));
+	memcpy(n.h, s->h, s->size * sizeof(f32));
+	n.size = s->size;
+
+	free_rectangle_soa(s);
+	*s = n;
+}
+
+inline void
+rectangle_soa_set(Rectangle_Soa *s, u32 i, Rectangle r)
+{
+	assert(i < s->size);
+	s->x[i] = r.x;
+	s->y[i] = r.y;
+	s->w[i] = r.w;
+	s->h[i] = r.h;
+}
+
+inline Rectangle
+rectangle_soa_get(Rectangle_Soa *s, u32 i)
+{
+	assert(i < s->size);
+	return { s->x[i], s->y[i], s->w[i], s->h[i] };
+}
+
+void
+rectangle_soa_push(Rectangle_Soa *s, Rectangle r)
+{
+	rectangle_soa_reserve(s, s->size + 1);
+	s->size += 1;
+	rectangle_soa_set(s, s->size - 1, r);
+}
+
+//
+// Minkowski kernels.
+//
+// Each kernel tests whether the origin lies inside the Minkowski difference of the query rectangle and each stored rectangle,
+// using the same comparisons in the same order so the SIMD paths agree with the scalar one bit for bit. The indices of the
+// hits are written out in ascending order and the hit count is returned. Point queries pass a zero sized rectangle, swept
+// queries pass the bounds of the whole move.
+//
+
+enum Minkowski_Bound {
+	MINKOWSKI_CLOSED,    // Touching counts as a hit.
+	MINKOWSKI_HALF_OPEN, // Touching the right or top edge doesn't, like intersect_point_rectangle.
+};
+
+typedef u32 (*Minkowski_Kernel)(Rectangle_Soa *rects, u32 count, Rectangle us, Minkowski_Bound bound, u32 *hits);
+
+u32
+minkowski_overlaps_scalar(Rectangle_Soa *rects, u32 count, Rectangle us, Minkowski_Bound bound, u32 *hits)
+{
+	u32 num_hits = 0;
+	for (u32 i = 0; i < count; ++i) {
+		f32 l = rects->x[i] - us.x - us.w;
+		f32 b = rects->y[i] - us.y - us.h;
+		f32 r = l + (us.w + rects->w[i]);
+		f32 t = b + (us.h + rects->h[i]);
+
+		bool hit = l <= 0.0f && b <= 0.0f;
+		if (bound == MINKOWSKI_CLOSED) {
+			hit = hit && r >= 0.0f && t >= 0.0f;
+		} else {
+			hit = hit && r > 0.0f && t > 0.0f;
+		}
+
+		if (hit) {
+			hits[num_hits++] = i;
+		}
+	}
+	return num_hits;
+}
+
+#ifdef COLLIDER_KERNELS_X86
+
+u32
+minkowski_overlaps_sse(Rectangle_Soa *rects, u32 count, Rectangle us, Minkowski_Bound bound, u32 *hits)
+{
+	__m128 us_x = _mm_set1_ps(us.x);
+	__m128 us_y = _mm_set1_ps(us.y);
+	__m128 us_w = _mm_set1_ps(us.w);
+	__m128 us_h = _mm_set1_ps(us.h);
+	__m128 zero = _mm_setzero_ps();
+
+	u32 num_hits = 0;
+	for (u32 i = 0; i < count; i += 4) {
+		__m128 l = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&rects->x[i]), us_x), us_w);
+		__m128 b = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&rects->y[i]), us_y), us_h);
+		__m128 r = _mm_add_ps(l, _mm_add_ps(us_w, _mm_load_ps(&rects->w[i])));
+		__m128 t = _mm_add_ps(b, _mm_add_ps(us_h, _mm_load_ps(&rects->h[i])));
+
+		__m128 hit = _mm_and_ps(_mm_cmple_ps(l, zero), _mm_cmple_ps(b, zero));
+		if (bound == MINKOWSKI_CLOSED) {
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(r, zero), _mm_cmpge_ps(t, zero)));
+		} else {
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(r, zero), _mm_cmpgt_ps(t, zero)));
+		}
+
+		u32 mask = _mm_movemask_ps(hit);
+		if (count - i < 4) {
+			mask &= (1u << (count - i)) - 1;
+		}
+		while (mask) {
+			hits[num_hits++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	return num_hits;
+}
+
+__attribute__((target("avx2"))) u32
+minkowski_overlaps_avx2(Rectangle_Soa *rects, u32 count, Rectangle us, Minkowski_Bound bound, u32 *hits)
+{
+	__m256 us_x = _mm256_set1_ps(us.x);
+	__m256 us_y = _mm256_set1_ps(us.y);
+	__m256 us_w = _mm256_set1_ps(us.w);
+	__m256 us_h = _mm256_set1_ps(us.h);
+	__m256 zero = _mm256_setzero_ps();
+
+	u32 num_hits = 0;
+	for (u32 i = 0; i < count; i += 8) {
+		__m256 l = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(&rects->x[i]), us_x), us_w);
+		__m256 b = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(&rects->y[i]), us_y), us_h);
+		__m256 r = _mm256_add_ps(l, _mm256_add_ps(us_w, _mm256_load_ps(&rects->w[i])));
+		__m256 t = _mm256_add_ps(b, _mm256_add_ps(us_h, _mm256_load_ps(&rects->h[i])));
+
+		// Ordered compares, so NaN slots never count as hits.
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(l, zero, _CMP_LE_OQ), _mm256_cmp_ps(b, zero, _CMP_LE_OQ));
+		if (bound == MINKOWSKI_CLOSED) {
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(r, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GE_OQ)));
+		} else {
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(r, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, zero, _CMP_GT_OQ)));
+		}
+
+		u32 mask = _mm256_movemask_ps(hit);
+		if (count - i < 8) {
+			mask &= (1u << (count - i)) - 1;
+		}
+		while (mask) {
+			hits[num_hits++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	return num_hits;
+}
+
+#endif
+
+//
+// Segment kernels.
+//
+// Slab tests of one segment against every stored rectangle. A slab the segment runs parallel to is handled up front: the
+// segment either lies inside it for its whole length or misses the rectangle. The nearest hit that starts at or after the
+// segment's start wins, ties going to the lowest index, and its index is returned, or NO_COLLIDER_ID if there was none.
+// Segments that start inside a rectangle don't hit it. Like the Minkowski kernels, every path does the same arithmetic in the
+// same order so they agree exactly.
+//
+
+typedef u32 (*Segment_Kernel)(Rectangle_Soa *rects, u32 count, V2 start, V2 delta, f32 *hit_t, u32 *hit_axis);
+
+// The scalar versions of minps and maxps, which return the second operand when the comparison fails.
+inline f32 kernel_min(f32 a, f32 b) { return (a < b) ? a : b; }
+inline f32 kernel_max(f32 a, f32 b) { return (a > b) ? a : b; }
+
+u32
+segment_cast_scalar(Rectangle_Soa *rects, u32 count, V2 start, V2 delta, f32 *hit_t, u32 *hit_axis)
+{
+	f32 inv_dx = 1.0f / delta.x;
+	f32 inv_dy = 1.0f / delta.y;
+
+	u32 nearest   = NO_COLLIDER_ID;
+	f32 nearest_t = INFINITY;
+	for (u32 i = 0; i < count; ++i) {
+		f32 l = rects->x[i] - start.x;
+		f32 b = rects->y[i] - start.y;
+		f32 r = l + rects->w[i];
+		f32 t = b + rects->h[i];
+
+		if (isnan(l)) {
+			continue;
+		}
+
+		f32 near_x = -INFINITY, far_x = INFINITY;
+		if (delta.x != 0.0f) {
+			near_x = kernel_min(l * inv_dx, r * inv_dx);
+			far_x  = kernel_max(l * inv_dx, r * inv_dx);
+		} else if (!(l <= 0.0f && r >= 0.0f)) {
+			continue;
+		}
+		f32 near_y = -INFINITY, far_y = INFINITY;
+		if (delta.y != 0.0f) {
+			near_y = kernel_min(b * inv_dy, t * inv_dy);
+			far_y  = kernel_max(b * inv_dy, t * inv_dy);
+		} else if (!(b <= 0.0f && t >= 0.0f)) {
+			continue;
+		}
+
+		f32 entry = kernel_max(near_x, near_y);
+		f32 exit  = kernel_min(far_x, far_y);
+		if (entry <= exit && entry >= 0.0f && entry <= 1.0f && entry < nearest_t) {
+			nearest   = i;
+			nearest_t = entry;
+			*hit_axis = (near_x > near_y) ? 0 : 1;
+		}
+	}
+
+	*hit_t = nearest_t;
+	return nearest;
+}
+
+#ifdef COLLIDER_KERNELS_X86
+
+u32
+segment_cast_sse(Rectangle_Soa *rects, u32 count, V2 start, V2 delta, f32 *hit_t, u32 *hit_axis)
+{
+	__m128 start_x = _mm_set1_ps(start.x);
+	__m128 start_y = _mm_set1_ps(start.y);
+	__m128 inv_dx  = _mm_set1_ps(1.0f / delta.x);
+	__m128 inv_dy  = _mm_set1_ps(1.0f / delta.y);
+	__m128 zero    = _mm_setzero_ps();
+	__m128 one     = _mm_set1_ps(1.0f);
+
+	u32 nearest   = NO_COLLIDER_ID;
+	f32 nearest_t = INFINITY;
+	for (u32 i = 0; i < count; i += 4) {
+		__m128 l = _mm_sub_ps(_mm_load_ps(&rects->x[i]), start_x);
+		__m128 b = _mm_sub_ps(_mm_load_ps(&rects->y[i]), start_y);
+		__m128 r = _mm_add_ps(l, _mm_load_ps(&rects->w[i]));
+		__m128 t = _mm_add_ps(b, _mm_load_ps(&rects->h[i]));
+
+		// Ordered compares, so NaN slots never count as hits.
+		__m128 hit = _mm_cmpeq_ps(l, l);
+
+		__m128 near_x = _mm_set1_ps(-INFINITY), far_x = _mm_set1_ps(INFINITY);
+		if (delta.x != 0.0f) {
+			near_x = _mm_min_ps(_mm_mul_ps(l, inv_dx), _mm_mul_ps(r, inv_dx));
+			far_x  = _mm_max_ps(_mm_mul_ps(l, inv_dx), _mm_mul_ps(r, inv_dx));
+		} else {
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(l, zero), _mm_cmpge_ps(r, zero)));
+		}
+		__m128 near_y = _mm_set1_ps(-INFINITY), far_y = _mm_set1_ps(INFINITY);
+		if (delta.y != 0.0f) {
+			near_y = _mm_min_ps(_mm_mul_ps(b, inv_dy), _mm_mul_ps(t, inv_dy));
+			far_y  = _mm_max_ps(_mm_mul_ps(b, inv_dy), _mm_mul_ps(t, inv_dy));
+		} else {
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(b, zero), _mm_cmpge_ps(t, zero)));
+		}
+
+		__m128 entry = _mm_max_ps(near_x, near_y);
+		__m128 exit  = _mm_min_ps(far_x, far_y);
+		hit = _mm_and_ps(hit, _mm_cmple_ps(entry, exit));
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(entry, zero), _mm_cmple_ps(entry, one)));
+
+		u32 mask = _mm_movemask_ps(hit);
+		if (count - i < 4) {
+			mask &= (1u << (count - i)) - 1;
+		}
+		if (!mask) {
+			continue;
+		}
+
+		alignas(16) f32 entries[4], nears_x[4], nears_y[4];
+		_mm_store_ps(entries, entry);
+		_mm_store_ps(nears_x, near_x);
+		_mm_store_ps(nears_y, near_y);
+		while (mask) {
+			u32 lane = __builtin_ctz(mask);
+			if (entries[lane] < nearest_t) {
+				nearest   = i + lane;
+				nearest_t = entries[lane];
+				*hit_axis = (nears_x[lane] > nears_y[lane]) ? 0 : 1;
+			}
+			mask &= mask - 1;
+		}
+	}
+
+	*hit_t = nearest_t;
+	return nearest;
+}
+
+__attribute__((target("avx2"))) u32
+segment_cast_avx2(Rectangle_Soa *rects, u32 count, V2 start, V2 delta, f32 *hit_t, u32 *hit_axis)
+{
+	__m256 start_x = _mm256_set1_ps(start.x);
+	__m256 start_y = _mm256_set1_ps(start.y);
+	__m256 inv_dx  = _mm256_set1_ps(1.0f / delta.x);
+	__m256 inv_dy  = _mm256_set1_ps(1.0f / delta.y);
+	__m256 zero    = _mm256_setzero_ps();
+	__m256 one     = _mm256_set1_ps(1.0f);
+
+	u32 nearest   = NO_COLLIDER_ID;
+	f32 nearest_t = INFINITY;
+	for (u32 i = 0; i < count; i += 8) {
+		__m256 l = _mm256_sub_ps(_mm256_load_ps(&rects->x[i]), start_x);
+		__m256 b = _mm256_sub_ps(_mm256_load_ps(&rects->y[i]), start_y);
+		__m256 r = _mm256_add_ps(l, _mm256_load_ps(&rects->w[i]));
+		__m256 t = _mm256_add_ps(b, _mm256_load_ps(&rects->h[i]));
+
+		__m256 hit = _mm256_cmp_ps(l, l, _CMP_EQ_OQ);
+
+		__m256 near_x = _mm256_set1_ps(-INFINITY), far_x = _mm256_set1_ps(INFINITY);
+		if (delta.x != 0.0f) {
+			near_x = _mm256_min_ps(_mm256_mul_ps(l, inv_dx), _mm256_mul_ps(r, inv_dx));
+			far_x  = _mm256_max_ps(_mm256_mul_ps(l, inv_dx), _mm256_mul_ps(r, inv_dx));
+		} else {
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(l, zero, _CMP_LE_OQ), _mm256_cmp_ps(r, zero, _CMP_GE_OQ)));
+		}
+		__m256 near_y = _mm256_set1_ps(-INFINITY), far_y = _mm256_set1_ps(INFINITY);
+		if (delta.y != 0.0f) {
+			near_y = _mm256_min_ps(_mm256_mul_ps(b, inv_dy), _mm256_mul_ps(t, inv_dy));
+			far_y  = _mm256_max_ps(_mm256_mul_ps(b, inv_dy), _mm256_mul_ps(t, inv_dy));
+		} else {
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(b, zero, _CMP_LE_OQ), _mm256_cmp_ps(t, zero, _CMP_GE_OQ)));
+		}
+
+		__m256 entry = _mm256_max_ps(near_x, near_y);
+		__m256 exit  = _mm256_min_ps(far_x, far_y);
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+		hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(entry, zero, _CMP_GE_OQ), _mm256_cmp_ps(entry, one, _CMP_LE_OQ)));
+
+		u32 mask = _mm256_movemask_ps(hit);
+		if (count - i < 8) {
+			mask &= (1u << (count - i)) - 1;
+		}
+		if (!mask) {
+			continue;
+		}
+
+		alignas(32) f32 entries[8], nears_x[8], nears_y[8];
+		_mm256_store_ps(entries, entry);
+		_mm256_store_ps(nears_x, near_x);
+		_mm256_store_ps(nears_y, near_y);
+		while (mask) {
+			u32 lane = __builtin_ctz(mask);
+			if (entries[lane] < nearest_t) {
+				nearest   = i + lane;
+				nearest_t = entries[lane];
+				*hit_axis = (nears_x[lane] > nears_y[lane]) ? 0 : 1;
+			}
+			mask &= mask - 1;
+		}
+	}
+
+	*hit_t = nearest_t;
+	return nearest;
+}
+
+#endif
+
+Minkowski_Kernel minkowski_overlaps = NULL;
+Segment_Kernel   segment_cast       = NULL;
+
+void
+select_collider_kernels()
+{
+#ifdef COLLIDER_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		minkowski_overlaps = minkowski_overlaps_avx2;
+		segment_cast       = segment_cast_avx2;
+		log_print(STANDARD_LOG, "Using the AVX2 collision kernels.");
+	} else {
+		minkowski_overlaps = minkowski_overlaps_sse;
+		segment_cast       = segment_cast_sse;
+		log_print(STANDARD_LOG, "Using the SSE collision kernels.");
+	}
+#else
+	minkowski_overlaps = minkowski_overlaps_scalar;
+	segment_cast       = segment_cast_scalar;
+	log_print(STANDARD_LOG, "Using the scalar collision kernels.");
+#endif
+}
+
+//
+// Collider store.
+//
+
+Tile_Collision_Map make_tile_collision_map(f32 tile_side, u32 initial_table_size = 64);
+
+Collider_Store
+make_collider_store(size_t initial_capacity, f32 grid_cell_side, f32 tile_side)
+{
+	if (!minkowski_overlaps) {
+		select_collider_kernels();
+	}
+
+	Collider_Store cs;
+	cs.rects     = make_rectangle_soa(initial_capacity);
+	cs.free_ids  = make_array<Collider_Id>(64, 0);
+	cs.grid      = make_spatial_grid(grid_cell_side);
+	cs.tiles     = make_tile_collision_map(tile_side);
+	cs.tile_grid = make_spatial_grid(tile_side);
+	return cs;
+}
+
+inline Rectangle
+get_collider(Collider_Id id, Collider_Store *colliders)
+{
+	return rectangle_soa_get(&colliders->rects, id);
+}
+
+Collider_Id
+add_collider(f32 x, f32 y, f32 w, f32 h, Collider_Store *colliders)
+{
+	Rectangle r = { x, y, w, h };
+
+	Collider_Id id;
+	if (colliders->free_ids.size > 0) {
+		id = colliders->free_ids.last();
+		colliders->free_ids.size -= 1;
+		rectangle_soa_set(&colliders->rects, id, r);
+	} else {
+		id = colliders->rects.size;
+		rectangle_soa_push(&colliders->rects, r);
+	}
+
+	spatial_grid_insert(&colliders->grid, id, r);
+
+	return id;
+}
+
+Collider_Id
+add_collider(Rectangle c, Collider_Store *colliders)
+{
+	return add_collider(c.x, c.y, c.w, c.h, colliders);
+}
+
+void
+remove_collider(Collider_Id id, Collider_Store *colliders)
+{
+	assert(!isnan(colliders->rects.x[id]));
+
+	spatial_grid_remove(&colliders->grid, id, get_collider(id, colliders));
+	rectangle_soa_set(&colliders->rects, id, NO_COLLIDER);
+	array_add(&colliders->free_ids, id);
+}
+
+void
+set_collider(Collider_Id id, Rectangle r, Collider_Store *colliders)
+{
+	spatial_grid_move(&colliders->grid, id, get_collider(id, colliders), r);
+	rectangle_soa_set(&colliders->rects, id, r);
+}
+
+bool
+collider_is_free(Collider_Id id, Collider_Store *colliders)
+{
+	return isnan(colliders->rects.x[id]);
+}
+
+// Ids of the colliders that might overlap or touch the area, in ascending order so results don't depend on the grid layout.
+void
+query_colliders(Rectangle area, Collider_Store *colliders, Array<Collider_Id> *results)
+{
+	results->size = 0;
+	spatial_grid_query(&colliders->grid, area, results);
+
+	for (u32 i = 1; i < results->size; ++i) {
+		Collider_Id id = (*results)[i];
+		s32 j = i - 1;
+		for (; j >= 0 && (*results)[j] > id; --j) {
+			(*results)[j + 1] = (*results)[j];
+		}
+		(*results)[j + 1] = id;
+	}
+}
+
+// Ids of the colliders whose Minkowski difference with us holds the origin, in ascending order. The grid candidates are
+// gathered into a packed SoA and filtered by the kernel a vector at a time; only the hits get looked at by the caller.
+void
+overlapping_colliders(Rectangle us, Minkowski_Bound bound, Collider_Id exclude, Collider_Store *colliders, Array<Collider_Id> *results)
+{
+	static Array<Collider_Id> candidates = make_array<Collider_Id>(64, 0);
+	static Rectangle_Soa      gathered   = make_rectangle_soa(64);
+	static Array<u32>         hits       = make_array<u32>(64, 0);
+
+	query_colliders(us, colliders, &candidates);
+
+	gathered.size = 0;
+	rectangle_soa_reserve(&gathered, candidates.size);
+	u32 num_gathered = 0;
+	for (Collider_Id id : candidates) {
+		if (id == exclude) {
+			continue;
+		}
+		gathered.x[num_gathered] = colliders->rects.x[id];
+		gathered.y[num_gathered] = colliders->rects.y[id];
+		gathered.w[num_gathered] = colliders->rects.w[id];
+		gathered.h[num_gathered] = colliders->rects.h[id];
+		candidates[num_gathered] = id;
+		num_gathered += 1;
+	}
+	gathered.size = num_gathered;
+
+	hits.resize(num_gathered);
+	u32 num_hits = minkowski_overlaps(&gathered, num_gathered, us, bound, hits.data);
+
+	results->size = 0;
+	for (u32 i = 0; i < num_hits; ++i) {
+		array_add(results, candidates[hits.data[i]]);
+	}
+}
+
+// Casts a batch of segments with one broadphase query over all of them, then runs the segment kernel over the gathered
+// candidates once per segment. Writes the nearest hit of each segment to hits.
+void
+cast_segments(Segment_Cast *casts, u32 num_casts, Collider_Id exclude, Collider_Store *colliders, Segment_Cast_Hit *hits)
+{
+	static Array<Collider_Id> candidates = make_array<Collider_Id>(64, 0);
+	static Rectangle_Soa      gathered   = make_rectangle_soa(64);
+
+	if (num_casts == 0) {
+		return;
+	}
+
+	f32 min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+	for (u32 i = 0; i < num_casts; ++i) {
+		min_x = fmin(min_x, fmin(casts[i].start.x, casts[i].end.x));
+		min_y = fmin(min_y, fmin(casts[i].start.y, casts[i].end.y));
+		max_x = fmax(max_x, fmax(casts[i].start.x, casts[i].end.x));
+		max_y = fmax(max_y, fmax(casts[i].start.y, casts[i].end.y));
+	}
+	query_colliders({ min_x, min_y, max_x - min_x, max_y - min_y }, colliders, &candidates);
+
+	gathered.size = 0;
+	rectangle_soa_reserve(&gathered, candidates.size);
+	u32 num_gathered = 0;
+	for (Collider_Id id : candidates) {
+		if (id == exclude) {
+			continue;
+		}
+		gathered.x[num_gathered] = colliders->rects.x[id];
+		gathered.y[num_gathered] = colliders->rects.y[id];
+		gathered.w[num_gathered] = colliders->rects.w[id];
+		gathered.h[num_gathered] = colliders->rects.h[id];
+		candidates[num_gathered] = id;
+		num_gathered += 1;
+	}
+	gathered.size = num_gathered;
+
+	for (u32 i = 0; i < num_casts; ++i) {
+		V2  delta = casts[i].end - casts[i].start;
+		u32 axis  = 0;
+		f32 t     = INFINITY;
+		u32 index = segment_cast(&gathered, num_gathered, casts[i].start, delta, &t, &axis);
+
+		hits[i].collider = (index == NO_COLLIDER_ID) ? NO_COLLIDER_ID : candidates[index];
+		hits[i].t        = t;
+		hits[i].axis     = axis;
+	}
+}
+
+//
+// Benchmark.
+//
+
+u32
+benchmark_random(u32 *state)
+{
+	// xorshift32, so runs are repeatable and don't disturb rand().
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+f32
+benchmark_random_f32(u32 *state, f32 min, f32 max)
+{
+	return min + (max - min) * ((benchmark_random(state) & 0xFFFFFF) / (f32)0x1000000);
+}
+
+// Times every available kernel against 1k, 10k and 100k random colliders and logs the per-rectangle cost. The kernels also
+// get checked against the scalar one, since they have to agree exactly.
+void
+benchmark_minkowski_kernels()
+{
+	struct Kernel_Entry {
+		const char       *name;
+		Minkowski_Kernel  kernel;
+	};
+	Kernel_Entry kernels[3];
+	u32 num_kernels = 0;
+	kernels[num_kernels++] = { "scalar", minkowski_overlaps_scalar };
+#ifdef COLLIDER_KERNELS_X86
+	kernels[num_kernels++] = { "sse", minkowski_overlaps_sse };
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels[num_kernels++] = { "avx2", minkowski_overlaps_avx2 };
+	}
+#endif
+
+	const u32 collider_counts[] = { 1000, 10000, 100000 };
+	const u32 num_queries       = 64;
+	const f32 world_side        = 1000.0f;
+
+	for (u32 count : collider_counts) {
+		u32 seed = 0x9E3779B9;
+		Rectangle_Soa rects = make_rectangle_soa(count);
+		for (u32 i = 0; i < count; ++i) {
+			rectangle_soa_push(&rects, { benchmark_random_f32(&seed, 0.0f, world_side), benchmark_random_f32(&seed, 0.0f, world_side),
+			                             benchmark_random_f32(&seed, 0.5f, 4.0f),       benchmark_random_f32(&seed, 0.5f, 4.0f) });
+		}
+		Rectangle queries[num_queries];
+		for (u32 i = 0; i < num_queries; ++i) {
+			queries[i] = { benchmark_random_f32(&seed, 0.0f, world_side), benchmark_random_f32(&seed, 0.0f, world_side), 40.0f, 40.0f };
+		}
+		u32 *hits = (u32 *)emalloc(count * sizeof(u32));
+
+		u64 scalar_us = 0;
+		u32 scalar_hits = 0;
+		for (u32 k = 0; k < num_kernels; ++k) {
+			u32 total_hits = 0;
+			u64 start = platform_get_time_us();
+			for (u32 q = 0; q < num_queries; ++q) {
+				total_hits += kernels[k].kernel(&rects, count, queries[q], MINKOWSKI_CLOSED, hits);
+			}
+			u64 elapsed = platform_get_time_us() - start;
+
+			if (k == 0) {
+				scalar_us = elapsed;
+				scalar_hits = total_hits;
+			} else if (total_hits != scalar_hits) {
+				log_print(MAJOR_ERROR_LOG, "The %s collision kernel found %u hits but the scalar one found %u.", kernels[k].name, total_hits, scalar_hits);
+			}
+
+			f64 ns_per_test = (elapsed * 1000.0) / ((f64)count * num_queries);
+			log_print(STANDARD_LOG, "%6u colliders, %-6s: %8lu us, %.3f ns per test, %.2fx scalar.", count, kernels[k].name, elapsed, ns_per_test, elapsed ? (f64)scalar_us / elapsed : 0.0);
+		}
+
+		free(hits);
+		free_rectangle_soa(&rects);
+	}
+}
+
+// Same idea for the segment kernels: random segments against random colliders, checked against the scalar kernel. A quarter
+// of the segments are axis aligned, since those take the parallel slab path.
+void
+benchmark_segment_kernels()
+{
+	struct Kernel_Entry {
+		const char     *name;
+		Segment_Kernel  kernel;
+	};
+	Kernel_Entry kernels[3];
+	u32 num_kernels = 0;
+	kernels[num_kernels++] = { "scalar", segment_cast_scalar };
+#ifdef COLLIDER_KERNELS_X86
+	kernels[num_kernels++] = { "sse", segment_cast_sse };
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels[num_kernels++] = { "avx2", segment_cast_avx2 };
+	}
+#endif
+
+	const u32 collider_counts[] = { 1000, 10000, 100000 };
+	const u32 num_segments      = 64;
+	const f32 world_side        = 1000.0f;
+
+	for (u32 count : collider_counts) {
+		u32 seed = 0x9E3779B9;
+		Rectangle_Soa rects = make_rectangle_soa(count);
+		for (u32 i = 0; i < count; ++i) {
+			rectangle_soa_push(&rects, { benchmark_random_f32(&seed, 0.0f, world_side), benchmark_random_f32(&seed, 0.0f, world_side),
+			                             benchmark_random_f32(&seed, 0.5f, 4.0f),       benchmark_random_f32(&seed, 0.5f, 4.0f) });
+		}
+		V2 starts[num_segments], deltas[num_segments];
+		for (u32 i = 0; i < num_segments; ++i) {
+			starts[i] = { benchmark_random_f32(&seed, 0.0f, world_side), benchmark_random_f32(&seed, 0.0f, world_side) };
+			deltas[i] = { benchmark_random_f32(&seed, -40.0f, 40.0f), benchmark_random_f32(&seed, -40.0f, 40.0f) };
+			if (i % 8 == 0) {
+				deltas[i].x = 0.0f;
+			} else if (i % 8 == 1) {
+				deltas[i].y = 0.0f;
+			}
+		}
+
+		u32 scalar_hits[num_segments];
+		u64 scalar_us = 0;
+		for (u32 k = 0; k < num_kernels; ++k) {
+			u32 hits[num_segments];
+			u64 start = platform_get_time_us();
+			for (u32 s = 0; s < num_segments; ++s) {
+				f32 t;
+				u32 axis;
+				hits[s] = kernels[k].kernel(&rects, count, starts[s], deltas[s], &t, &axis);
+			}
+			u64 elapsed = platform_get_time_us() - start;
+
+			if (k == 0) {
+				scalar_us = elapsed;
+				memcpy(scalar_hits, hits, sizeof(hits));
+			} else if (memcmp(scalar_hits, hits, sizeof(hits)) != 0) {
+				log_print(MAJOR_ERROR_LOG, "The %s segment kernel disagrees with the scalar one.", kernels[k].name);
+			}
+
+			f64 ns_per_test = (elapsed * 1000.0) / ((f64)count * num_segments);
+			log_print(STANDARD_LOG, "%6u colliders, %-6s segments: %8lu us, %.3f ns per test, %.2fx scalar.", count, kernels[k].name, elapsed, ns_per_test, elapsed ? (f64)scalar_us / elapsed : 0.0);
+		}
+
+		free_rectangle_soa(&rects);
+	}
+}
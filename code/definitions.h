@@ -794,12 +794,20 @@ struct Loaded_Sprite {
 };
 
 struct Texture_Asset {
-	//u32 pixel_width;
-	//u32 pixel_height;
+	u32 pixel_width;
+	u32 pixel_height;
+	u8 *pixels; // Held until the texture is copied into the sprite texture array.
 
 	Gpu_Texture_Handle gpu_handle;
+
+	// Every sprite sheet also lives in one layer of the sprite texture array. Layers all share the size of the largest sheet,
+	// so smaller sheets only cover the lower corner of their layer and their uvs have to be scaled down to match.
+	u32 texture_array_layer; // NO_TEXTURE_ARRAY_LAYER for textures loaded after the array was made.
+	V2  texture_array_uv_scale;
 };
 
+#define NO_TEXTURE_ARRAY_LAYER UINT32_MAX
+
 struct Sound_Asset {
 };
 
@@ -914,7 +922,7 @@ struct Player {
 	V2          velocity;
 	s8          grounded;
 	s8          grabbing_ledge;
-	Timer       jump_grace_timer;
+	u32         jump_grace_ticks_left; // Ticks left in which the player can still jump after walking off a ledge.
 };
 
 #define HIDE_TILE_FLAG 0x1
@@ -922,16 +930,244 @@ struct Player {
 struct Tile {
 	Sprite_Instance sprite;
 	V2              world_position;
-	Collider_Id     collider_id;
 	u32             flags;
 };
 
+struct Spatial_Grid_Cell {
+	s32        x, y;
+	Array<u32> ids;
+};
+
+// Uniform grid over the world, stored sparsely as a hash table of the occupied cells. Everything that overlaps or touches a
+// cell is listed in it, so a query only looks at the cells its rectangle covers, no matter how big the level is.
+struct Spatial_Grid {
+	f32                      cell_side;
+	Array<Spatial_Grid_Cell> cells;
+	Array<u32>               table;        // Open addressed, power of two size. Holds indices into cells.
+	Array<u32>               query_stamps; // Indexed by id. Stops an id that spans several cells from being reported twice.
+	u32                      query_stamp;
+	u32                      num_id_lists; // Cells past cells.size, up to here, hold the id lists of cells that emptied out.
+};
+
+// Rectangles stored as separate x, y, w and h arrays so the collision kernels can test eight of them with one instruction.
+// Each array is 32-byte aligned and the capacity is kept a multiple of eight, so a kernel can always load whole vectors. Slots
+// past the size hold NaN, which fails every comparison.
+struct Rectangle_Soa {
+	f32 *x;
+	f32 *y;
+	f32 *w;
+	f32 *h;
+	u32  size;
+	u32  capacity;
+};
+
+#define TILE_REGION_SIDE 16 // In tiles.
+
+// A square block of the tile grid. Solid tiles in a region are merged into as few rectangles as possible, and an edit only
+// re-merges the regions it touched.
+struct Tile_Region {
+	s32                x, y;                                      // In regions.
+	u8                 solid[TILE_REGION_SIDE * TILE_REGION_SIDE]; // Number of visible tiles covering each cell.
+	Array<Collider_Id> colliders;                                 // The merged rectangles.
+	Array<V2>          corners;                                   // Convex corners of its solid tiles, see build_tile_region_corners().
+	bool               dirty;
+	bool               corners_dirty;
+};
+
+struct Tile_Collision_Map {
+	f32                tile_side;
+	Array<Tile_Region> regions;
+	Array<u32>         table;         // Open addressed, power of two size. Holds indices into regions.
+	Array<u32>         dirty_regions;
+};
+
+// A batch of segments cast together shares one broadphase query, so casts from the same actor should go in one batch.
+struct Segment_Cast {
+	V2 start;
+	V2 end;
+};
+
+struct Segment_Cast_Hit {
+	Collider_Id collider; // NO_COLLIDER_ID if nothing was hit before the end.
+	f32         t;        // How far along from start to end the segment first touches the collider, from 0 to 1.
+	u32         axis;     // 0 if it went in through the left or right face, 1 through the bottom or top.
+};
+
+struct Collider_Store {
+	Rectangle_Soa      rects;    // Indexed by Collider_Id. Free slots hold NO_COLLIDER.
+	Array<Collider_Id> free_ids; // Ids stay valid until removed, so the player can hang on to theirs.
+	Spatial_Grid       grid;
+	Tile_Collision_Map tiles;    // Owns the colliders of the static tiles.
+	Spatial_Grid       tile_grid; // Every tile's index, hidden or not, in the one tile cell it sits in. For picking tiles in the editor.
+};
+
+#define LEVEL_CHUNK_DIRECTORY    "../data/chunks"
+#define LEVEL_CHUNK_SIDE         64 // In tiles. A whole number of tile regions, so a chunk's colliders are its regions' colliders.
+#define LEVEL_CHUNK_LOAD_RADIUS  1  // In chunks around the camera's chunk.
+#define LEVEL_CHUNK_EVICT_RADIUS 2  // Past the load radius, so a camera going back and forth over a chunk border doesn't thrash.
+#define MAX_LEVEL_CHUNKS         32 // Enough for every chunk inside the evict radius.
+
+enum Level_Chunk_State : u32 {
+	LEVEL_CHUNK_FREE = 0,
+	LEVEL_CHUNK_LOADING,  // A job thread is mapping the chunk's file.
+	LEVEL_CHUNK_LOADED,   // Mapped, waiting for the main thread to add it to the level.
+	LEVEL_CHUNK_RESIDENT, // Its tiles and colliders are in the level.
+};
+
+struct Level_Chunk {
+	s32          x, y;      // In chunks.
+	volatile u32 state;     // A Level_Chunk_State. Set to LEVEL_CHUNK_LOADED by the job thread, everything else by the main thread.
+	const char  *file;      // The mapped chunk file, NULL if the chunk doesn't have one.
+	size_t       file_size;
+};
+
+struct Level_Stream {
+	bool        enabled; // Only levels saved as chunks stream, others are loaded whole.
+	Level_Chunk chunks[MAX_LEVEL_CHUNKS];
+};
+
 struct Game_State {
-	Array<Rectangle> colliders;
+	Collider_Store   colliders;
 	Array<Tile>      tiles;
 	Player           player;
 	Rope             rope;
 	Camera           camera;
+	Level_Stream     level_stream;
+};
+
+#define LEVEL_FILE_MAGIC   0x4C565052 // "RPVL"
+#define LEVEL_FILE_VERSION 1
+
+// A level file is mapped and used in place, so every section is an array of fixed size records at the offset the header
+// gives, aligned to four bytes. Positions are in tiles.
+//
+// The sprite name section is num_sprite_names u32 offsets into the string section, which holds the names null terminated.
+// Each tile names its sprite by index into that table. The collider section lists the regions whose merged rectangles were
+// saved; a region left out (or a file with no colliders at all) is merged from its tiles at load.
+struct Level_File_Header {
+	u32 magic;
+	u32 version;
+	u32 file_size;
+	u32 num_sprite_names;
+	u32 sprite_names_offset;
+	u32 strings_offset;
+	u32 strings_size;
+	u32 num_tiles;
+	u32 tiles_offset;
+	u32 num_regions;
+	u32 regions_offset;
+	u32 num_colliders;
+	u32 colliders_offset;
+};
+
+struct Level_File_Tile {
+	s16 x, y;
+	u16 sprite;
+};
+
+struct Level_File_Region {
+	s32 x, y; // In regions.
+	u32 first_collider;
+	u32 num_colliders;
+};
+
+struct Level_File_Collider {
+	s16 x, y, w, h;
+};
+
+enum Level_Save_State : u32 {
+	LEVEL_SAVE_IDLE = 0,
+	LEVEL_SAVE_RUNNING,
+	LEVEL_SAVE_DONE,
+	LEVEL_SAVE_FAILED,
+};
+
+// One file a save writes: the tiles from min up to but not including max, in tiles. Or, for remove, a file to delete.
+struct Level_Save_File {
+	char path[256];
+	V2s  min, max;
+	bool remove;
+};
+
+// A level save in flight. The main thread fills it with a copy of the level and hands it to a job thread, which owns it
+// until it sets the state to done or failed.
+struct Level_Save {
+	volatile u32               state;    // A Level_Save_State.
+	volatile f32               progress; // From 0 to 1.
+	u64                        start_us;
+
+	Array<Tile>                tiles;
+	Array<Level_File_Region>   regions;   // Every region whose colliders can be saved, and its colliders in tiles.
+	Array<Level_File_Collider> colliders;
+	Array<Level_Save_File>     files;
+
+	// The job thread's scratch for building each file.
+	Array<const char *>        names;
+	Array<Level_File_Tile>     file_tiles;
+	Array<Level_File_Region>   file_regions;
+	Array<Level_File_Collider> file_colliders;
+};
+
+#define INPUT_STREAM_MAGIC   0x4E495052 // "RPIN"
+#define INPUT_STREAM_VERSION 2
+
+// A recorded run starts with this header, followed by the Game_State_Snapshot the run started from, then the snapshot's tiles (a u8 name length, the
+// name, the world position and the flags), then its rope control points. Then, per tick, the u32 game buttons (see
+// get_game_buttons()) and the u64 hash_game_state() after the tick.
+struct Input_Stream_Header {
+	u32 magic;
+	u32 version;
+	u32 tick_hz;
+	u32 num_ticks;
+};
+
+// Everything update() carries between ticks, minus the tiles and rope control points, which are written after it.
+struct Game_State_Snapshot {
+	Rectangle player_collider;
+	V2        player_world_position;
+	V2        player_velocity;
+	s32       player_facing;
+	s8        player_grounded;
+	s8        player_grabbing_ledge;
+	u32       player_jump_grace_ticks_left;
+
+	V2        rope_cast_direction;
+	V2        rope_cast_point;
+	f32       rope_unstretched_length;
+	bool      rope_out;
+	bool      rope_extending;
+	bool      rope_retracting;
+	bool      rope_was_attached;
+	bool      rope_was_released;
+	bool      rope_end_moving;
+	u32       rope_end;
+	u32       rope_num_control_points;
+
+	V2        camera_position;
+
+	u32       num_tiles;
+};
+
+struct Snapshot_Tile {
+	char name[SPRITE_INSTANCE_NAME_BUFFER_LENGTH];
+	V2   world_position;
+	u32  flags;
+};
+
+struct Input_Recorder {
+	FILE *file;      // NULL when not recording.
+	u32   num_ticks;
+};
+
+struct Input_Replay {
+	Input_Stream_Header  header;
+	Game_State_Snapshot  snapshot;
+	Array<Snapshot_Tile> tiles;
+	Array<V2>            rope_control_points;
+	u32 *                buttons;
+	u64 *                hashes;
+	u32                  tick;           // The next tick to play.
+	u32                  first_mismatch; // The first tick whose hash didn't match the recording, or num_ticks if none.
 };
 
 struct Check_Grounded_Result {
@@ -947,22 +1183,23 @@ enum Collision_Direction {
 	NO_COLLISION
 };
 
-struct Axis_Collision_Check_Result {
-	f32 penetration;
-	Collision_Direction direction;
-};
-
 struct Collision_Report {
 	Rectangle collider;
 	f32 penetration;
 };
 
+#define MAX_COLLISION_REPORTS 4
+
+// Lives on the caller's stack, so a collision check never touches the heap. Reports past MAX_COLLISION_REPORTS are dropped;
+// a swept move hits at most one collider per axis, only pushing out of overlaps can report more.
 struct Collision_Check_Result {
 	V2 delta_position;
 	Collision_Direction x_collision_direction;
 	Collision_Direction y_collision_direction;
-	Array<Collision_Report> x_collisions;
-	Array<Collision_Report> y_collisions;
+	u32 num_x_collisions;
+	u32 num_y_collisions;
+	Collision_Report x_collisions[MAX_COLLISION_REPORTS];
+	Collision_Report y_collisions[MAX_COLLISION_REPORTS];
 };
 
 struct Sweep {
@@ -2,12 +2,21 @@ GLuint debug_vao;
 GLuint debug_vbo;
 GLuint text_vao;
 GLuint text_vbo;
-GLuint debug_shader;
-GLuint debug_text_shader;
+Shader_Program debug_shader;
+Shader_Program debug_text_shader;
+
+s32 debug_orthographic_projection_uniform;
+s32 debug_zoomed_orthographic_projection_uniform;
+s32 debug_view_vector_uniform;
+s32 debug_texture_uniform;
+s32 debug_text_projection_uniform;
+s32 debug_text_atlas_uniform;
 
 u8 debug_draw = true;
 u8 draw_grid = false;
 
+f32 zoom_factor = 1.0f; // How much bigger the world is drawn with the editor's zoomed projection.
+
 enum Editor_Mode {
 	LEVEL_EDITOR,
 	COLLISION_EDITOR,
@@ -21,41 +30,39 @@ Editor_Mode current_editor_mode = LEVEL_EDITOR;
 u8 show_editor    = false;
 u8 show_colliders = false;
 
-struct Debug_Render_Command {
-	u32         num_verts        = 0;
-	u32         gl_mode          = GL_TRIANGLES;
-	u8          screen_space     = true;
-	const char *texture_name     = NULL;
-	f32         line_thickness   = 1.0f;
-	f32         alpha            = 1.0f;
+// Everything the old per-command uniforms used to carry lives in the vertices now, so the whole frame's debug geometry is one
+// triangle list drawn with one call.
+struct Debug_Vertex {
+	V2    position;
+	Color color;         // Alpha is already multiplied in.
+	V2    uv;
+	f32   screen_space;  // 1 for screen space, 0 for world space.
+	f32   texture_layer; // Layer of the sprite texture array, or NO_DEBUG_TEXTURE.
 };
 
-constexpr GLuint DEBUG_MAX_RENDER_COMMANDS = 512;
-constexpr GLuint DEBUG_MAX_RENDER_VERTS = DEBUG_MAX_RENDER_COMMANDS*4;
+#define NO_DEBUG_TEXTURE -1.0f
 
-struct Debug_Render_Commands {
-	Debug_Render_Command data[DEBUG_MAX_RENDER_COMMANDS];
-	size_t count;
-	GLuint num_total_verts;
-} debug_render_commands;
+Array<Debug_Vertex> debug_vertices = make_array<Debug_Vertex, false>(4096, 0);
 
 const char *debug_vertex_shader_source = R"(
 	uniform	mat4  zoomed_orthographic_projection;
 	uniform	mat4  orthographic_projection;
 	uniform vec2  view_vector;
-	uniform bool screen_space;
 
-	layout (location = 0) in vec2 vert_position;
-	layout (location = 1) in vec4 vert_color;
-	layout (location = 2) in vec2 vert_uv;
+	layout (location = 0) in vec2  vert_position;
+	layout (location = 1) in vec4  vert_color;
+	layout (location = 2) in vec2  vert_uv;
+	layout (location = 3) in float vert_screen_space;
+	layout (location = 4) in float vert_texture_layer;
 
-	out vec4 frag_color;
-	out vec2 frag_uv;
+	out vec4  frag_color;
+	out vec2  frag_uv;
+	out float frag_texture_layer;
 
 	void main()
 	{
 		vec2 p = vert_position;
-		if (!screen_space) {
+		if (vert_screen_space == 0.0f) {
 			p += view_vector;
 			gl_Position = zoomed_orthographic_projection * vec4(p, 0.0f, 1.0f);
 		} else {
@@ -63,74 +70,250 @@ const char *debug_vertex_shader_source = R"(
 		}
 		frag_color = vert_color;
 		frag_uv = vert_uv;
+		frag_texture_layer = vert_texture_layer;
 	}
 )";
 
 const char *debug_fragment_shader_source = R"(
-	in vec4 frag_color;
-	in vec2 frag_uv;
+	in vec4  frag_color;
+	in vec2  frag_uv;
+	in float frag_texture_layer;
 
 	out vec4 color;
 
-	uniform bool has_texture;
-	uniform sampler2D utexture;
-	uniform float alpha;
+	uniform sampler2DArray utexture;
 
 	void main()
 	{
-		if (has_texture) {
-			color = texture(utexture, frag_uv);
+		if (frag_texture_layer >= 0.0f) {
+			color = texture(utexture, vec3(frag_uv, frag_texture_layer));
 		} else {
 			color = frag_color;
 		}
 
-		color.w = alpha;
+		color.w = frag_color.w;
 	}
 )";
 
-struct Debug_Vertex {
-	V2    position;
-	Color color;
-	V2    uv;
-};
+#define GLYPH_ATLAS_PIXEL_SIDE   512
+#define GLYPH_ATLAS_PADDING      1
+#define DEBUG_FONT_PIXEL_SIZE    30
+#define MAX_DEBUG_TEXT_VERTS     (6 * 4096)
+#define NUM_ASCII_GLYPHS         128
 
 struct Glyph {
-	GLuint texture_id; // ID handle of the glyph texture
-	V2u    size;       // Size of glyph
-	V2s    bearing;    // Offset from baseline to left/top of glyph
-	FT_Pos advance;    // Offset to advance to next glyph
+	u32       codepoint;
+	bool      loaded;
+	V2u       size;     // Size of glyph
+	V2s       bearing;  // Offset from baseline to left/top of glyph
+	FT_Pos    advance;  // Offset to advance to next glyph
+	Rectangle atlas_uv; // Where the glyph bitmap sits in the atlas.
 };
 
-Glyph characters[128];
+// Every glyph is rasterized once into a single red channel texture, packed in rows. ASCII is loaded up front, anything else
+// gets added the first time it is drawn.
+struct Glyph_Atlas {
+	FT_Library ft;
+	FT_Face    face;
+	GLuint     texture;
+
+	u32 pen_x;
+	u32 pen_y;
+	u32 row_height;
+	bool full;
+
+	Glyph         ascii[NUM_ASCII_GLYPHS];
+	Array<Glyph>  extended;
+} glyph_atlas;
+
+struct Text_Vertex {
+	V2    position;
+	V2    uv;
+	Color color;
+};
+
+// All the text for the frame. Drawn in one call by debug_render.
+struct Debug_Text_Vertices {
+	Text_Vertex data[MAX_DEBUG_TEXT_VERTS];
+	u32 count;
+} debug_text_vertices;
 
 const char *text_vertex_shader_source = R"(
-	layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
-	out vec2 TexCoords;
+	layout (location = 0) in vec2 vert_position;
+	layout (location = 1) in vec2 vert_uv;
+	layout (location = 2) in vec4 vert_color;
+
+	out vec2 frag_uv;
+	out vec4 frag_color;
 
 	uniform mat4 projection;
 
 	void main()
 	{
-	    gl_Position = vec4(vertex.xy, 0.0, 1.0);
-	    TexCoords = vertex.zw;
+		gl_Position = projection * vec4(vert_position, 0.0, 1.0);
+		frag_uv = vert_uv;
+		frag_color = vert_color;
 	}
 )";
 
 const char *text_fragment_shader_source = R"(
-	in vec2 TexCoords;
+	in vec2 frag_uv;
+	in vec4 frag_color;
+
 	out vec4 color;
 
-	uniform sampler2D text;
-	uniform vec3 textColor;
+	uniform sampler2D glyph_atlas;
 
 	void main()
-	{    
-	    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-	    //color = vec4(textColor, 1.0) * sampled;
-	    color = vec4(0.0, 0.0, 0.0, 1.0);
-	}  
+	{
+		color = vec4(frag_color.rgb, frag_color.a * texture(glyph_atlas, frag_uv).r);
+	}
 )";
 
+bool
+rasterize_glyph(u32 codepoint, Glyph *g)
+{
+	g->codepoint = codepoint;
+	g->loaded    = false;
+
+	if (FT_Load_Char(glyph_atlas.face, codepoint, FT_LOAD_RENDER)) {
+		log_print(MAJOR_ERROR_LOG, "FREETYPE: Failed to load glyph for codepoint %u.", codepoint);
+		return false;
+	}
+
+	FT_GlyphSlot slot = glyph_atlas.face->glyph;
+	u32 w = slot->bitmap.width;
+	u32 h = slot->bitmap.rows;
+
+	if (glyph_atlas.pen_x + w + GLYPH_ATLAS_PADDING > GLYPH_ATLAS_PIXEL_SIDE) {
+		glyph_atlas.pen_x      = 0;
+		glyph_atlas.pen_y     += glyph_atlas.row_height + GLYPH_ATLAS_PADDING;
+		glyph_atlas.row_height = 0;
+	}
+	if (glyph_atlas.pen_y + h + GLYPH_ATLAS_PADDING > GLYPH_ATLAS_PIXEL_SIDE) {
+		if (!glyph_atlas.full) {
+			log_print(MAJOR_ERROR_LOG, "The glyph atlas is full, codepoint %u and any new glyphs after it won't be drawn.", codepoint);
+		}
+		glyph_atlas.full = true;
+		return false;
+	}
+
+	if (w > 0 && h > 0) {
+		gl_active_texture(GL_TEXTURE0);
+		gl_bind_texture(GL_TEXTURE_2D, glyph_atlas.texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, glyph_atlas.pen_x, glyph_atlas.pen_y, w, h, GL_RED, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
+	}
+
+	g->size     = { w, h };
+	g->bearing  = { slot->bitmap_left, slot->bitmap_top };
+	g->advance  = slot->advance.x;
+	g->atlas_uv = { (f32)glyph_atlas.pen_x / GLYPH_ATLAS_PIXEL_SIDE,
+	                (f32)glyph_atlas.pen_y / GLYPH_ATLAS_PIXEL_SIDE,
+	                (f32)w / GLYPH_ATLAS_PIXEL_SIDE,
+	                (f32)h / GLYPH_ATLAS_PIXEL_SIDE };
+	g->loaded   = true;
+
+	glyph_atlas.pen_x     += w + GLYPH_ATLAS_PADDING;
+	glyph_atlas.row_height = h > glyph_atlas.row_height ? h : glyph_atlas.row_height;
+
+	return true;
+}
+
+void
+glyph_atlas_init(const char *font_path, u32 pixel_size)
+{
+	if (FT_Init_FreeType(&glyph_atlas.ft))
+		_abort("FREETYPE: Could not init FreeType Library.");
+
+	if (FT_New_Face(glyph_atlas.ft, font_path, 0, &glyph_atlas.face))
+		_abort("FREETYPE: Failed to load font %s.", font_path);
+
+	FT_Set_Pixel_Sizes(glyph_atlas.face, 0, pixel_size);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Disable byte-alignment restriction
+
+	glGenTextures(1, &glyph_atlas.texture);
+	gl_active_texture(GL_TEXTURE0);
+	gl_bind_texture(GL_TEXTURE_2D, glyph_atlas.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLYPH_ATLAS_PIXEL_SIDE, GLYPH_ATLAS_PIXEL_SIDE, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+	// The texture starts out undefined, so clear it or the padding between glyphs could bleed garbage.
+	u8 *zeros = (u8 *)calloc(GLYPH_ATLAS_PIXEL_SIDE * GLYPH_ATLAS_PIXEL_SIDE, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLYPH_ATLAS_PIXEL_SIDE, GLYPH_ATLAS_PIXEL_SIDE, GL_RED, GL_UNSIGNED_BYTE, zeros);
+	free(zeros);
+
+	for (u32 c = 0; c < NUM_ASCII_GLYPHS; ++c) {
+		rasterize_glyph(c, &glyph_atlas.ascii[c]);
+	}
+
+	glyph_atlas.extended = make_array<Glyph>(64, 0);
+}
+
+// Returns NULL if the font has no such glyph or the atlas ran out of room.
+Glyph *
+get_glyph(u32 codepoint)
+{
+	if (codepoint < NUM_ASCII_GLYPHS) {
+		Glyph *g = &glyph_atlas.ascii[codepoint];
+		return g->loaded ? g : NULL;
+	}
+
+	for (auto &g : glyph_atlas.extended) {
+		if (g.codepoint == codepoint) {
+			return g.loaded ? &g : NULL;
+		}
+	}
+
+	// Failures get remembered too, so a missing glyph doesn't hit FreeType every frame.
+	Glyph g;
+	rasterize_glyph(codepoint, &g);
+	array_add(&glyph_atlas.extended, g);
+
+	Glyph *added = &glyph_atlas.extended.last();
+	return added->loaded ? added : NULL;
+}
+
+// Returns the codepoint and advances the string past it. Malformed bytes come back as U+FFFD.
+u32
+utf8_next_codepoint(const char **text)
+{
+	const u8 *s = (const u8 *)*text;
+
+	u32 codepoint;
+	u32 num_continuation_bytes;
+	if (s[0] < 0x80) {
+		codepoint = s[0];
+		num_continuation_bytes = 0;
+	} else if ((s[0] & 0xE0) == 0xC0) {
+		codepoint = s[0] & 0x1F;
+		num_continuation_bytes = 1;
+	} else if ((s[0] & 0xF0) == 0xE0) {
+		codepoint = s[0] & 0x0F;
+		num_continuation_bytes = 2;
+	} else if ((s[0] & 0xF8) == 0xF0) {
+		codepoint = s[0] & 0x07;
+		num_continuation_bytes = 3;
+	} else {
+		*text += 1;
+		return 0xFFFD;
+	}
+
+	for (u32 i = 1; i <= num_continuation_bytes; ++i) {
+		if ((s[i] & 0xC0) != 0x80) {
+			*text += i;
+			return 0xFFFD;
+		}
+		codepoint = (codepoint << 6) | (s[i] & 0x3F);
+	}
+
+	*text += num_continuation_bytes + 1;
+	return codepoint;
+}
+
 V3
 make_v3(V2 v, f32 z)
 {
@@ -144,78 +327,78 @@ debug_init()
 		random_colors[i] = random_color();
 
 	glGenVertexArrays(1, &debug_vao);
-	glBindVertexArray(debug_vao);
+	gl_bind_vertex_array(debug_vao);
 	glGenBuffers(1, &debug_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, debug_vbo);
-	glBufferData(GL_ARRAY_BUFFER, DEBUG_MAX_RENDER_VERTS * sizeof(Debug_Vertex), NULL, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, position));
+	gl_bind_buffer(GL_ARRAY_BUFFER, debug_vbo);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, position));
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, color));
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, uv));
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, screen_space));
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Debug_Vertex), (GLvoid *)offsetof(Debug_Vertex, texture_layer));
+	for (u32 i = 0; i < 5; ++i) {
+		glEnableVertexAttribArray(i);
+	}
 
-	debug_shader = make_shader(String{debug_vertex_shader_source, 0}, String{debug_fragment_shader_source, 0});
-	glUseProgram(debug_shader);
-	glUniformMatrix4fv(glGetUniformLocation(debug_shader, "orthographic_projection"), 1, false, (GLfloat *)&orthographic_projection);
-	glUniformMatrix4fv(glGetUniformLocation(debug_shader, "zoomed_orthographic_projection"), 1, false, (GLfloat *)&orthographic_projection);
+	debug_shader = make_shader_program(String{debug_vertex_shader_source, 0}, String{debug_fragment_shader_source, 0});
+	debug_orthographic_projection_uniform        = shader_find_uniform(&debug_shader, "orthographic_projection");
+	debug_zoomed_orthographic_projection_uniform = shader_find_uniform(&debug_shader, "zoomed_orthographic_projection");
+	debug_view_vector_uniform                    = shader_find_uniform(&debug_shader, "view_vector");
+	debug_texture_uniform                        = shader_find_uniform(&debug_shader, "utexture");
 
-	debug_text_shader = make_shader(String{text_vertex_shader_source, 0}, String{text_fragment_shader_source, 0});
+	use_shader_program(&debug_shader);
+	shader_set_uniform(&debug_shader, debug_orthographic_projection_uniform, orthographic_projection);
+	shader_set_uniform(&debug_shader, debug_zoomed_orthographic_projection_uniform, orthographic_projection);
+	shader_set_uniform(&debug_shader, debug_texture_uniform, 0);
+
+	debug_text_shader = make_shader_program(String{text_vertex_shader_source, 0}, String{text_fragment_shader_source, 0});
+	debug_text_projection_uniform = shader_find_uniform(&debug_text_shader, "projection");
+	debug_text_atlas_uniform      = shader_find_uniform(&debug_text_shader, "glyph_atlas");
 	glGenVertexArrays(1, &text_vao);
 	glGenBuffers(1, &text_vbo);
-	glBindVertexArray(text_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+	gl_bind_vertex_array(text_vao);
+	gl_bind_buffer(GL_ARRAY_BUFFER, text_vbo);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Text_Vertex), (GLvoid *)offsetof(Text_Vertex, position));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Text_Vertex), (GLvoid *)offsetof(Text_Vertex, uv));
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Text_Vertex), (GLvoid *)offsetof(Text_Vertex, color));
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glUseProgram(debug_text_shader);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+	use_shader_program(&debug_text_shader);
 	M4 m = make_orthographic_projection(0, window_pixel_width, 0, window_pixel_height);
-	glUniformMatrix4fv(glGetUniformLocation(debug_text_shader, "projection"), 1, false, (GLfloat *)&m);
-	glBindVertexArray(0);
+	shader_set_uniform(&debug_text_shader, debug_text_projection_uniform, m);
+	shader_set_uniform(&debug_text_shader, debug_text_atlas_uniform, 0);
+	gl_bind_vertex_array(0);
+
+	glyph_atlas_init("../data/fonts/arial.ttf", DEBUG_FONT_PIXEL_SIZE);
 }
 
-s64
-push_debug_vertices_and_command(Debug_Vertex *verts, u32 num_verts, u32 gl_mode, bool screen_space, Debug_Render_Command rc)
+void
+push_debug_vertices(Debug_Vertex *verts, u32 num_verts)
 {
-	glUseProgram(debug_shader);
-	glBindVertexArray(debug_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, debug_vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, debug_render_commands.num_total_verts * sizeof(Debug_Vertex), num_verts * sizeof(Debug_Vertex), verts);
-
-	u32 start_offset = debug_render_commands.num_total_verts * sizeof(Debug_Vertex);
-	debug_render_commands.num_total_verts += num_verts;
-	assert(debug_render_commands.num_total_verts < DEBUG_MAX_RENDER_VERTS);
-	assert(debug_render_commands.count < DEBUG_MAX_RENDER_COMMANDS);
-
-	rc.num_verts    = num_verts;
-	rc.gl_mode      = gl_mode;
-	rc.screen_space = screen_space;
-
-	debug_render_commands.data[debug_render_commands.count] = rc;
-	++debug_render_commands.count;
-
-	return start_offset;
+	size_t start = debug_vertices.size;
+	debug_vertices.resize(debug_vertices.size + num_verts);
+	memcpy(&debug_vertices.data[start], verts, num_verts * sizeof(Debug_Vertex));
 }
 
 Debug_Vertex
-make_debug_vertex(V2 position, Color c)
+make_debug_vertex(V2 position, Color c, bool screen_space)
 {
-	return (Debug_Vertex){ position, c, { 0.0f, 0.0f } };
+	return (Debug_Vertex){ position, c, { 0.0f, 0.0f }, (f32)screen_space, NO_DEBUG_TEXTURE };
 }
 
 Debug_Vertex
-make_debug_vertex(f32 position_x, f32 position_y, Color c)
+make_debug_vertex(f32 position_x, f32 position_y, Color c, bool screen_space)
 {
 	V2 p = { position_x, position_y };
-	return (Debug_Vertex){ p, c, { 0.f, 0.f } };
+	return (Debug_Vertex){ p, c, { 0.f, 0.f }, (f32)screen_space, NO_DEBUG_TEXTURE };
 }
 
 Debug_Vertex
-make_debug_vertex(f32 position_x, f32 position_y, V2 uv)
+make_debug_vertex(f32 position_x, f32 position_y, V2 uv, f32 texture_layer, f32 alpha, bool screen_space)
 {
 	V2 p = { position_x, position_y };
-	return (Debug_Vertex){ p, black, uv };
+	return (Debug_Vertex){ p, Color(0.0f, 0.0f, 0.0f, alpha), uv, (f32)screen_space, texture_layer };
 }
 
 void
@@ -225,28 +408,46 @@ debug_draw_triangle(V2 v1, V2 v2, V2 v3, Color c, bool screen_space, V2 view_vec
 	v2 = round_to_nearest_pixel(v2) + view_vector;
 	v3 = round_to_nearest_pixel(v3) + view_vector;
 
-	Debug_Vertex tri[3] = { make_debug_vertex(v1, c),
-	                        make_debug_vertex(v2, c),
-	                        make_debug_vertex(v3, c) };
-
-	Debug_Render_Command rc;
+	Debug_Vertex tri[3] = { make_debug_vertex(v1, c, screen_space),
+	                        make_debug_vertex(v2, c, screen_space),
+	                        make_debug_vertex(v3, c, screen_space) };
 
-	push_debug_vertices_and_command(tri, 3, GL_TRIANGLES, screen_space, rc);
+	push_debug_vertices(tri, 3);
 }
 
+// Thickness is in screen pixels, whatever the zoom. Lines are drawn as quads with square caps, so lines that meet at a corner
+// don't leave a notch.
 void
 debug_draw_line(V2 p1, V2 p2, Color c, bool screen_space = false, f32 thickness = 1.0f)
 {
 	p1 = round_to_nearest_pixel(p1);
 	p2 = round_to_nearest_pixel(p2);
 
-	Debug_Vertex line[2] = { make_debug_vertex(p1, c),
-	                         make_debug_vertex(p2, c) };
-
-	Debug_Render_Command rc;
-	rc.line_thickness = thickness;
+	V2 d = p2 - p1;
+	if (length2(d) == 0.0f) {
+		return;
+	}
 
-	push_debug_vertices_and_command(line, 2, GL_LINES, screen_space, rc);
+	f32 half_width = thickness * scaled_meters_per_pixel / 2.0f;
+	if (!screen_space) {
+		half_width /= zoom_factor;
+	}
+	V2 along  = half_width * normalize(d);
+	V2 across = { -along.y, along.x };
+
+	V2 a = p1 - along - across;
+	V2 b = p1 - along + across;
+	V2 e = p2 + along + across;
+	V2 f = p2 + along - across;
+
+	Debug_Vertex v[] = { make_debug_vertex(a, c, screen_space),
+	                     make_debug_vertex(b, c, screen_space),
+	                     make_debug_vertex(f, c, screen_space),
+	                     make_debug_vertex(b, c, screen_space),
+	                     make_debug_vertex(e, c, screen_space),
+	                     make_debug_vertex(f, c, screen_space) };
+
+	push_debug_vertices(v, ARRAY_COUNT(v));
 }
 
 void
@@ -254,21 +455,16 @@ debug_draw_rectangle(Rectangle r, Color c, bool screen_space = false, f32 alpha
 {
 	V2 rp = round_to_nearest_pixel({ r.x, r.y });
 
-	if (!screen_space) {
-		//rp += view_vector;
-	}
-
-	Debug_Vertex v[] = { make_debug_vertex(rp.x, rp.y,             c),
-	                     make_debug_vertex(rp.x, rp.y + r.h,       c),
-	                     make_debug_vertex(rp.x + r.w, rp.y,       c),
-	                     make_debug_vertex(rp.x, rp.y + r.h,       c),
-	                     make_debug_vertex(rp.x + r.w, rp.y + r.h, c),
-	                     make_debug_vertex(rp.x + r.w, rp.y,       c) };
+	c.a *= alpha;
 
-	Debug_Render_Command rc;
-	rc.alpha = alpha;
+	Debug_Vertex v[] = { make_debug_vertex(rp.x, rp.y,             c, screen_space),
+	                     make_debug_vertex(rp.x, rp.y + r.h,       c, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y,       c, screen_space),
+	                     make_debug_vertex(rp.x, rp.y + r.h,       c, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y + r.h, c, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y,       c, screen_space) };
 
-	push_debug_vertices_and_command(v, ARRAY_COUNT(v), GL_TRIANGLES, screen_space, rc);
+	push_debug_vertices(v, ARRAY_COUNT(v));
 }
 
 void
@@ -293,23 +489,27 @@ debug_draw_textured_rectangle(Rectangle r, const char *sprite_name, bool screen_
 
 	V2 rp = round_to_nearest_pixel({ r.x, r.y });
 
-	f32 tex_x = ls->frames[0].texture_scissor.x;
-	f32 tex_w = ls->frames[0].texture_scissor.w;
-	f32 tex_y = ls->frames[0].texture_scissor.y;
-	f32 tex_h = ls->frames[0].texture_scissor.h;
-
-	Debug_Vertex v[] = { make_debug_vertex(rp.x, rp.y,             { tex_x, tex_y + tex_h }),
-	                     make_debug_vertex(rp.x, rp.y + r.h,       { tex_x, tex_y }),
-	                     make_debug_vertex(rp.x + r.w, rp.y,       { tex_x + tex_w, tex_y + tex_h }),
-	                     make_debug_vertex(rp.x, rp.y + r.h,       { tex_x, tex_y }),
-	                     make_debug_vertex(rp.x + r.w, rp.y + r.h, { tex_x + tex_w, tex_y }),
-	                     make_debug_vertex(rp.x + r.w, rp.y,       { tex_x + tex_w, tex_y + tex_h }) };
-
-	Debug_Render_Command rc;
-	rc.alpha = alpha;
-	rc.texture_name = ls->texture_name;
-	
-	push_debug_vertices_and_command(v, ARRAY_COUNT(v), GL_TRIANGLES, screen_space, rc);
+	Texture_Asset *texture = get_sprite_sheet_texture(ls->texture_name);
+	if (!texture) {
+		return;
+	}
+
+	V2  uv_scale = texture->texture_array_uv_scale;
+	f32 layer    = texture->texture_array_layer;
+
+	f32 tex_x = ls->frames[0].texture_scissor.x * uv_scale.x;
+	f32 tex_w = ls->frames[0].texture_scissor.w * uv_scale.x;
+	f32 tex_y = ls->frames[0].texture_scissor.y * uv_scale.y;
+	f32 tex_h = ls->frames[0].texture_scissor.h * uv_scale.y;
+
+	Debug_Vertex v[] = { make_debug_vertex(rp.x, rp.y,             { tex_x, tex_y + tex_h },         layer, alpha, screen_space),
+	                     make_debug_vertex(rp.x, rp.y + r.h,       { tex_x, tex_y },                 layer, alpha, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y,       { tex_x + tex_w, tex_y + tex_h }, layer, alpha, screen_space),
+	                     make_debug_vertex(rp.x, rp.y + r.h,       { tex_x, tex_y },                 layer, alpha, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y + r.h, { tex_x + tex_w, tex_y },         layer, alpha, screen_space),
+	                     make_debug_vertex(rp.x + r.w, rp.y,       { tex_x + tex_w, tex_y + tex_h }, layer, alpha, screen_space) };
+
+	push_debug_vertices(v, ARRAY_COUNT(v));
 }
 
 void
@@ -326,67 +526,50 @@ debug_draw_quad_outline(Rectangle r, Color c, bool screen_space = false, f32 thi
 	V2 p3 = { r.x + r.w, r.y + r.h};
 	V2 p4 = { r.x, r.y + r.h};
 
-	V2 alignment = { thickness * scaled_meters_per_pixel / 2.0f, 0.0f };
-
-	debug_draw_line(p1 - alignment, p2, c, screen_space, thickness);
-	debug_draw_line(p2 - alignment, p3 - alignment, c, screen_space, thickness);
-	debug_draw_line(p3, p4 - alignment, c, screen_space, thickness);
+	debug_draw_line(p1, p2, c, screen_space, thickness);
+	debug_draw_line(p2, p3, c, screen_space, thickness);
+	debug_draw_line(p3, p4, c, screen_space, thickness);
 	debug_draw_line(p4, p1, c, screen_space, thickness);
 }
 
-// @TODO: Make the text rendering use the same projection as everybody else.
-// @TODO: Make the text push vertices and draw all text in one call.
+// Position is the left end of the baseline, in window pixels. Text is UTF-8.
 void
 debug_draw_text(V2 position, Color c, const char *text, f32 scale = 1.0f)
 {
-	glUseProgram(debug_text_shader);
-	glUniform3f(glGetUniformLocation(debug_text_shader, "textColor"), c.r, c.g, c.b);
-	glActiveTexture(GL_TEXTURE0);
-	glBindVertexArray(text_vao);
-
-	// Iterate through all characters
-	for (; *text; ++text) {
-		u8 uc = (u8)*text;
-		Glyph g = characters[uc];
-
-		f32 xpos = position.x + g.bearing.x * scale;
-		f32 ypos = position.y - (g.size.y - g.bearing.y) * scale;
-
-		f32 w = g.size.x * scale;
-		f32 h = g.size.y * scale;
-		// Update VBO for each character
-		f32 vertices[6][4] = {
-			{ 0,     1,   0.0, 0.0 },            
-			{ 0,     0,       0.0, 1.0 },
-			{ 1, 0,       1.0, 1.0 },
-
-			{ 0,     1,   0.0, 0.0 },
-			{ 1, 0,       1.0, 1.0 },
-			{ 1, 1,   1.0, 0.0 }           
-			/*
-			{ xpos,     ypos + h,   0.0, 0.0 },            
-			{ xpos,     ypos,       0.0, 1.0 },
-			{ xpos + w, ypos,       1.0, 1.0 },
-
-			{ xpos,     ypos + h,   0.0, 0.0 },
-			{ xpos + w, ypos,       1.0, 1.0 },
-			{ xpos + w, ypos + h,   1.0, 0.0 }           
-*/
-		};
-		// Render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, g.texture_id);
-		// Update content of VBO memory
-		glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
-		//glBindBuffer(GL_ARRAY_BUFFER, 0);
-		// Render quad
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		// Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-		position.x += (g.advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
-	}
+	while (*text) {
+		u32 codepoint = utf8_next_codepoint(&text);
+		Glyph *g = get_glyph(codepoint);
+		if (!g) {
+			continue;
+		}
+
+		if (debug_text_vertices.count + 6 > MAX_DEBUG_TEXT_VERTS) {
+			log_print(MINOR_ERROR_LOG, "Ran out of debug text vertices.");
+			return;
+		}
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+		f32 x = position.x + g->bearing.x * scale;
+		f32 y = position.y - ((s32)g->size.y - g->bearing.y) * scale;
+		f32 w = g->size.x * scale;
+		f32 h = g->size.y * scale;
+
+		// Glyph bitmaps are stored top row first.
+		f32 u0 = g->atlas_uv.x;
+		f32 u1 = g->atlas_uv.x + g->atlas_uv.w;
+		f32 v0 = g->atlas_uv.y + g->atlas_uv.h;
+		f32 v1 = g->atlas_uv.y;
+
+		Text_Vertex *v = &debug_text_vertices.data[debug_text_vertices.count];
+		v[0] = { { x,     y + h }, { u0, v1 }, c };
+		v[1] = { { x,     y     }, { u0, v0 }, c };
+		v[2] = { { x + w, y     }, { u1, v0 }, c };
+		v[3] = { { x,     y + h }, { u0, v1 }, c };
+		v[4] = { { x + w, y     }, { u1, v0 }, c };
+		v[5] = { { x + w, y + h }, { u1, v1 }, c };
+		debug_text_vertices.count += 6;
+
+		position.x += (g->advance >> 6) * scale; // Advance is in 1/64 pixels.
+	}
 }
 
 Loaded_Texture *get_texture(Asset_Id);
@@ -396,41 +579,28 @@ debug_render()
 {
 	//glEnable(GL_DEPTH_TEST);
 
-	if (debug_draw) {
-		glUseProgram(debug_shader);
-
-		glBindVertexArray(debug_vao);
-
-		GLuint num_verts_drawn = 0;
-		glBindBuffer(GL_ARRAY_BUFFER, debug_vbo);
-		for (u32 i = 0; i < debug_render_commands.count; ++i) {
-			Debug_Render_Command cmd = debug_render_commands.data[i];
-
-			if (cmd.texture_name != NULL) {
-				Texture_Asset *texture = get_texture(cmd.texture_name);
-				if (!texture) {
-					continue;
-				}
-
-				glUniform1i(glGetUniformLocation(debug_shader, "has_texture"), 1);
-				glBindTexture(GL_TEXTURE_2D, texture->gpu_handle);
-			} else {
-				glUniform1i(glGetUniformLocation(debug_shader, "has_texture"), 0);
-				glBindTexture(GL_TEXTURE_2D, 0);
-			}
-
-			glUniform1i(glGetUniformLocation(debug_shader, "screen_space"), cmd.screen_space);
-
-			glUniform1f(glGetUniformLocation(debug_shader, "alpha"), cmd.alpha);
-
-			glLineWidth(cmd.line_thickness);
+	if (debug_draw && debug_vertices.size > 0) {
+		use_shader_program(&debug_shader);
+		gl_bind_vertex_array(debug_vao);
+		gl_active_texture(GL_TEXTURE0);
+		gl_bind_texture(GL_TEXTURE_2D_ARRAY, sprite_texture_array);
+		gl_bind_buffer(GL_ARRAY_BUFFER, debug_vbo);
+		glBufferData(GL_ARRAY_BUFFER, debug_vertices.size * sizeof(Debug_Vertex), debug_vertices.data, GL_STREAM_DRAW);
+		glDrawArrays(GL_TRIANGLES, 0, debug_vertices.size);
+	}
 
-			glDrawArrays(cmd.gl_mode, num_verts_drawn, cmd.num_verts);
-			num_verts_drawn += cmd.num_verts;
-		}
+	if (debug_draw && debug_text_vertices.count > 0) {
+		use_shader_program(&debug_text_shader);
+		gl_bind_vertex_array(text_vao);
+		gl_active_texture(GL_TEXTURE0);
+		gl_bind_texture(GL_TEXTURE_2D, glyph_atlas.texture);
+		gl_bind_buffer(GL_ARRAY_BUFFER, text_vbo);
+		glBufferData(GL_ARRAY_BUFFER, debug_text_vertices.count * sizeof(Text_Vertex), debug_text_vertices.data, GL_STREAM_DRAW);
+		glDrawArrays(GL_TRIANGLES, 0, debug_text_vertices.count);
 	}
 
-	debug_render_commands.count = debug_render_commands.num_total_verts = 0;
+	debug_vertices.clear();
+	debug_text_vertices.count = 0;
 
 	//glDisable(GL_DEPTH_TEST);
 }
@@ -504,7 +674,7 @@ struct Button {
 Asset_Id active_tile_asset_id = ASSET_DOES_NOT_EXIST;
 const char *active_tile_name = NULL;
 
-Collider_Id add_collider(f32, f32, f32, f32, Array<Rectangle> *);
+Collider_Id add_collider(f32, f32, f32, f32, Collider_Store *);
 
 V2
 world_to_screen(V2 wp, const Camera &c)
@@ -554,99 +724,185 @@ debug_draw_sweeps(Sweep *sweeps, u32 num_sweeps)
 	}
 }
 
-void
-load_level(Array<Tile> *tiles, Array<Rectangle> *colliders)
-{
-	array_reset(tiles);
-	array_reset(colliders);
+enum Edit_Mode {
+	EDIT_MODE_ADD,
+	EDIT_MODE_REMOVE,
+	EDIT_MODE_MOVE,
+	EDIT_MODE_SELECT,
+};
 
-	FILE *fh = fopen("../data/level.txt", "r");
+Edit_Mode  edit_mode      = EDIT_MODE_SELECT;
+Array<u32> selected_tiles = make_array<u32>(100, 0); // Indices into the game state's tiles.
 
-	u32 num_tiles = 0;
-	fscanf(fh, "%u", &num_tiles);
+u32 remove_tile(Array<Tile> *tiles, Collider_Store *colliders, u32 tile_index);
 
-	char name_buf[256];
-	for (u32 i = 0; i < num_tiles; ++i) {
-		s32 tile_x = 0, tile_y = 0;
-		fscanf(fh, "%s %d %d", name_buf, &tile_x, &tile_y);
+struct Level_Change {
+	Edit_Mode   operation;
+	V2          meter_delta_position;
+	Rectangle   selection_rect_before_move;
+	Array<u32> *tile_indices; // Owned by whoever made the change, so changes never share them.
+};
 
-		add_tile(name_buf, (V2){ tile_x * TILE_SIDE_IN_METERS, tile_y * TILE_SIDE_IN_METERS }, tiles, colliders);
-	}
-#if 0
-	auto handle = platform_open_file("../data/level.ahh", O_RDONLY);
-	assert(handle != FILE_HANDLE_ERROR);
+// What a record in the undo log starts with.
+struct Level_Change_Header {
+	u32       operation;
+	u32       num_tile_indices;
+	u32       num_runs;
+	V2        meter_delta_position;
+	Rectangle selection_rect_before_move;
+};
+
+// The undo history is one growable log of variable size records, oldest first, so it's only ever as big as the edits in it
+// and never has to forget any. A record is a Level_Change_Header, then the tile indices as runs of consecutive indices (a
+// zigzag varint gap from the end of the last run and a varint run length), then the record's size as a u32 so undo can step
+// back over it. A box edit over thousands of tiles in a row takes a handful of bytes.
+Array<u8> level_change_log  = make_array<u8>(4096, 0);
+size_t    level_change_head = 0; // Where the next undo ends and the next redo starts.
 
-	u32 num_tiles = 0;
-	assert(platform_read_file(handle, sizeof(num_tiles), &num_tiles));
+// Empties tile_indices and collects the change's tile indices in it.
+Level_Change
+make_level_change(Edit_Mode operation, Array<u32> *tile_indices)
+{
+	Level_Change lc;
+	lc.operation                  = operation;
+	lc.meter_delta_position       = { 0.0f, 0.0f };
+	lc.selection_rect_before_move = NO_RECTANGLE;
+	lc.tile_indices               = tile_indices;
+	lc.tile_indices->size         = 0;
+	return lc;
+}
 
-	char asset_name[256]; // @TEMP
-	for (u32 i = 0; i < num_tiles; ++i) {
-		u32 asset_name_length = 0;
-		V2 tile_world_position = {};
+void
+reset_level_changes()
+{
+	level_change_log.size = 0;
+	level_change_head     = 0;
+}
 
-		assert(platform_read_file(handle, sizeof(asset_name_length), &asset_name_length));
-		assert(platform_read_file(handle, asset_name_length, &asset_name));
-		asset_name[asset_name_length] = '\0';
-		assert(platform_read_file(handle, sizeof(tile_world_position), &tile_world_position));
+// Drops the box selection, for when the tile indices it holds no longer mean the same tiles.
+void
+reset_tile_selection()
+{
+	edit_mode = EDIT_MODE_SELECT;
+	selected_tiles.resize(0);
+}
 
-		add_tile("tiles_girder", tile_world_position, tiles, colliders);
+void
+write_varint(u32 v, Array<u8> *log)
+{
+	while (v >= 0x80) {
+		array_add(log, (u8)(v | 0x80));
+		v >>= 7;
 	}
-#endif
+	array_add(log, (u8)v);
 }
 
-enum Edit_Mode {
-	EDIT_MODE_ADD,
-	EDIT_MODE_REMOVE,
-	EDIT_MODE_MOVE,
-	EDIT_MODE_SELECT,
-};
+u32
+read_varint(const u8 **p)
+{
+	u32 v = 0;
+	for (u32 shift = 0; ; shift += 7) {
+		u8 b = *(*p)++;
+		v |= (u32)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			return v;
+		}
+	}
+}
 
-Edit_Mode edit_mode = EDIT_MODE_SELECT;
+// Adding a change drops anything that could have been redone.
+void
+add_level_change(const Level_Change &lc)
+{
+	Array<u32> &indices = *lc.tile_indices;
+	if (indices.size == 0) {
+		return;
+	}
 
-u32 remove_tile(Array<Tile> *tiles, Array<Rectangle> *colliders, u32 tile_index);
+	level_change_log.size = level_change_head;
+	size_t start = level_change_log.size;
+
+	Level_Change_Header h = {};
+	h.operation                  = lc.operation;
+	h.num_tile_indices           = indices.size;
+	h.meter_delta_position       = lc.meter_delta_position;
+	h.selection_rect_before_move = lc.selection_rect_before_move;
+	level_change_log.resize(start + sizeof(h));
+
+	u32 previous_end = 0;
+	for (u32 i = 0; i < indices.size; ) {
+		u32 run_length = 1;
+		while (i + run_length < indices.size && indices[i + run_length] == indices[i] + run_length) {
+			run_length += 1;
+		}
 
-struct Level_Change {
-	u32       tile_indices[32];
-	u32       num_tile_indices = 0;
-	V2        meter_delta_position;
-	Rectangle selection_rect_before_move;
+		s32 gap = (s32)(indices[i] - previous_end);
+		write_varint(((u32)gap << 1) ^ (u32)(gap >> 31), &level_change_log);
+		write_varint(run_length, &level_change_log);
 
-	Edit_Mode operation;
-};
+		previous_end = indices[i] + run_length;
+		i += run_length;
+		h.num_runs += 1;
+	}
+	memcpy(&level_change_log[start], &h, sizeof(h));
 
-#define MAX_LEVEL_CHANGES 256
-Level_Change level_changes[MAX_LEVEL_CHANGES];
-u32 num_level_changes = 0;
-u32 level_change_head = 0;
+	u32 record_size = (level_change_log.size - start) + sizeof(u32);
+	level_change_log.resize(level_change_log.size + sizeof(u32));
+	memcpy(&level_change_log[level_change_log.size - sizeof(u32)], &record_size, sizeof(u32));
 
-void
-add_level_change(const Level_Change &ele)
+	level_change_head = level_change_log.size;
+}
+
+// Reads the record's tile indices into tile_indices. Returns the size of the record.
+u32
+read_level_change(size_t start, Level_Change *lc, Array<u32> *tile_indices)
 {
-	memcpy(&level_changes[level_change_head], &ele, sizeof(ele));
-	++level_change_head;
-	num_level_changes = level_change_head;
+	Level_Change_Header h;
+	memcpy(&h, &level_change_log[start], sizeof(h));
+
+	*lc = make_level_change((Edit_Mode)h.operation, tile_indices);
+	lc->meter_delta_position       = h.meter_delta_position;
+	lc->selection_rect_before_move = h.selection_rect_before_move;
+
+	const u8 *p = &level_change_log[start + sizeof(h)];
+	u32 previous_end = 0;
+	for (u32 r = 0; r < h.num_runs; ++r) {
+		u32 zigzag     = read_varint(&p);
+		u32 run_length = read_varint(&p);
+		u32 first      = previous_end + (u32)((s32)(zigzag >> 1) ^ -(s32)(zigzag & 1));
+		for (u32 i = 0; i < run_length; ++i) {
+			array_add(lc->tile_indices, first + i);
+		}
+		previous_end = first + run_length;
+	}
+	assert(lc->tile_indices->size == h.num_tile_indices);
+
+	return (p - &level_change_log[start]) + sizeof(u32);
 }
 
 u8
-undo(Level_Change *ele)
+undo(Level_Change *lc, Array<u32> *tile_indices)
 {
 	if (level_change_head == 0) {
 		return false;
 	}
 
-	*ele = level_changes[--level_change_head];
+	u32 record_size;
+	memcpy(&record_size, &level_change_log[level_change_head - sizeof(u32)], sizeof(u32));
+	level_change_head -= record_size;
+	read_level_change(level_change_head, lc, tile_indices);
 
 	return true;
 }
 
 u8
-redo(Level_Change *ele)
+redo(Level_Change *lc, Array<u32> *tile_indices)
 {
-	if (level_change_head == num_level_changes) {
+	if (level_change_head == level_change_log.size) {
 		return false;
 	}
 
-	*ele = level_changes[level_change_head++];
+	level_change_head += read_level_change(level_change_head, lc, tile_indices);
 
 	return true;
 }
@@ -703,7 +959,6 @@ struct Tile_Rectangle {
 Program_State
 debug_update(const Input &input, Game_State *game_state)
 {
-	static f32 zoom_factor = 1.0f;
 	static f32 proj_w = window_scaled_meter_width, proj_h = window_scaled_meter_height, proj_x = 0, proj_y = 0;
 
 	Program_State return_state = PROGRAM_STATE_RUNNING;
@@ -721,11 +976,11 @@ debug_update(const Input &input, Game_State *game_state)
 		proj_y = 0;
 
 		orthographic_projection = make_orthographic_projection(proj_x, proj_w, proj_y, proj_h);
-		glUseProgram(shader);
-		glUniformMatrix4fv(glGetUniformLocation(shader, "projection_matrix"), 1, false, (GLfloat *)&orthographic_projection);
-		glUseProgram(debug_shader);
-		glUniformMatrix4fv(glGetUniformLocation(debug_shader, "zoomed_orthographic_projection"), 1, false, (GLfloat *)&orthographic_projection);
-		glUseProgram(0);
+		use_shader_program(&shader);
+		shader_set_uniform(&shader, sprite_projection_uniform, orthographic_projection);
+		use_shader_program(&debug_shader);
+		shader_set_uniform(&debug_shader, debug_zoomed_orthographic_projection_uniform, orthographic_projection);
+		gl_use_program(0);
 
 		show_editor = !show_editor;
 	}
@@ -733,48 +988,74 @@ debug_update(const Input &input, Game_State *game_state)
 	if (key_pressed(input.keyboard, C_KEY))
 		show_colliders = !show_colliders;
 
-	static Rectangle selection_rect;
-	debug_draw_text({0, 0}, black, "hello", 10.0f);
-
-	if (key_down(input.keyboard, LCTRL_KEY) && key_pressed(input.keyboard, S_KEY)) {
-		log_print(STANDARD_LOG, "Saving the level: %u.", game_state->tiles.size);
-
-		FILE *fh = fopen("../data/level.txt", "w");
-		if (!fh)  _abort("Could not open level file for writing.");
-		DEFER(fclose(fh));
+	if (key_down(input.keyboard, LCTRL_KEY) && key_pressed(input.keyboard, B_KEY)) {
+		benchmark_minkowski_kernels();
+		benchmark_segment_kernels();
+		benchmark_sample_kernels();
+	}
 
-		u32 num_tiles = game_state->tiles.size;
-		fprintf(fh, "%u\n", num_tiles);
+	// Plays the test sound panned to wherever the mouse is across the window, to hear the mixer. With shift, starts or stops
+	// the streamed test track.
+	if (key_down(input.keyboard, LCTRL_KEY) && key_pressed(input.keyboard, M_KEY)) {
+		static Voice_Id debug_track_voice = NO_VOICE_ID;
+		if (!key_down(input.keyboard, LSHIFT_KEY)) {
+			play_sound(debug_sound, 0.5f, (2.0f * input.mouse.position.x / window_scaled_meter_width) - 1.0f);
+		} else if (debug_track_voice == NO_VOICE_ID) {
+			debug_track_voice = play_sound(debug_track, 0.5f, 0.0f, true);
+		} else {
+			stop_voice(debug_track_voice);
+			debug_track_voice = NO_VOICE_ID;
+		}
+	}
 
-		for (auto t : game_state->tiles) {
-			size_t name_len = strlen(t.sprite.name);
+	static Rectangle selection_rect;
+#ifdef DEBUG
+	char gl_call_counts[128];
+	snprintf(gl_call_counts, sizeof(gl_call_counts), "gl state calls issued: %u elided: %u", gl_state.last_frame_num_calls_issued, gl_state.last_frame_num_calls_elided);
+	debug_draw_text({ 10.0f, window_pixel_height - 30.0f }, black, gl_call_counts);
+
+	// The latency is measured by the device, from when the mixer last wrote a period to when it'll be heard.
+	if (mixer.running) {
+		char sound_stats[128];
+		u32 latency_frames = __atomic_load_n(&pcm_playback_info.latency_frames, __ATOMIC_RELAXED);
+		u32 num_underruns  = __atomic_load_n(&pcm_playback_info.num_underruns, __ATOMIC_RELAXED);
+		snprintf(sound_stats, sizeof(sound_stats), "sound latency: %.1f ms (%lu frame periods, %s) underruns: %u", latency_frames * 1000.0f / pcm_playback_info.sample_rate, pcm_playback_info.frames_per_period, pcm_playback_info.mmap ? "mapped" : "copied", num_underruns);
+		debug_draw_text({ 10.0f, window_pixel_height - 90.0f }, (num_underruns > 0) ? red : black, sound_stats);
+	}
+#endif
 
-			V2s tp = world_position_to_tile_position(t.world_position);
-			fprintf(fh, "%s %d %d\n", t.sprite.name, tp.x, tp.y);
+	if (key_down(input.keyboard, LCTRL_KEY) && key_pressed(input.keyboard, S_KEY)) {
+		// With shift, a level that's loaded whole gets split into chunks, and streams from then on.
+		if (game_state->level_stream.enabled || key_down(input.keyboard, LSHIFT_KEY)) {
+			save_level_chunks(&game_state->level_stream, &game_state->tiles, &game_state->colliders);
+		} else {
+			save_level(LEVEL_PATH, &game_state->tiles, &game_state->colliders);
 		}
+	}
 
-#if 0
-		auto handle = platform_open_file("../data/level.txt", O_WRONLY | O_CREAT);
-		assert(handle != FILE_HANDLE_ERROR);
-
-		u32 num_tiles = game_state->tiles.size;
-		assert(platform_write_file(handle, sizeof(num_tiles), &num_tiles));
-
-		for (auto t : game_state->tiles) {
-			u32 string_len = 0;
-			char name_buffer[256]; // @TEMP
-			assert(0);
-			//string_len = get_asset_id_string(t.sprite.sprite_asset_id, name_buffer);
-			assert(string_len != 0);
-			name_buffer[string_len] = '\0';
-			printf("NAME %u %s\n", string_len, name_buffer);
-			assert(platform_write_file(handle, sizeof(string_len), &string_len));
-			assert(platform_write_file(handle, string_len, &name_buffer));
-			assert(platform_write_file(handle, sizeof(t.world_position), &t.world_position));
+	// Saves run on a job thread, show how the last one is going and how it went.
+	static u32 save_finished_ms = 0;
+	u32 save_state = __atomic_load_n(&level_save.state, __ATOMIC_ACQUIRE);
+	if (save_state != LEVEL_SAVE_IDLE) {
+		char save_text[64];
+		if (save_state == LEVEL_SAVE_RUNNING) {
+			u32 percent = level_save.progress * 100;
+			char bar[21];
+			for (u32 i = 0; i < 20; ++i) {
+				bar[i] = (i < percent / 5) ? '#' : '.';
+			}
+			bar[20] = '\0';
+			snprintf(save_text, sizeof(save_text), "Saving the level [%s] %u%%", bar, percent);
+			save_finished_ms = 0;
+		} else {
+			snprintf(save_text, sizeof(save_text), (save_state == LEVEL_SAVE_DONE) ? "Saved the level." : "Could not save the level, see the log.");
+			if (save_finished_ms == 0) {
+				save_finished_ms = platform_get_time_ms();
+			} else if (platform_get_time_ms() - save_finished_ms > 2000) {
+				level_save.state = LEVEL_SAVE_IDLE;
+			}
 		}
-
-		platform_close_file(handle);
-#endif
+		debug_draw_text({ 10.0f, window_pixel_height - 60.0f }, (save_state == LEVEL_SAVE_FAILED) ? red : black, save_text);
 	}
 
 	if (key_down(input.keyboard, LCTRL_KEY) && (key_pressed(input.keyboard, Z_KEY) || key_pressed(input.keyboard, Y_KEY))) {
@@ -786,18 +1067,18 @@ debug_update(const Input &input, Game_State *game_state)
 			redoing = true;
 		}
 
+		static Array<u32> undo_indices = make_array<u32>(256, 0);
 		Level_Change ele;
 		u8 success = false;
 
 		if (undoing) {
-			success = undo(&ele);
+			success = undo(&ele, &undo_indices);
 		} else {
-			success = redo(&ele);
+			success = redo(&ele, &undo_indices);
 		}
 
 		if (success) {
-			for (u32 i = 0; i < ele.num_tile_indices; ++i) {
-				u32 tile_index = ele.tile_indices[i];
+			for (u32 tile_index : *ele.tile_indices) {
 
 				assert(game_state->tiles.size > tile_index);
 
@@ -814,17 +1095,17 @@ debug_update(const Input &input, Game_State *game_state)
 
 				case EDIT_MODE_REMOVE: {
 					if (undoing) {
-						unhide_tile(&game_state->tiles, tile_index);
+						unhide_tile(&game_state->tiles, &game_state->colliders, tile_index);
 					} else {
-						hide_tile(&game_state->tiles, tile_index);
+						hide_tile(&game_state->tiles, &game_state->colliders, tile_index);
 					}
 				} break;
 
 				case EDIT_MODE_ADD: {
 					if (undoing) {
-						hide_tile(&game_state->tiles, tile_index);
+						hide_tile(&game_state->tiles, &game_state->colliders, tile_index);
 					} else {
-						unhide_tile(&game_state->tiles, tile_index);
+						unhide_tile(&game_state->tiles, &game_state->colliders, tile_index);
 					}
 				} break;
 
@@ -860,11 +1141,11 @@ debug_update(const Input &input, Game_State *game_state)
 			zoom_factor = window_scaled_meter_width / (proj_w + ZOOM_STEP * step);
 
 			orthographic_projection = make_orthographic_projection(proj_x, proj_w, proj_y, proj_h);
-			glUseProgram(shader);
-			glUniformMatrix4fv(glGetUniformLocation(shader, "projection_matrix"), 1, false, (GLfloat *)&orthographic_projection);
-			glUseProgram(debug_shader);
-			glUniformMatrix4fv(glGetUniformLocation(debug_shader, "zoomed_orthographic_projection"), 1, false, (GLfloat *)&orthographic_projection);
-			glUseProgram(0);
+			use_shader_program(&shader);
+			shader_set_uniform(&shader, sprite_projection_uniform, orthographic_projection);
+			use_shader_program(&debug_shader);
+			shader_set_uniform(&debug_shader, debug_zoomed_orthographic_projection_uniform, orthographic_projection);
+			gl_use_program(0);
 		}
 
 		if (key_pressed(input.keyboard, R_KEY)) {
@@ -874,8 +1155,6 @@ debug_update(const Input &input, Game_State *game_state)
 			draw_grid = !draw_grid;
 		}
 
-		static Array<Asset_Id> selected_tiles = make_array<Asset_Id>(100, 0);
-
 		static Color grid_color              = white;
 
 		if (mouse_button_down(input.mouse, MOUSE_BUTTON_MIDDLE)) {
@@ -968,10 +1247,9 @@ debug_update(const Input &input, Game_State *game_state)
 
 					u8 do_add = false;
 
-					Level_Change ec;
+					static Array<u32> add_indices = make_array<u32>(256, 0);
+					Level_Change ec = make_level_change(EDIT_MODE_ADD, &add_indices);
 					if (mouse_button_released(input.mouse, MOUSE_BUTTON_LEFT)) {
-						ec.operation        = EDIT_MODE_ADD;
-
 						do_add = true;
 					}
 
@@ -980,7 +1258,7 @@ debug_update(const Input &input, Game_State *game_state)
 							if (do_add) {
 								add_tile(active_tile_name, { preview_rect_origin_x + (x * tile_w), preview_rect_origin_y + (y * tile_h) }, &game_state->tiles, &game_state->colliders);
 
-								ec.tile_indices[ec.num_tile_indices++] = (u32)(game_state->tiles.size - 1);
+								array_add(ec.tile_indices, (u32)(game_state->tiles.size - 1));
 							} else {
 								debug_draw_textured_rectangle({ preview_rect_origin_x + (x * tile_w), preview_rect_origin_y + (y * tile_h), tile_w, tile_h }, active_tile_name, false, 0.5f);
 							}
@@ -999,30 +1277,19 @@ debug_update(const Input &input, Game_State *game_state)
 			static bool moving = false;
 
 			if (edit_mode == EDIT_MODE_REMOVE && defining_edit_rect && mouse_button_released(input.mouse, MOUSE_BUTTON_LEFT)) {
-					Level_Change lc;
-					lc.operation = EDIT_MODE_REMOVE;
-
-					for (u32 i = 0; i < game_state->tiles.size; ++i) {
-						Rectangle tile_rect = { game_state->tiles[i].world_position.x, game_state->tiles[i].world_position.y, TILE_SIDE_IN_METERS, TILE_SIDE_IN_METERS };
+					static Array<u32> remove_indices = make_array<u32>(256, 0);
+					Level_Change lc = make_level_change(EDIT_MODE_REMOVE, &remove_indices);
 
-						if (intersect_rectangle_rectangle(edit_rect, tile_rect)) {
-							lc.tile_indices[lc.num_tile_indices++] = i;
-
-							hide_tile(&game_state->tiles, i);
-						}
+					query_tiles(edit_rect, &game_state->tiles, &game_state->colliders, lc.tile_indices);
+					for (u32 i : *lc.tile_indices) {
+						hide_tile(&game_state->tiles, &game_state->colliders, i);
 					}
 
-					if (lc.num_tile_indices > 0)  add_level_change(lc);
+					add_level_change(lc);
 			}
 
 			if (edit_mode == EDIT_MODE_SELECT && defining_edit_rect && mouse_button_released(input.mouse, MOUSE_BUTTON_LEFT)) {
-				for (u32 i = 0; i < game_state->tiles.size; ++i) {
-					Rectangle tile_rect = { game_state->tiles[i].world_position.x, game_state->tiles[i].world_position.y, TILE_SIDE_IN_METERS, TILE_SIDE_IN_METERS };
-
-					if (intersect_rectangle_rectangle(edit_rect, tile_rect)) {
-						selected_tiles.push(i);
-					}
-				}
+				query_tiles(edit_rect, &game_state->tiles, &game_state->colliders, &selected_tiles);
 
 				edit_mode = EDIT_MODE_MOVE;
 				selection_rect = edit_rect;
@@ -1047,7 +1314,7 @@ debug_update(const Input &input, Game_State *game_state)
 						move_origin = world_position_to_tile_position(mouse_world_position);
 
 						for (auto i : selected_tiles) {
-							hide_tile(&game_state->tiles, i);
+							hide_tile(&game_state->tiles, &game_state->colliders, i);
 						}
 					} else {
 						pressed_outside_selection_rect = true;;
@@ -1069,17 +1336,17 @@ debug_update(const Input &input, Game_State *game_state)
 				V2 meter_move = TILE_SIDE_IN_METERS * tile_move;
 
 				if (moving && mouse_button_released(input.mouse, MOUSE_BUTTON_LEFT)) {
-					Level_Change ec;
+					static Array<u32> move_indices = make_array<u32>(256, 0);
+					Level_Change ec = make_level_change(EDIT_MODE_MOVE, &move_indices);
 					ec.meter_delta_position       = meter_move;
 					ec.selection_rect_before_move = selection_rect;
-					ec.operation                  = EDIT_MODE_MOVE;
 
 					for (auto i : selected_tiles) {
-						unhide_tile(&game_state->tiles, i);
+						unhide_tile(&game_state->tiles, &game_state->colliders, i);
 
 						move_tile(meter_move, i, game_state);
 
-						ec.tile_indices[ec.num_tile_indices++] = i;
+						array_add(ec.tile_indices, i);
 					}
 
 					add_level_change(ec);
@@ -1173,8 +1440,10 @@ debug_update(const Input &input, Game_State *game_state)
 
 	if (show_colliders) {
 		static Color collider_color{199, 21, 133, 100};
-		for (u32 i = 0; i < game_state->colliders.size; ++i) {
-			debug_draw_rectangle(game_state->colliders[i], collider_color, false, 0.45f);
+		for (u32 i = 0; i < game_state->colliders.rects.size; ++i) {
+			if (!collider_is_free(i, &game_state->colliders)) {
+				debug_draw_rectangle(get_collider(i, &game_state->colliders), collider_color, false, 0.45f);
+			}
 		}
 	}
 
@@ -1218,7 +1487,7 @@ debug_update(const Input &input, Game_State *game_state)
 					started_test = true;
 					printf("Bend test start.\n");
 				} else {
-					add_and_remove_bends(game_state->colliders, test_start_pos, test_end_pos, p->physical_position, p->collider_id, r);
+					add_and_remove_bends(game_state->colliders, test_start_pos, test_end_pos, p->physical_position, r);
 					started_test = false;
 					printf("Bend test end.\n");
 				}
@@ -1236,8 +1505,8 @@ debug_update(const Input &input, Game_State *game_state)
 
 #endif
 
-	glUseProgram(debug_shader);
-	glUniform2f(glGetUniformLocation(debug_shader, "view_vector"), game_state->camera.view_vector.x, game_state->camera.view_vector.y);
+	use_shader_program(&debug_shader);
+	shader_set_uniform(&debug_shader, debug_view_vector_uniform, game_state->camera.view_vector);
 
 	return return_state;
 }
@@ -0,0 +1,290 @@
+//
+// Level streaming. A level saved as chunks is split into files of LEVEL_CHUNK_SIDE by LEVEL_CHUNK_SIDE tiles in the level
+// file format. Job threads map the files of the chunks around the camera, and between frames the main thread adds the mapped
+// chunks to the level and drops the chunks the camera has left far behind, so only the chunks near the camera are ever in
+// memory and there's no load screen however big the level is.
+//
+
+bool
+level_chunks_exist()
+{
+	return platform_is_directory(LEVEL_CHUNK_DIRECTORY);
+}
+
+void
+level_chunk_path(s32 x, s32 y, char *buffer, size_t buffer_size)
+{
+	snprintf(buffer, buffer_size, "%s/%d_%d.lvl", LEVEL_CHUNK_DIRECTORY, x, y);
+}
+
+V2s
+world_position_to_level_chunk(V2 p)
+{
+	s32 tile_x = lround(p.x / TILE_SIDE_IN_METERS);
+	s32 tile_y = lround(p.y / TILE_SIDE_IN_METERS);
+	return { (s32)floor(tile_x / (f32)LEVEL_CHUNK_SIDE), (s32)floor(tile_y / (f32)LEVEL_CHUNK_SIDE) };
+}
+
+// Runs on a job thread. Reads every page of the chunk file in, so adding the chunk doesn't stall the main thread on the disk.
+void
+load_level_chunk_job_callback(void *job_data)
+{
+	Level_Chunk *c = (Level_Chunk *)job_data;
+
+	char path[256];
+	level_chunk_path(c->x, c->y, path, sizeof(path));
+
+	size_t file_size = 0;
+	const char *file = platform_map_file(path, &file_size); // A chunk with nothing in it has no file.
+
+	size_t page_size = platform_get_page_size();
+	for (size_t i = 0; i < file_size; i += page_size) {
+		(void)((volatile const char *)file)[i];
+	}
+
+	c->file      = file;
+	c->file_size = file_size;
+	__atomic_store_n(&c->state, LEVEL_CHUNK_LOADED, __ATOMIC_RELEASE);
+}
+
+Level_Chunk *
+find_level_chunk(Level_Stream *ls, s32 x, s32 y)
+{
+	for (Level_Chunk &c : ls->chunks) {
+		if (c.state != LEVEL_CHUNK_FREE && c.x == x && c.y == y) {
+			return &c;
+		}
+	}
+	return NULL;
+}
+
+Level_Chunk *
+claim_level_chunk(Level_Stream *ls, s32 x, s32 y, Level_Chunk_State state)
+{
+	for (Level_Chunk &c : ls->chunks) {
+		if (c.state == LEVEL_CHUNK_FREE) {
+			c.x         = x;
+			c.y         = y;
+			c.file      = NULL;
+			c.file_size = 0;
+			c.state     = state;
+			return &c;
+		}
+	}
+
+	static bool warned = false;
+	if (!warned) {
+		log_print(MINOR_ERROR_LOG, "Ran out of level chunks, chunk %d %d won't load until some are dropped.", x, y);
+		warned = true;
+	}
+	return NULL;
+}
+
+// Helps the job threads with whatever is queued, then waits for any chunk load still in flight.
+void
+wait_for_level_chunks(Level_Stream *ls)
+{
+	do_all_jobs(&job_queue);
+	for (Level_Chunk &c : ls->chunks) {
+		while (__atomic_load_n(&c.state, __ATOMIC_ACQUIRE) == LEVEL_CHUNK_LOADING) {
+			do_all_jobs(&job_queue);
+		}
+	}
+}
+
+void
+add_level_chunk(Level_Chunk *c, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	if (c->file) {
+		char path[256];
+		level_chunk_path(c->x, c->y, path, sizeof(path));
+		load_level_data(c->file, c->file_size, path, tiles, colliders);
+
+		platform_unmap_file(c->file, c->file_size);
+		c->file = NULL;
+	}
+	c->state = LEVEL_CHUNK_RESIDENT;
+}
+
+// Takes the chunk's tiles out of the level, keeping the order of the rest. Its regions go at the next update_tile_colliders().
+void
+drop_level_chunk(Level_Chunk *c, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	u32 num_kept = 0;
+	for (u32 i = 0; i < tiles->size; ++i) {
+		Tile t = (*tiles)[i];
+		V2s chunk = world_position_to_level_chunk(t.world_position);
+		bool kept = (chunk.x != c->x || chunk.y != c->y);
+
+		// The tile grid is keyed by index, so refile every tile that moves down.
+		if (!kept || num_kept != i) {
+			spatial_grid_remove(&colliders->tile_grid, i, tile_grid_rectangle(t.world_position));
+		}
+		if (kept) {
+			if (num_kept != i) {
+				spatial_grid_insert(&colliders->tile_grid, num_kept, tile_grid_rectangle(t.world_position));
+			}
+			(*tiles)[num_kept++] = t;
+		}
+	}
+	tiles->size = num_kept;
+
+	s32 regions_per_chunk = LEVEL_CHUNK_SIDE / TILE_REGION_SIDE;
+	for (s32 y = 0; y < regions_per_chunk; ++y) {
+		for (s32 x = 0; x < regions_per_chunk; ++x) {
+			clear_tile_region(&colliders->tiles, (c->x * regions_per_chunk) + x, (c->y * regions_per_chunk) + y);
+		}
+	}
+
+	c->state = LEVEL_CHUNK_FREE;
+}
+
+// Called between frames. Queues loads for the chunks coming into range of the camera, adds the chunks that finished loading
+// and, if allowed, drops the chunks out of range. The editor's undo history holds tile indices, so it keeps chunks from being
+// dropped while it's open. Blocking waits for the loads it queued, for runs that have to come out the same every time.
+// Returns true if the level changed.
+bool
+update_level_stream(Level_Stream *ls, V2 camera_position, bool allow_dropping, bool block, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	if (!ls->enabled) {
+		return false;
+	}
+
+	V2s center = world_position_to_level_chunk(camera_position);
+	auto in_range = [&](s32 x, s32 y, s32 radius)
+	{
+		return abs(x - center.x) <= radius && abs(y - center.y) <= radius;
+	};
+
+	for (s32 y = center.y - LEVEL_CHUNK_LOAD_RADIUS; y <= center.y + LEVEL_CHUNK_LOAD_RADIUS; ++y) {
+		for (s32 x = center.x - LEVEL_CHUNK_LOAD_RADIUS; x <= center.x + LEVEL_CHUNK_LOAD_RADIUS; ++x) {
+			if (find_level_chunk(ls, x, y)) {
+				continue;
+			}
+			Level_Chunk *c = claim_level_chunk(ls, x, y, LEVEL_CHUNK_LOADING);
+			if (c) {
+				add_job(c, load_level_chunk_job_callback, &job_queue);
+			}
+		}
+	}
+
+	if (block) {
+		wait_for_level_chunks(ls);
+	}
+
+	bool changed = false;
+	for (Level_Chunk &c : ls->chunks) {
+		u32 state = __atomic_load_n(&c.state, __ATOMIC_ACQUIRE);
+		if (state == LEVEL_CHUNK_LOADED) {
+			if (in_range(c.x, c.y, LEVEL_CHUNK_EVICT_RADIUS)) {
+				u32 num_tiles = tiles->size;
+				add_level_chunk(&c, tiles, colliders);
+				changed |= (tiles->size != num_tiles);
+			} else {
+				// The camera moved on before it finished loading.
+				if (c.file) {
+					platform_unmap_file(c.file, c.file_size);
+				}
+				c.state = LEVEL_CHUNK_FREE;
+			}
+		} else if (state == LEVEL_CHUNK_RESIDENT && allow_dropping && !in_range(c.x, c.y, LEVEL_CHUNK_EVICT_RADIUS)) {
+			drop_level_chunk(&c, tiles, colliders);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// Loads the chunks around the camera before the first frame, so the level doesn't pop in.
+void
+start_level_stream(Level_Stream *ls, V2 camera_position, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	memset(ls->chunks, 0, sizeof(ls->chunks));
+	ls->enabled = true;
+
+	u64 start_us = platform_get_time_us();
+	update_level_stream(ls, camera_position, true, true, tiles, colliders);
+	update_tile_colliders(colliders);
+	log_print(STANDARD_LOG, "Streaming the level from %s, started with %u tiles in %.3f ms.", LEVEL_CHUNK_DIRECTORY, tiles->size, (platform_get_time_us() - start_us) / 1000.0);
+}
+
+// For when the level's tiles were replaced wholesale, by a replay's snapshot. Works out again which chunks are resident from
+// the tiles themselves. Chunks in range that the tiles don't cover get loaded as usual.
+void
+adopt_level_chunks(Level_Stream *ls, Array<Tile> *tiles)
+{
+	if (!ls->enabled) {
+		return;
+	}
+
+	wait_for_level_chunks(ls);
+	for (Level_Chunk &c : ls->chunks) {
+		if (c.state == LEVEL_CHUNK_LOADED && c.file) {
+			platform_unmap_file(c.file, c.file_size);
+		}
+		c.state = LEVEL_CHUNK_FREE;
+	}
+
+	for (Tile &t : *tiles) {
+		V2s chunk = world_position_to_level_chunk(t.world_position);
+		if (!find_level_chunk(ls, chunk.x, chunk.y)) {
+			claim_level_chunk(ls, chunk.x, chunk.y, LEVEL_CHUNK_RESIDENT);
+		}
+	}
+}
+
+// Saves every chunk that has tiles loaded to its chunk file, on a job thread like save_level(). A resident chunk with no tiles
+// left loses its file. Also how a level gets split into chunks in the first place.
+bool
+save_level_chunks(Level_Stream *ls, Array<Tile> *tiles, Collider_Store *colliders)
+{
+	static Array<V2s> chunks = make_array<V2s>(MAX_LEVEL_CHUNKS, 0);
+	chunks.size = 0;
+
+	if (!platform_make_directory(LEVEL_CHUNK_DIRECTORY) || !begin_level_save(&level_save, tiles, colliders)) {
+		return false;
+	}
+
+	for (Tile &t : *tiles) {
+		if (t.flags & HIDE_TILE_FLAG) {
+			continue;
+		}
+		V2s chunk = world_position_to_level_chunk(t.world_position);
+		bool listed = false;
+		for (V2s c : chunks) {
+			listed |= (c.x == chunk.x && c.y == chunk.y);
+		}
+		if (!listed) {
+			array_add(&chunks, chunk);
+		}
+	}
+
+	char path[256];
+	for (V2s c : chunks) {
+		level_chunk_path(c.x, c.y, path, sizeof(path));
+		V2s min = { c.x * LEVEL_CHUNK_SIDE, c.y * LEVEL_CHUNK_SIDE };
+		V2s max = { min.x + LEVEL_CHUNK_SIDE, min.y + LEVEL_CHUNK_SIDE };
+		add_level_save_file(&level_save, path, min, max);
+	}
+
+	if (ls->enabled) {
+		for (Level_Chunk &c : ls->chunks) {
+			if (c.state != LEVEL_CHUNK_RESIDENT) {
+				continue;
+			}
+			bool has_tiles = false;
+			for (V2s saved : chunks) {
+				has_tiles |= (saved.x == c.x && saved.y == c.y);
+			}
+			if (!has_tiles) {
+				level_chunk_path(c.x, c.y, path, sizeof(path));
+				add_level_save_file(&level_save, path, {}, {}, true);
+			}
+		}
+	}
+
+	queue_level_save(&level_save);
+
+	return true;
+}
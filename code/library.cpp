@@ -116,6 +116,20 @@ random_color()
 	return Color{r, g, b};
 }
 
+#define FNV1A_64_OFFSET_BASIS 0xCBF29CE484222325ull
+
+// FNV-1a. Chain calls by passing the previous result as the hash.
+u64
+hash_bytes(const void *data, size_t n, u64 hash = FNV1A_64_OFFSET_BASIS)
+{
+	const u8 *bytes = (const u8 *)data;
+	for (size_t i = 0; i < n; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
 void
 timer_set(u32 wait_time, Timer *t)
 {
@@ -184,7 +198,7 @@ make_array(size_t initial_capacity, size_t initial_size)
 
 	Array<T> a;
 	a.data = (T *)malloc(sizeof(T) * initial_capacity);
-	if (initialize_to_zero)
+	if constexpr (initialize_to_zero)
 		memset(a.data, 0, initial_capacity * sizeof(T));
 	a.capacity = initial_capacity;
 	a.size = initial_size;
@@ -224,11 +238,12 @@ template<typename T>
 void
 array_add(Array<T> *a, T e)
 {
-	a->data[a->size++] = e;
-
 	if (a->size >= a->capacity) {
-		a->data = (T *)realloc(a->data, sizeof(T) * ((a->capacity * 2) + 1));
+		a->capacity = (a->capacity * 2) + 1;
+		a->data = (T *)realloc(a->data, sizeof(T) * a->capacity);
 	}
+
+	a->data[a->size++] = e;
 }
 
 template<typename T>
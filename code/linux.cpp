@@ -1,11 +1,14 @@
-#include <X11/X.h>
+// The headless build only needs the key symbol values, everything that talks to X, GLX or ALSA is compiled out.
 #include <X11/keysym.h>
+#ifndef HEADLESS
+#include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 
 #define ALSA_PCM_NEW_HW_PARAMS_API
 #include <alsa/asoundlib.h>
+#endif
 
 #include <sys/stat.h>
 #include <unistd.h>
@@ -14,6 +17,8 @@
 #include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <errno.h>
+#include <string.h>
 
 #define EXIT_FAILURE 1
 #define EXIT_SUCCESS 0
@@ -21,6 +26,7 @@
 enum Key_Symbol : int {
 	W_KEY = XK_w,
 	A_KEY = XK_a,
+	B_KEY = XK_b,
 	S_KEY = XK_s,
 	D_KEY = XK_d,
 	E_KEY = XK_e,
@@ -39,10 +45,13 @@ enum Key_Symbol : int {
 	Z_KEY = XK_z,
 	BACKSPACE_KEY = XK_BackSpace,
 	LCTRL_KEY = XK_Control_L,
+	LSHIFT_KEY = XK_Shift_L,
 	RCTRL_KEY = XK_Control_R,
 	LALT_KEY = XK_Alt_L,
 	RALT_KEY = XK_Alt_R,
 	ESCAPE_KEY = XK_Escape,
+	F9_KEY = XK_F9,
+	F10_KEY = XK_F10,
 };
 
 enum Mouse_Button : int {
@@ -70,6 +79,7 @@ enum File_Seek_Relative {
 //typedef uint64_t File_Offset;
 //File_Offset FILE_OFFSET_ERROR = (File_Offset)-1;
 
+#ifndef HEADLESS
 // @TODO: Store colormap and free it on exit.
 struct Linux_Context {
 	Display *  display = NULL;
@@ -81,6 +91,7 @@ struct Linux_Context {
 
 #define GLX_CONTEXT_MAJOR_VERSION_ARB 0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB 0x2092
+#endif
 
 u32  window_pixel_width          =  0;
 u32  window_pixel_height         =  0;
@@ -93,6 +104,7 @@ f32  scaled_meters_per_pixel     =  0;
 void platform_exit(int exit_code);
 bool platform_write_file(File_Handle fh, size_t n, const void *buf);
 
+#ifndef HEADLESS
 static bool x11_error_occured = false;
 
 static int
@@ -131,11 +143,15 @@ is_ext_supported(const char *ext_list, const char *ext)
 	return false;
 }
 
+#endif
+
 void render_init();
+void render_make_sprite_texture_array();
 void render_cleanup();
 void init_assets();
 void assets_load_all();
 void debug_init();
+void sound_init();
 
 u32
 u32_min(u32 a, u32 b)
@@ -143,6 +159,7 @@ u32_min(u32 a, u32 b)
 	return a < b ? a : b;
 }
 
+#ifndef HEADLESS
 int context_attribs[] = {
 	GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
 	GLX_CONTEXT_MINOR_VERSION_ARB, 2,
@@ -170,6 +187,7 @@ platform_make_job_thread_opengl_context()
 
 	return gl_thread_context;
 }
+#endif
 
 void *job_thread_start(void *job_thread_data);
 
@@ -179,6 +197,7 @@ void platform_toggle_fullscreen();
 
 void *get_job_queue();
 
+#ifndef HEADLESS
 int
 main(int, char **)
 {
@@ -382,8 +401,11 @@ main(int, char **)
 
 	init_assets();
 
+	render_make_sprite_texture_array();
+
 	debug_init();
 
+	sound_init();
 
 	////////////////////
 	application_entry();
@@ -491,6 +513,24 @@ platform_keycode_to_keysym(unsigned keycode, int level)
 
 	return (Key_Symbol)keysym;
 }
+#else
+// There's no X server to ask in the headless build, so every key gets a fixed scancode. The key symbols we use are all
+// distinct in their low byte.
+inline unsigned
+platform_keysym_to_scancode(Key_Symbol ks)
+{
+	unsigned sc = ks & 0xFF;
+	assert(sc > 0);
+	return sc;
+}
+
+void
+platform_exit(int exit_code)
+{
+	fflush(stdout);
+	_exit(exit_code);
+}
+#endif
 
 void
 platform_press_button(IO_Button *b)
@@ -511,6 +551,7 @@ platform_release_button(IO_Button *b)
 
 void _memset(void *destination, int set_to, size_t count);
 
+#ifndef HEADLESS
 void
 platform_update_mouse_position(Mouse *m)
 {
@@ -637,6 +678,7 @@ platform_swap_buffers()
 {
 	glXSwapBuffers(linux_context.display, linux_context.window);
 }
+#endif
 
 void
 platform_debug_print(size_t nbytes, const char* buf)
@@ -761,12 +803,126 @@ platform_free_memory(void *m, size_t len)
 		_abort("Failed to free memory from platform - %s.", strerror(errno));
 }
 
+bool
+platform_is_directory(const char *path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool
+platform_make_directory(const char *path)
+{
+	if (mkdir(path, 0777) == -1 && errno != EEXIST) {
+		log_print(MAJOR_ERROR_LOG, "Could not make directory %s -- %s.", path, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Blocks until the file's data is on the disk.
+bool
+platform_sync_file(File_Handle fh)
+{
+	if (fsync(fh) == -1) {
+		log_print(MAJOR_ERROR_LOG, "Could not sync file -- %s.", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Replaces anything already at the new path in one step.
+bool
+platform_rename_file(const char *old_path, const char *new_path)
+{
+	if (rename(old_path, new_path) == -1) {
+		log_print(MAJOR_ERROR_LOG, "Could not rename %s to %s -- %s.", old_path, new_path, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Syncs the directory the path is in, so a rename or remove in it is on the disk too.
+bool
+platform_sync_directory_of(const char *path)
+{
+	char directory[256] = ".";
+	const char *slash = strrchr(path, '/');
+	if (slash) {
+		snprintf(directory, sizeof(directory), "%.*s", (int)(slash - path), path);
+	}
+
+	File_Handle fh = open(directory, O_RDONLY | O_DIRECTORY);
+	if (fh < 0) {
+		log_print(MAJOR_ERROR_LOG, "Could not open directory %s -- %s.", directory, strerror(errno));
+		return false;
+	}
+	bool ok = platform_sync_file(fh);
+	close(fh);
+	return ok;
+}
+
+// Not having been there to begin with counts as removed.
+bool
+platform_remove_file(const char *path)
+{
+	if (unlink(path) == -1 && errno != ENOENT) {
+		log_print(MAJOR_ERROR_LOG, "Could not remove file %s -- %s.", path, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Maps the whole file read only. Returns NULL if it can't be opened or is empty.
+const char *
+platform_map_file(const char *path, size_t *size)
+{
+	File_Handle fh = open(path, O_RDONLY);
+	if (fh < 0) {
+		return NULL;
+	}
+	DEFER(close(fh));
+
+	struct stat st;
+	if (fstat(fh, &st) != 0 || st.st_size == 0) {
+		return NULL;
+	}
+
+	void *m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fh, 0);
+	if (m == MAP_FAILED) {
+		log_print(MAJOR_ERROR_LOG, "Could not map file %s -- %s.", path, strerror(errno));
+		return NULL;
+	}
+	*size = st.st_size;
+	return (const char *)m;
+}
+
+void
+platform_unmap_file(const char *m, size_t size)
+{
+	if (munmap((void *)m, size) == -1) {
+		log_print(MINOR_ERROR_LOG, "Could not unmap file -- %s.", strerror(errno));
+	}
+}
+
 size_t
 platform_get_page_size()
 {
 	return sysconf(_SC_PAGESIZE);
 }
 
+// Lets the kernel drop the pages of a mapping that lie wholly inside the range. They're read back in if touched again.
+void
+platform_release_mapped_pages(const char *m, size_t offset, size_t size)
+{
+	size_t page_size = platform_get_page_size();
+	size_t start     = (offset + page_size - 1) & ~(page_size - 1);
+	size_t end       = (offset + size) & ~(page_size - 1);
+	if (end > start && madvise((void *)(m + start), end - start, MADV_DONTNEED) == -1) {
+		log_print(MINOR_ERROR_LOG, "Could not release mapped pages -- %s.", strerror(errno));
+	}
+}
+
 inline Time_Spec
 platform_get_time()
 {
@@ -840,6 +996,8 @@ platform_sleep(u32 milliseconds)
 
 #define READ_AND_ADVANCE_STREAM(type, stream) *((type *)stream); stream += sizeof(type);
 
+#ifndef HEADLESS
+
 struct Pcm_Playback_Info {
 	u16 num_channels;
 	u32 sample_rate;
@@ -847,147 +1005,203 @@ struct Pcm_Playback_Info {
 	u32 bytes_per_frame;
 	u32 bytes_per_period;
 	snd_pcm_uframes_t frames_per_period;
-	struct pollfd fd;
+	snd_pcm_uframes_t frames_per_buffer;
+	bool mmap; // Whether the mixer writes straight into the device's buffer, or into a period that's copied over.
+
+	// Updated by the mixer thread as it writes, for the debug overlay.
+	volatile u32 latency_frames; // How long the last period written has to wait before it's heard.
+	volatile u32 num_underruns;
 } pcm_playback_info;
 
-void
-platform_pcm_open_device()
+// Only touched by the mixer thread once the device is open.
+struct Pcm_Write {
+	s16 *             period; // For devices that can't be mapped.
+	snd_pcm_uframes_t offset; // Where the frames being mixed start in the device's buffer.
+} pcm_write;
+
+// Periods are as short as the mixer can keep up with, since sounds start a period or so from when they're played. Returns
+// false if there's no device to play on, the game runs without sound then.
+bool
+platform_pcm_open_device(u32 frames_per_period, u32 periods_per_buffer)
 {
 	snd_pcm_hw_params_t *pcm_parameters;
+	snd_pcm_sw_params_t *pcm_software_parameters;
 	s32                  dir;
 	s32                  return_code;
 
 	return_code = snd_pcm_open(&linux_context.pcm_handle, "default", SND_PCM_STREAM_PLAYBACK, 0);
 	if (return_code < 0) {
-		_abort("Unable to open pcm device: %s.", snd_strerror(return_code));
+		log_print(MAJOR_ERROR_LOG, "Unable to open pcm device: %s.", snd_strerror(return_code));
+		return false;
 	}
 
-	pcm_playback_info.num_channels = 2;
-	pcm_playback_info.sample_rate = 44100;
+	// Ask for the format the sounds are packed in, so they play without being converted.
+	pcm_playback_info.num_channels = PACKED_SOUND_NUM_CHANNELS;
+	pcm_playback_info.sample_rate = PACKED_SOUND_SAMPLE_RATE;
 	pcm_playback_info.bits_per_sample = 16;
 	pcm_playback_info.bytes_per_frame = pcm_playback_info.num_channels * (pcm_playback_info.bits_per_sample / 8);
 
 	snd_pcm_hw_params_alloca(&pcm_parameters);
 	snd_pcm_hw_params_any(linux_context.pcm_handle, pcm_parameters);
-	snd_pcm_hw_params_set_access(linux_context.pcm_handle, pcm_parameters, SND_PCM_ACCESS_RW_INTERLEAVED);
+
+	// Mapping the device's buffer saves copying every period into it, but not every device can be mapped.
+	pcm_playback_info.mmap = (snd_pcm_hw_params_set_access(linux_context.pcm_handle, pcm_parameters, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0);
+	if (!pcm_playback_info.mmap) {
+		snd_pcm_hw_params_set_access(linux_context.pcm_handle, pcm_parameters, SND_PCM_ACCESS_RW_INTERLEAVED);
+	}
 	snd_pcm_hw_params_set_format(linux_context.pcm_handle, pcm_parameters, SND_PCM_FORMAT_S16_LE);
 	snd_pcm_hw_params_set_channels(linux_context.pcm_handle, pcm_parameters, pcm_playback_info.num_channels);
 	snd_pcm_hw_params_set_rate_near(linux_context.pcm_handle, pcm_parameters, &pcm_playback_info.sample_rate, &dir);
 
-	pcm_playback_info.frames_per_period = 8192;
+	pcm_playback_info.frames_per_period = frames_per_period;
 	snd_pcm_hw_params_set_period_size_near(linux_context.pcm_handle, pcm_parameters, &pcm_playback_info.frames_per_period, &dir);
 
-	snd_pcm_uframes_t frames_per_buffer = pcm_playback_info.frames_per_period * 2;
-	snd_pcm_hw_params_set_buffer_size(linux_context.pcm_handle, pcm_parameters, frames_per_buffer);
+	pcm_playback_info.frames_per_buffer = pcm_playback_info.frames_per_period * periods_per_buffer;
+	snd_pcm_hw_params_set_buffer_size_near(linux_context.pcm_handle, pcm_parameters, &pcm_playback_info.frames_per_buffer);
 
 	return_code = snd_pcm_hw_params(linux_context.pcm_handle, pcm_parameters);
 	if (return_code < 0) {
-		_abort("Unable to set sound hardware parameters: %s\n", snd_strerror(return_code));
+		log_print(MAJOR_ERROR_LOG, "Unable to set sound hardware parameters: %s.", snd_strerror(return_code));
+		snd_pcm_close(linux_context.pcm_handle);
+		return false;
 	}
 
 	snd_pcm_hw_params_get_period_size(pcm_parameters, &pcm_playback_info.frames_per_period, &dir);
-	snd_pcm_hw_params_get_period_time(pcm_parameters, &pcm_playback_info.sample_rate, &dir);
+	snd_pcm_hw_params_get_buffer_size(pcm_parameters, &pcm_playback_info.frames_per_buffer);
+	snd_pcm_hw_params_get_rate(pcm_parameters, &pcm_playback_info.sample_rate, &dir);
 
 	pcm_playback_info.bytes_per_period = pcm_playback_info.frames_per_period * pcm_playback_info.bytes_per_frame;
 
-	if(snd_pcm_poll_descriptors(linux_context.pcm_handle, &pcm_playback_info.fd, 1) < 0) {
-		_abort("Error getting file descriptor for PCM.");
+	// Starts playing once the buffer is full, and wakes the mixer whenever there's room for another period.
+	snd_pcm_sw_params_alloca(&pcm_software_parameters);
+	snd_pcm_sw_params_current(linux_context.pcm_handle, pcm_software_parameters);
+	snd_pcm_sw_params_set_start_threshold(linux_context.pcm_handle, pcm_software_parameters, pcm_playback_info.frames_per_buffer - (pcm_playback_info.frames_per_buffer % pcm_playback_info.frames_per_period));
+	snd_pcm_sw_params_set_avail_min(linux_context.pcm_handle, pcm_software_parameters, pcm_playback_info.frames_per_period);
+	return_code = snd_pcm_sw_params(linux_context.pcm_handle, pcm_software_parameters);
+	if (return_code < 0) {
+		log_print(MINOR_ERROR_LOG, "Unable to set sound software parameters: %s.", snd_strerror(return_code));
 	}
-}
 
-u8
-platform_pcm_less_than_one_period_left_in_buffer()
-{
-	s32 return_code = poll(&pcm_playback_info.fd, 1, 0);
-	if (return_code == -1) {
-		log_print(MINOR_ERROR_LOG, "Error polling PCM file descriptor -- %s.", strerror(errno));
+	if (!pcm_playback_info.mmap) {
+		pcm_write.period = (s16 *)malloc(pcm_playback_info.bytes_per_period);
 	}
 
-	return return_code ? true : false;
+	log_print(STANDARD_LOG, "Opened the pcm device at %u Hz with %lu frame periods in a %lu frame buffer, %s.", pcm_playback_info.sample_rate, pcm_playback_info.frames_per_period, pcm_playback_info.frames_per_buffer, pcm_playback_info.mmap ? "mapped" : "not mapped");
+
+	return true;
 }
 
-s32
-platform_pcm_write_period(s16 *period_buffer)
+// Gets the device going again after an underrun, or after the system was suspended. Returns false on any other error.
+bool
+pcm_recover(s32 error)
 {
-	s32 frames_written_this_call = snd_pcm_writei(linux_context.pcm_handle, period_buffer, pcm_playback_info.frames_per_period);
-	if (frames_written_this_call == -EPIPE) {
-		log_print(MINOR_ERROR_LOG, "PCM underrun occurred.\n");
-		snd_pcm_prepare(linux_context.pcm_handle);
-		return -1;
-	} else if (frames_written_this_call < 0) {
-		log_print(MINOR_ERROR_LOG, "Error from snd_pcm_writei: %s.\n", snd_strerror(frames_written_this_call));
-		return -1;
+	if (error == -EPIPE) {
+		__atomic_add_fetch(&pcm_playback_info.num_underruns, 1, __ATOMIC_RELAXED);
 	}
-
-	if ((u32)frames_written_this_call != pcm_playback_info.frames_per_period) {
-		log_print(MINOR_ERROR_LOG, "PCM short write, wrote %d frames and expected %d.\n", frames_written_this_call, (s32)pcm_playback_info.frames_per_period);
+	if (error == -EINTR || error == -EAGAIN) {
+		return true;
 	}
 
-	return frames_written_this_call;
-
-		//wav_file += frames_written_this_call * bytes_per_frame;
-		//frames_written += frames_written_this_call;
-#if 0
-	auto ma = mem_make_arena();
-	String wav_file_string = read_entire_file("../data/sounds/speech.wav", &ma);
-	const char *wav_file = wav_file_string.data;
-
-	wav_file += 4;
+	s32 return_code = snd_pcm_recover(linux_context.pcm_handle, error, 1);
+	if (return_code < 0) {
+		log_print(MINOR_ERROR_LOG, "Could not recover the pcm device: %s.", snd_strerror(return_code));
+		return false;
+	}
+	return true;
+}
 
-	u32 wav_file_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
+// Blocks until the device has room for a period, then returns where to put its frames. When the device's buffer is mapped
+// that's straight in the buffer, and there can be fewer than a period's frames of room before it wraps around. Returns NULL
+// on an error other than an underrun.
+s16 *
+platform_pcm_begin_period(u32 *num_frames)
+{
+	if (!pcm_playback_info.mmap) {
+		*num_frames = pcm_playback_info.frames_per_period;
+		return pcm_write.period;
+	}
 
-	wav_file += 8;
+	while (true) {
+		snd_pcm_sframes_t frames_available = snd_pcm_avail_update(linux_context.pcm_handle);
+		if (frames_available < 0) {
+			if (!pcm_recover(frames_available)) {
+				return NULL;
+			}
+			continue;
+		}
 
-	u32 format_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u16 format_type        = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u16 num_channels       = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u32 sample_rate        = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u32 bytes_per_second   = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u16 bytes_per_frame    = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u16 bits_per_sample    = READ_AND_ADVANCE_STREAM(u16, wav_file);
+		if ((snd_pcm_uframes_t)frames_available < pcm_playback_info.frames_per_period) {
+			// Committing mapped frames doesn't start the device the way writing them does, so start it once the buffer is full.
+			if (snd_pcm_state(linux_context.pcm_handle) == SND_PCM_STATE_PREPARED) {
+				s32 return_code = snd_pcm_start(linux_context.pcm_handle);
+				if (return_code < 0 && !pcm_recover(return_code)) {
+					return NULL;
+				}
+				continue;
+			}
 
-	char chunk_name[5] = {};
-	strncpy(chunk_name, wav_file, 4);
+			s32 return_code = snd_pcm_wait(linux_context.pcm_handle, 1000);
+			if (return_code < 0 && !pcm_recover(return_code)) {
+				return NULL;
+			}
+			continue;
+		}
 
-	while (strcmp(chunk_name, "data") != 0) {
-		wav_file += 4;
-		u32 chunk_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
-		wav_file += chunk_data_length;
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t             frames = pcm_playback_info.frames_per_period;
+		s32 return_code = snd_pcm_mmap_begin(linux_context.pcm_handle, &areas, &pcm_write.offset, &frames);
+		if (return_code < 0) {
+			if (!pcm_recover(return_code)) {
+				return NULL;
+			}
+			continue;
+		}
 
-		strncpy(chunk_name, wav_file, 4);
+		// Interleaved, so every channel's area is the same buffer offset by the channel.
+		*num_frames = frames;
+		return (s16 *)((char *)areas[0].addr + (areas[0].first / 8) + (pcm_write.offset * (areas[0].step / 8)));
 	}
+}
 
-	wav_file += 4;
-
-	u32 sample_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
-
-	printf("%u\n%u\n%u\n%u\n%u\n%u\n%u\n%u\n", format_data_length, format_type, num_channels, sample_rate, bytes_per_second, bytes_per_frame, bits_per_sample, sample_data_length); 
-
-	s32 total_frames   = sample_data_length / bytes_per_frame;
-	s32 frames_written = 0;
-
-	while (frames_written < total_frames) {
-		s32 frames_written_this_call = snd_pcm_writei(linux_context.pcm_handle, wav_file, pcm_playback_info.frames_per_period);
-		if (frames_written_this_call == -EPIPE) {
-			log_print(MINOR_ERROR_LOG, "PCM underrun occurred.\n");
-			snd_pcm_prepare(linux_context.pcm_handle);
-			// @TODO: Exit early?
-		} else if (frames_written_this_call < 0) {
-			log_print(MINOR_ERROR_LOG, "Error from snd_pcm_writei: %s.\n", snd_strerror(frames_written_this_call));
-			// @TODO: Exit early?
-		} else {
-			if (frames_written_this_call != (s32)pcm_playback_info.frames_per_period) {
-				log_print(MINOR_ERROR_LOG, "PCM short write, wrote %d frames and expected %d.\n", frames_written_this_call, (s32)pcm_playback_info.frames_per_period);
+// Hands the frames from platform_pcm_begin_period() to the device. Returns the number of frames written, or -1 on an error
+// other than an underrun.
+s32
+platform_pcm_end_period(u32 num_frames)
+{
+	if (pcm_playback_info.mmap) {
+		snd_pcm_sframes_t frames_committed = snd_pcm_mmap_commit(linux_context.pcm_handle, pcm_write.offset, num_frames);
+		if (frames_committed < 0 || (u32)frames_committed != num_frames) {
+			if (!pcm_recover((frames_committed < 0) ? frames_committed : -EPIPE)) {
+				return -1;
+			}
+			return 0;
+		}
+	} else {
+		s16 *samples     = pcm_write.period;
+		s32  frames_left = num_frames;
+
+		while (frames_left > 0) {
+			s32 frames_written_this_call = snd_pcm_writei(linux_context.pcm_handle, samples, frames_left);
+			if (frames_written_this_call < 0) {
+				if (!pcm_recover(frames_written_this_call)) {
+					log_print(MINOR_ERROR_LOG, "Error from snd_pcm_writei: %s.", snd_strerror(frames_written_this_call));
+					return -1;
+				}
+				continue;
 			}
 
-			wav_file += frames_written_this_call * bytes_per_frame;
-			frames_written += frames_written_this_call;
+			samples     += frames_written_this_call * pcm_playback_info.num_channels;
+			frames_left -= frames_written_this_call;
 		}
 	}
 
-	snd_pcm_drain(linux_context.pcm_handle);
-	snd_pcm_close(linux_context.pcm_handle);
-#endif
+	// Everything queued in front of the frames just written, which is how long a sound started now takes to be heard.
+	snd_pcm_sframes_t delay = 0;
+	if (snd_pcm_delay(linux_context.pcm_handle, &delay) == 0 && delay >= 0) {
+		__atomic_store_n(&pcm_playback_info.latency_frames, (u32)delay, __ATOMIC_RELAXED);
+	}
+
+	return num_frames;
 }
 
 void
@@ -996,6 +1210,7 @@ platform_pcm_close_device()
 	snd_pcm_drain(linux_context.pcm_handle);
 	snd_pcm_close(linux_context.pcm_handle);
 }
+#endif
 
 Thread_Handle
 platform_create_thread(Thread_Procedure tp, void *thread_argument)
@@ -1041,6 +1256,7 @@ platform_get_semaphore_value(sem_t *s)
 	return v;
 }
 
+#ifndef HEADLESS
 void
 platform_toggle_fullscreen()
 {
@@ -1059,4 +1275,4 @@ platform_toggle_fullscreen()
 
 	XSendEvent(linux_context.display, DefaultRootWindow(linux_context.display), False, SubstructureRedirectMask | SubstructureNotifyMask, &e);
 }
-
+#endif
@@ -24,15 +24,17 @@ clamp(f32 it, f32 min, f32 max)
 f32
 inv_sqrt(f32 number)
 {
-	long i;
+	// Has to be 32 bits. A long here read four bytes of stack along with the float, which made results depend on whatever
+	// was left there and broke replays.
+	s32 i;
 	f32 x2, y;
 	const f32 threehalfs = 1.5F;
 
 	x2 = number * 0.5F;
 	y  = number;
-	i  = * ( long * ) &y;
+	memcpy(&i, &y, sizeof(i));
 	i  = 0x5f3759df - ( i >> 1 );
-	y  = * ( float * ) &i;
+	memcpy(&y, &i, sizeof(y));
 	y  = y * ( threehalfs - ( x2 * y * y ) );
 
 	return y;
@@ -194,6 +196,18 @@ round_to_nearest(V2 v, f32 factor)
 	return v;
 }
 
+f32
+lerp(f32 a, f32 b, f32 t)
+{
+	return a + t * (b - a);
+}
+
+V2
+lerp(V2 a, V2 b, f32 t)
+{
+	return { lerp(a.x, b.x, t), lerp(a.y, b.y, t) };
+}
+
 V2
 round_to_nearest_pixel(V2 p)
 {
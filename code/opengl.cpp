@@ -10,20 +10,214 @@ typedef void (APIENTRY *DEBUGPROC)(GLenum source,
 #include "opengl_functions.h"
 #undef DEFINEPROC
 
-struct Render_Command {
-	GLuint vao;
-	GLuint vbo;
-	GLuint ebo;
-	GLuint texture_id;
+#define GL_STATE_UNKNOWN           0xFFFFFFFF
+#define MAX_TRACKED_TEXTURE_UNITS  4
+
+enum Gl_Texture_Target {
+	GL_STATE_TEXTURE_2D,
+	GL_STATE_TEXTURE_2D_ARRAY,
+	NUM_GL_STATE_TEXTURE_TARGETS
+};
+
+// Mirror of the bits of driver state the renderers touch every frame, so binds that wouldn't change anything never reach the
+// driver. Anything that changes this state has to go through the gl_* wrappers below, or call gl_state_reset afterwards.
+// Every thread has its own context, so every thread gets its own copy. The zeroed copy matches the bindings of a new context.
+struct Gl_State {
+	GLuint program;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint element_array_buffer;
+	GLuint active_texture_unit;
+	GLuint textures[MAX_TRACKED_TEXTURE_UNITS][NUM_GL_STATE_TEXTURE_TARGETS];
+	GLuint blend_enabled;
+	GLenum blend_source_factor;
+	GLenum blend_destination_factor;
+
+#ifdef DEBUG
+	u32 num_calls_issued;
+	u32 num_calls_elided;
+	u32 last_frame_num_calls_issued;
+	u32 last_frame_num_calls_elided;
+#endif
+};
+
+thread_local Gl_State gl_state;
+
+void
+gl_state_reset()
+{
+	gl_state.program                  = GL_STATE_UNKNOWN;
+	gl_state.vertex_array             = GL_STATE_UNKNOWN;
+	gl_state.array_buffer             = GL_STATE_UNKNOWN;
+	gl_state.element_array_buffer     = GL_STATE_UNKNOWN;
+	gl_state.active_texture_unit      = GL_STATE_UNKNOWN;
+	gl_state.blend_enabled            = GL_STATE_UNKNOWN;
+	gl_state.blend_source_factor      = GL_STATE_UNKNOWN;
+	gl_state.blend_destination_factor = GL_STATE_UNKNOWN;
+	for (u32 i = 0; i < MAX_TRACKED_TEXTURE_UNITS; ++i) {
+		for (u32 j = 0; j < NUM_GL_STATE_TEXTURE_TARGETS; ++j) {
+			gl_state.textures[i][j] = GL_STATE_UNKNOWN;
+		}
+	}
+}
+
+// Returns true if the call has to be issued.
+bool
+gl_state_update(GLuint *cached, GLuint value)
+{
+	if (*cached == value) {
+#ifdef DEBUG
+		gl_state.num_calls_elided += 1;
+#endif
+		return false;
+	}
+
+	*cached = value;
+#ifdef DEBUG
+	gl_state.num_calls_issued += 1;
+#endif
+	return true;
+}
+
+void
+gl_state_end_frame()
+{
+#ifdef DEBUG
+	gl_state.last_frame_num_calls_issued = gl_state.num_calls_issued;
+	gl_state.last_frame_num_calls_elided = gl_state.num_calls_elided;
+	gl_state.num_calls_issued = gl_state.num_calls_elided = 0;
+#endif
+}
+
+void
+gl_use_program(GLuint program)
+{
+	if (gl_state_update(&gl_state.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void
+gl_bind_vertex_array(GLuint vao)
+{
+	if (gl_state_update(&gl_state.vertex_array, vao)) {
+		glBindVertexArray(vao);
+		// The element buffer binding is part of the vertex array.
+		gl_state.element_array_buffer = GL_STATE_UNKNOWN;
+	}
+}
+
+void
+gl_bind_buffer(GLenum target, GLuint buffer)
+{
+	GLuint *cached = NULL;
+	if (target == GL_ARRAY_BUFFER) {
+		cached = &gl_state.array_buffer;
+	} else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+		cached = &gl_state.element_array_buffer;
+	}
+
+	if (!cached || gl_state_update(cached, buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void
+gl_active_texture(GLenum unit)
+{
+	assert(unit >= GL_TEXTURE0 && unit < GL_TEXTURE0 + MAX_TRACKED_TEXTURE_UNITS);
+
+	if (gl_state_update(&gl_state.active_texture_unit, unit - GL_TEXTURE0)) {
+		glActiveTexture(unit);
+	}
+}
+
+// Binds to whatever unit was last made active with gl_active_texture.
+void
+gl_bind_texture(GLenum target, GLuint texture)
+{
+	assert(gl_state.active_texture_unit < MAX_TRACKED_TEXTURE_UNITS);
+
+	Gl_Texture_Target t;
+	if (target == GL_TEXTURE_2D) {
+		t = GL_STATE_TEXTURE_2D;
+	} else {
+		assert(target == GL_TEXTURE_2D_ARRAY);
+		t = GL_STATE_TEXTURE_2D_ARRAY;
+	}
+
+	if (gl_state_update(&gl_state.textures[gl_state.active_texture_unit][t], texture)) {
+		glBindTexture(target, texture);
+	}
+}
+
+void
+gl_set_blend(bool enabled, GLenum source_factor = GL_SRC_ALPHA, GLenum destination_factor = GL_ONE_MINUS_SRC_ALPHA)
+{
+	if (gl_state_update(&gl_state.blend_enabled, enabled)) {
+		if (enabled) {
+			glEnable(GL_BLEND);
+		} else {
+			glDisable(GL_BLEND);
+		}
+	}
+
+	if (!enabled) {
+		return;
+	}
+
+	bool source_changed      = gl_state_update(&gl_state.blend_source_factor, source_factor);
+	bool destination_changed = gl_state_update(&gl_state.blend_destination_factor, destination_factor);
+	if (source_changed || destination_changed) {
+		glBlendFunc(source_factor, destination_factor);
+	}
+}
+
+#define MAX_SHADER_UNIFORMS             32
+#define MAX_SHADER_VARIABLE_NAME_LENGTH 64
+#define MAX_SHADER_UNIFORM_VALUE_SIZE   sizeof(M4)
+
+#define NO_SHADER_UNIFORM -1
+
+struct Shader_Variable {
+	char   name[MAX_SHADER_VARIABLE_NAME_LENGTH];
+	GLint  location;
+	GLenum type;
+	GLint  count;
 };
 
-struct Vertex {
-	V3 position;
-	V2 uv;
+struct Shader_Uniform {
+	Shader_Variable variable;
+
+	// The last value sent to the driver. Uniform values belong to the program, so this stays valid across program switches.
+	bool has_value;
+	u8   value[MAX_SHADER_UNIFORM_VALUE_SIZE];
+};
+
+// A linked program plus everything the driver told us about its active uniforms. Look up the uniforms once with
+// shader_find_uniform and keep the index. The setters skip the driver call if the uniform already holds the value.
+struct Shader_Program {
+	GLuint         id;
+	u32            num_uniforms;
+	Shader_Uniform uniforms[MAX_SHADER_UNIFORMS];
+};
+
+// One instance of the sprite quad. The vertex shader expands it into a triangle strip and samples the sprite texture array
+// layer given here, so every sprite in the scene goes out in one instanced draw no matter which sheet it came from.
+struct Render_Command {
+	V2        position;
+	V2        size;
+	Rectangle texture_scissor;
+	f32       texture_layer;
 };
 
 Array<Render_Command> render_commands = make_array<Render_Command>(1000, 0);
-GLuint shader;
+GLuint sprite_vao;
+GLuint sprite_instance_vbo;
+GLuint sprite_texture_array;
+Shader_Program shader;
+s32 sprite_projection_uniform;
+s32 sprite_texture_uniform;
 M4 orthographic_projection;
 bool is_opengl_initialized = false;
 
@@ -84,20 +278,151 @@ make_shader(String vert_source, String frag_source)
 	return program;
 }
 
+// Array uniforms are reported as "name[0]".
+void
+strip_shader_variable_array_suffix(char *name, GLsizei name_length)
+{
+	if (name_length > 3 && strcmp(name + name_length - 3, "[0]") == 0) {
+		name[name_length - 3] = '\0';
+	}
+}
+
+Shader_Program
+make_shader_program(String vert_source, String frag_source)
+{
+	Shader_Program p = {};
+	p.id = make_shader(vert_source, frag_source);
+
+	GLint num_active_uniforms = 0;
+	glGetProgramiv(p.id, GL_ACTIVE_UNIFORMS, &num_active_uniforms);
+	if (num_active_uniforms > MAX_SHADER_UNIFORMS) {
+		_abort("Shader program has %d active uniforms, but the max is %d.", num_active_uniforms, MAX_SHADER_UNIFORMS);
+	}
+
+	for (GLint i = 0; i < num_active_uniforms; ++i) {
+		Shader_Variable *v = &p.uniforms[p.num_uniforms].variable;
+		GLsizei name_length = 0;
+		glGetActiveUniform(p.id, i, sizeof(v->name), &name_length, &v->count, &v->type, v->name);
+		strip_shader_variable_array_suffix(v->name, name_length);
+
+		// Uniform block members don't have a location.
+		v->location = glGetUniformLocation(p.id, v->name);
+		if (v->location == -1) {
+			continue;
+		}
+
+		p.uniforms[p.num_uniforms].has_value = false;
+		p.num_uniforms += 1;
+	}
+
+	return p;
+}
+
+// Returns NO_SHADER_UNIFORM if the program doesn't use the uniform (the compiler may have optimized it out), in which case
+// the setters do nothing.
+s32
+shader_find_uniform(Shader_Program *p, const char *name)
+{
+	for (u32 i = 0; i < p->num_uniforms; ++i) {
+		if (strcmp(p->uniforms[i].variable.name, name) == 0) {
+			return i;
+		}
+	}
+
+	log_print(MINOR_ERROR_LOG, "Shader program %u has no active uniform named %s.", p->id, name);
+
+	return NO_SHADER_UNIFORM;
+}
+
+void
+use_shader_program(Shader_Program *p)
+{
+	gl_use_program(p->id);
+}
+
+// Returns true if the uniform needs to be sent to the driver. The program has to be in use at that point.
+bool
+shader_update_cached_uniform(Shader_Program *p, s32 uniform, const void *value, size_t value_size)
+{
+	if (uniform == NO_SHADER_UNIFORM) {
+		return false;
+	}
+
+	assert(uniform >= 0 && (u32)uniform < p->num_uniforms);
+	assert(value_size <= MAX_SHADER_UNIFORM_VALUE_SIZE);
+
+	Shader_Uniform *u = &p->uniforms[uniform];
+	if (u->has_value && memcmp(u->value, value, value_size) == 0) {
+		return false;
+	}
+
+	assert(gl_state.program == p->id);
+
+	memcpy(u->value, value, value_size);
+	u->has_value = true;
+
+	return true;
+}
+
+// Samplers and bools are set as ints.
+void
+shader_set_uniform(Shader_Program *p, s32 uniform, s32 value)
+{
+	if (shader_update_cached_uniform(p, uniform, &value, sizeof(value))) {
+		glUniform1i(p->uniforms[uniform].variable.location, value);
+	}
+}
+
+void
+shader_set_uniform(Shader_Program *p, s32 uniform, f32 value)
+{
+	if (shader_update_cached_uniform(p, uniform, &value, sizeof(value))) {
+		assert(p->uniforms[uniform].variable.type == GL_FLOAT);
+		glUniform1f(p->uniforms[uniform].variable.location, value);
+	}
+}
+
+void
+shader_set_uniform(Shader_Program *p, s32 uniform, V2 value)
+{
+	if (shader_update_cached_uniform(p, uniform, &value, sizeof(value))) {
+		assert(p->uniforms[uniform].variable.type == GL_FLOAT_VEC2);
+		glUniform2f(p->uniforms[uniform].variable.location, value.x, value.y);
+	}
+}
+
+void
+shader_set_uniform(Shader_Program *p, s32 uniform, V3 value)
+{
+	if (shader_update_cached_uniform(p, uniform, &value, sizeof(value))) {
+		assert(p->uniforms[uniform].variable.type == GL_FLOAT_VEC3);
+		glUniform3f(p->uniforms[uniform].variable.location, value.x, value.y, value.z);
+	}
+}
+
+void
+shader_set_uniform(Shader_Program *p, s32 uniform, const M4 &value)
+{
+	if (shader_update_cached_uniform(p, uniform, &value, sizeof(value))) {
+		assert(p->uniforms[uniform].variable.type == GL_FLOAT_MAT4);
+		glUniformMatrix4fv(p->uniforms[uniform].variable.location, 1, false, (GLfloat *)&value);
+	}
+}
+
 GLuint
 gpu_make_texture(u32 gl_tex_unit, s32 texture_format, s32 pixel_format, s32 pixel_width, s32 pixel_height, u8 *pixels)
 {
 	GLuint tex_id;
 	glGenTextures(1, &tex_id);
-	glActiveTexture(gl_tex_unit);
-	glBindTexture(GL_TEXTURE_2D, tex_id);
+	gl_active_texture(gl_tex_unit);
+	gl_bind_texture(GL_TEXTURE_2D, tex_id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexImage2D(GL_TEXTURE_2D, 0, texture_format, pixel_width, pixel_height, 0, pixel_format, GL_UNSIGNED_BYTE, pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_bind_texture(GL_TEXTURE_2D, 0);
 	return tex_id;
 }
 
@@ -106,6 +431,19 @@ V2 round_to_nearest_pixel(V2 p);
 Loaded_Sprite *get_sprite(Asset_Id id);
 Loaded_Texture *get_texture(Asset_Id id);
 
+// Gets a texture to draw out of the sprite texture array. Returns NULL, having logged why, if it isn't in the array.
+Texture_Asset *
+get_sprite_sheet_texture(const char *name)
+{
+	Texture_Asset *t = get_texture(name);
+	if (t && t->texture_array_layer == NO_TEXTURE_ARRAY_LAYER) {
+		log_print(MINOR_ERROR_LOG, "Tried to draw texture %s, which was loaded after the sprite texture array was made.", name);
+		return NULL;
+	}
+
+	return t;
+}
+
 void
 add_quad_render_commands(const char *texture_name, f32 quad_meter_width, f32 quad_meter_height, Rectangle texture_scissor_rect, V2 world_position, V2 view_vector)
 {
@@ -115,18 +453,9 @@ add_quad_render_commands(const char *texture_name, f32 quad_meter_width, f32 qua
 		//return;
 	//}
 
-	Texture_Asset *texture = get_texture(texture_name);
+	Texture_Asset *texture = get_sprite_sheet_texture(texture_name);
 	if (!texture)  return;
 
-	// @TODO: Worth it to load these up front?
-	Render_Command rc;
-	rc.texture_id = texture->gpu_handle;
-	glGenVertexArrays(1, &rc.vao);
-	glGenBuffers(1, &rc.vbo);
-	glGenBuffers(1, &rc.ebo);
-	glBindVertexArray(rc.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, rc.vbo);
-
 #if 0
 	static V2 pcp = c->position;
 	static V2 dpcp = { 0.0f, 0.0f };
@@ -196,44 +525,18 @@ add_quad_render_commands(const char *texture_name, f32 quad_meter_width, f32 qua
 
 	V2 camera_space_position = round_to_nearest_pixel(world_position) + view_vector;
 
-	f32 gl_x      = camera_space_position.x;
-	f32 gl_y      = camera_space_position.y;
-	f32 gl_width  = quad_meter_width;
-	f32 gl_height = quad_meter_height;
-
-	f32 tex_x = texture_scissor_rect.x;
-	f32 tex_w = texture_scissor_rect.w;
-	f32 tex_y = texture_scissor_rect.y;
-	f32 tex_h = texture_scissor_rect.h;
-
-	Vertex vertices[4] = {
-		//{ { gl_x, gl_y, 0.0f }, { 0, 1 } },
-		{ { gl_x, gl_y, 0.0f }, { tex_x, tex_y + tex_h } },
-		//{ { gl_x, gl_y + gl_height, 0.0f }, { 0, 0 } },
-		{ { gl_x, gl_y + gl_height, 0.0f }, { tex_x, tex_y } },
-		//{ { gl_x + gl_width, gl_y + gl_height, 0.0f }, { 1, 0 } },
-		{ { gl_x + gl_width, gl_y + gl_height, 0.0f }, { tex_x + tex_w, tex_y } },
-		//{ { gl_x + gl_width, gl_y, 0.0f }, { 1, 1 } },
-		{ { gl_x + gl_width, gl_y, 0.0f }, { tex_x + tex_w, tex_y + tex_h } },
-	};
-
-	GLuint indices[6] {
-		0, 1, 2, 0, 2, 3
-	};
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, position));
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, uv));
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	V2 uv_scale = texture->texture_array_uv_scale;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rc.ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_DYNAMIC_DRAW);
-
-	glBindVertexArray(0);
-	render_commands.push(rc);
+	Render_Command rc;
+	rc.position        = camera_space_position;
+	rc.size            = { quad_meter_width, quad_meter_height };
+	rc.texture_scissor = { texture_scissor_rect.x * uv_scale.x,
+	                       texture_scissor_rect.y * uv_scale.y,
+	                       texture_scissor_rect.w * uv_scale.x,
+	                       texture_scissor_rect.h * uv_scale.y };
+	rc.texture_layer   = texture->texture_array_layer;
+
+	array_add(&render_commands, rc);
 }
 
 void
@@ -284,8 +587,8 @@ render_init()
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(gl_debug_message_callback, 0);
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl_state_reset();
+	gl_set_blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glDepthFunc(GL_LEQUAL);
 	glDisable(GL_DEPTH_TEST);
 	glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
@@ -299,13 +602,80 @@ render_init()
 	String frag_source = read_entire_file("shader.frag", &init_arena);
 	assert(vert_source != STRING_ERROR && frag_source != STRING_ERROR);
 
-	shader = make_shader(vert_source, frag_source);
-	assert(shader);
+	shader = make_shader_program(vert_source, frag_source);
+	assert(shader.id);
+	sprite_projection_uniform = shader_find_uniform(&shader, "projection_matrix");
+	sprite_texture_uniform    = shader_find_uniform(&shader, "utexture");
 
-	glUseProgram(shader);
+	use_shader_program(&shader);
 	orthographic_projection = make_orthographic_projection(0, window_scaled_meter_width, 0, window_scaled_meter_height);
-	glUniformMatrix4fv(glGetUniformLocation(shader, "projection_matrix"), 1, false, (GLfloat *)&orthographic_projection);
-	glUseProgram(0);
+	shader_set_uniform(&shader, sprite_projection_uniform, orthographic_projection);
+	shader_set_uniform(&shader, sprite_texture_uniform, 0);
+	gl_use_program(0);
+
+	// The sprite quad has no per-vertex data. Every attribute advances once per instance and the corners come from gl_VertexID.
+	glGenVertexArrays(1, &sprite_vao);
+	glGenBuffers(1, &sprite_instance_vbo);
+	gl_bind_vertex_array(sprite_vao);
+	gl_bind_buffer(GL_ARRAY_BUFFER, sprite_instance_vbo);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Render_Command), (GLvoid *)offsetof(Render_Command, position));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Render_Command), (GLvoid *)offsetof(Render_Command, size));
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Render_Command), (GLvoid *)offsetof(Render_Command, texture_scissor));
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Render_Command), (GLvoid *)offsetof(Render_Command, texture_layer));
+	for (u32 i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+	gl_bind_vertex_array(0);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Has to run after the assets are loaded. Copies every sprite sheet into its own layer of one array texture so the sprite pass
+// never has to switch textures. The per-sheet textures stick around for the debug renderer. Textures loaded after this
+// aren't in the array, and get_sprite_sheet_texture won't draw them.
+void
+render_make_sprite_texture_array()
+{
+	u32 num_layers = texture_catalog.data.size;
+	if (num_layers == 0) {
+		return;
+	}
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	if (num_layers > (u32)max_layers) {
+		_abort("Have %u sprite sheets, but the sprite texture array can only hold %d layers.", num_layers, max_layers);
+	}
+
+	u32 layer_width = 0, layer_height = 0;
+	for (auto &t : texture_catalog.data) {
+		layer_width  = t.pixel_width  > layer_width  ? t.pixel_width  : layer_width;
+		layer_height = t.pixel_height > layer_height ? t.pixel_height : layer_height;
+	}
+
+	glGenTextures(1, &sprite_texture_array);
+	gl_active_texture(GL_TEXTURE0);
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, sprite_texture_array);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layer_width, layer_height, num_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	for (u32 i = 0; i < num_layers; ++i) {
+		Texture_Asset *t = &texture_catalog.data[i];
+		assert(t->pixels);
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, t->pixel_width, t->pixel_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, t->pixels);
+
+		t->texture_array_layer    = i;
+		t->texture_array_uv_scale = { (f32)t->pixel_width / layer_width, (f32)t->pixel_height / layer_height };
+
+		stbi_image_free(t->pixels);
+		t->pixels = NULL;
+	}
+
+	log_print(STANDARD_LOG, "Made sprite texture array with %u layers of %ux%u.", num_layers, layer_width, layer_height);
 }
 
 void debug_render();
@@ -317,17 +687,17 @@ submit_render_commands_and_swap_backbuffer()
 	{
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glUseProgram(shader);
+		if (render_commands.size > 0) {
+			use_shader_program(&shader);
+			gl_bind_vertex_array(sprite_vao);
+			gl_active_texture(GL_TEXTURE0);
+			gl_bind_texture(GL_TEXTURE_2D_ARRAY, sprite_texture_array);
 
-		for (auto rc : render_commands) {
-			glBindVertexArray(rc.vao);
-			glBindBuffer(GL_ARRAY_BUFFER, rc.vbo);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rc.ebo);
-			glBindTexture(GL_TEXTURE_2D, rc.texture_id);
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (GLvoid *)0);
+			// Orphan last frame's instances instead of waiting on the GPU to finish with them.
+			gl_bind_buffer(GL_ARRAY_BUFFER, sprite_instance_vbo);
+			glBufferData(GL_ARRAY_BUFFER, render_commands.size * sizeof(Render_Command), render_commands.data, GL_STREAM_DRAW);
 
-			glDeleteBuffers(1, &rc.vbo);
-			glDeleteVertexArrays(1, &rc.vao);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, render_commands.size);
 		}
 
 		render_commands.clear();
@@ -338,6 +708,8 @@ submit_render_commands_and_swap_backbuffer()
 		debug_render();
 	}
 
+	gl_state_end_frame();
+
 	platform_swap_buffers();
 }
 
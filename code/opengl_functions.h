@@ -31,6 +31,9 @@ GLPROC(glUniform1f, void, GLint, GLfloat);
 GLPROC(glUniform2fv, void, GLint, GLsizei, const GLfloat *);
 GLPROC(glUniform2f, void, GLint, GLfloat, GLfloat);
 GLPROC(glUniform1i, void, GLint, GLint);
+GLPROC(glGetActiveUniform, void, GLuint, GLuint, GLsizei, GLsizei *, GLint *, GLenum *, GLchar *);
+GLPROC(glGetActiveAttrib, void, GLuint, GLuint, GLsizei, GLsizei *, GLint *, GLenum *, GLchar *);
+GLPROC(glGetAttribLocation, GLint, GLuint, const GLchar *);
 
 GLPROC(glGenVertexArrays,    void,   GLsizei, GLuint *);
 GLPROC(glGenBuffers,    void,   GLsizei, GLuint *);
@@ -42,6 +45,8 @@ GLPROC(glBindBufferBase,    void,   GLenum, GLuint, GLuint);
 GLPROC(glBufferSubData, void,   GLenum, GLintptr, GLsizeiptr, const GLvoid *);
 GLPROC(glBufferData, void,   GLenum, GLsizeiptr, const GLvoid *, GLenum);
 GLPROC(glDeleteVertexArrays,    void, GLsizei,   const GLuint *);
+GLPROC(glVertexAttribDivisor,    void,   GLuint, GLuint);
+GLPROC(glDrawArraysInstanced,    void,   GLenum, GLint, GLsizei, GLsizei);
 
 GLPROC(glCreateShader,  GLuint, GLenum);
 GLPROC(glShaderSource, void, GLuint, GLsizei, const GLchar **, const GLint *);
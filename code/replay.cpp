@@ -0,0 +1,253 @@
+//
+// Input recording and replay. A recording holds the game state it started from, the game buttons of every tick and the
+// state hash after every tick, so a replay can tell exactly which tick it first went a different way from the original run.
+//
+
+void
+take_game_state_snapshot(Game_State *gs, Game_State_Snapshot *s)
+{
+	Player *p = &gs->player;
+	Rope   *r = &gs->rope;
+
+	// Zero the padding too, so the same state always writes the same bytes.
+	memset(s, 0, sizeof(*s));
+
+	s->player_collider              = p->collider;
+	s->player_world_position        = p->world_position;
+	s->player_velocity              = p->velocity;
+	s->player_facing                = p->facing;
+	s->player_grounded              = p->grounded;
+	s->player_grabbing_ledge        = p->grabbing_ledge;
+	s->player_jump_grace_ticks_left = p->jump_grace_ticks_left;
+
+	s->rope_cast_direction     = r->cast_direction;
+	s->rope_cast_point         = r->cast_point;
+	s->rope_unstretched_length = r->unstretched_length;
+	s->rope_out                = r->out;
+	s->rope_extending          = r->extending;
+	s->rope_retracting         = r->retracting;
+	s->rope_was_attached       = r->was_attached;
+	s->rope_was_released       = r->was_released;
+	s->rope_end_moving         = r->end_moving;
+	s->rope_end                = r->end;
+	s->rope_num_control_points = r->control_points.size;
+
+	s->camera_position = gs->camera.position;
+
+	s->num_tiles = gs->tiles.size;
+}
+
+void
+restore_game_state_snapshot(Input_Replay *replay, Game_State *gs)
+{
+	Game_State_Snapshot *s = &replay->snapshot;
+	Player *p = &gs->player;
+	Rope   *r = &gs->rope;
+
+	clear_tile_colliders(&gs->colliders);
+	array_reset(&gs->tiles);
+	for (u32 i = 0; i < replay->tiles.size; ++i) {
+		add_tile(replay->tiles[i].name, replay->tiles[i].world_position, &gs->tiles, &gs->colliders);
+		if (replay->tiles[i].flags & HIDE_TILE_FLAG) {
+			hide_tile(&gs->tiles, &gs->colliders, i);
+		}
+	}
+	update_tile_colliders(&gs->colliders);
+	adopt_level_chunks(&gs->level_stream, &gs->tiles);
+
+	set_collider(p->collider_id, s->player_collider, &gs->colliders);
+	p->collider              = s->player_collider;
+	p->world_position        = s->player_world_position;
+	p->velocity              = s->player_velocity;
+	p->facing                = s->player_facing;
+	p->grounded              = s->player_grounded;
+	p->grabbing_ledge        = s->player_grabbing_ledge;
+	p->jump_grace_ticks_left = s->player_jump_grace_ticks_left;
+
+	r->cast_direction     = s->rope_cast_direction;
+	r->cast_point         = s->rope_cast_point;
+	r->unstretched_length = s->rope_unstretched_length;
+	r->out                = s->rope_out;
+	r->extending          = s->rope_extending;
+	r->retracting         = s->rope_retracting;
+	r->was_attached       = s->rope_was_attached;
+	r->was_released       = s->rope_was_released;
+	r->end_moving         = s->rope_end_moving;
+	r->end                = s->rope_end;
+	array_reset(&r->control_points);
+	for (V2 cp : replay->rope_control_points) {
+		array_add(&r->control_points, cp);
+	}
+
+	set_camera_position(&gs->camera, s->camera_position);
+}
+
+void
+stop_input_recording(Input_Recorder *recorder)
+{
+	if (!recorder->file) {
+		return;
+	}
+
+	// The tick count isn't known until now, so go back and fill it in.
+	fseek(recorder->file, offsetof(Input_Stream_Header, num_ticks), SEEK_SET);
+	fwrite(&recorder->num_ticks, sizeof(recorder->num_ticks), 1, recorder->file);
+	if (fclose(recorder->file) != 0) {
+		log_print(MAJOR_ERROR_LOG, "Could not finish writing the input recording -- %s.", strerror(errno));
+	}
+	log_print(STANDARD_LOG, "Recorded %u ticks.", recorder->num_ticks);
+
+	recorder->file = NULL;
+}
+
+bool
+start_input_recording(const char *path, Game_State *gs, Input_Recorder *recorder)
+{
+	stop_input_recording(recorder);
+
+	FILE *fh = fopen(path, "wb");
+	if (!fh) {
+		log_print(MAJOR_ERROR_LOG, "Could not open %s to record input -- %s.", path, strerror(errno));
+		return false;
+	}
+
+	Input_Stream_Header header;
+	header.magic     = INPUT_STREAM_MAGIC;
+	header.version   = INPUT_STREAM_VERSION;
+	header.tick_hz   = (u32)SIMULATION_TICK_HZ;
+	header.num_ticks = 0;
+	fwrite(&header, sizeof(header), 1, fh);
+
+	Game_State_Snapshot snapshot;
+	take_game_state_snapshot(gs, &snapshot);
+	fwrite(&snapshot, sizeof(snapshot), 1, fh);
+
+	for (Tile &t : gs->tiles) {
+		u8 name_length = strlen(t.sprite.name);
+		fwrite(&name_length, sizeof(name_length), 1, fh);
+		fwrite(t.sprite.name, name_length, 1, fh);
+		fwrite(&t.world_position, sizeof(t.world_position), 1, fh);
+		fwrite(&t.flags, sizeof(t.flags), 1, fh);
+	}
+	fwrite(gs->rope.control_points.data, sizeof(V2), gs->rope.control_points.size, fh);
+
+	recorder->file      = fh;
+	recorder->num_ticks = 0;
+
+	log_print(STANDARD_LOG, "Recording input to %s.", path);
+
+	return true;
+}
+
+// Called after each tick's update(). The file is buffered by stdio, so this is a copy most ticks.
+void
+record_input_tick(u32 buttons, u64 hash, Input_Recorder *recorder)
+{
+	if (!recorder->file) {
+		return;
+	}
+
+	fwrite(&buttons, sizeof(buttons), 1, recorder->file);
+	fwrite(&hash, sizeof(hash), 1, recorder->file);
+	recorder->num_ticks += 1;
+}
+
+void
+free_input_replay(Input_Replay *replay)
+{
+	free(replay->tiles.data);
+	free(replay->rope_control_points.data);
+	free(replay->buttons);
+	free(replay->hashes);
+	*replay = {};
+}
+
+bool
+load_input_replay(const char *path, Input_Replay *replay)
+{
+	*replay = {};
+
+	FILE *fh = fopen(path, "rb");
+	if (!fh) {
+		log_print(MAJOR_ERROR_LOG, "Could not open input recording %s -- %s.", path, strerror(errno));
+		return false;
+	}
+	DEFER(fclose(fh));
+
+	Input_Stream_Header *h = &replay->header;
+	if (fread(h, sizeof(*h), 1, fh) != 1 || h->magic != INPUT_STREAM_MAGIC) {
+		log_print(MAJOR_ERROR_LOG, "%s is not an input recording.", path);
+		return false;
+	}
+	if (h->version != INPUT_STREAM_VERSION) {
+		log_print(MAJOR_ERROR_LOG, "Input recording %s has version %u, expected %u.", path, h->version, INPUT_STREAM_VERSION);
+		return false;
+	}
+
+	Game_State_Snapshot *s = &replay->snapshot;
+	bool ok = fread(s, sizeof(*s), 1, fh) == 1;
+
+	replay->tiles = make_array<Snapshot_Tile>(ok ? s->num_tiles : 0, 0);
+	for (u32 i = 0; ok && i < s->num_tiles; ++i) {
+		Snapshot_Tile st = {};
+		u8 name_length = 0;
+		ok = fread(&name_length, sizeof(name_length), 1, fh) == 1
+		  && name_length < sizeof(st.name)
+		  && fread(st.name, name_length, 1, fh) == 1
+		  && fread(&st.world_position, sizeof(st.world_position), 1, fh) == 1
+		  && fread(&st.flags, sizeof(st.flags), 1, fh) == 1;
+		replay->tiles.push(st);
+	}
+
+	replay->rope_control_points = make_array<V2>(ok ? s->rope_num_control_points : 0, ok ? s->rope_num_control_points : 0);
+	ok = ok && fread(replay->rope_control_points.data, sizeof(V2), replay->rope_control_points.size, fh) == replay->rope_control_points.size;
+
+	replay->buttons = (u32 *)emalloc(h->num_ticks * sizeof(u32));
+	replay->hashes  = (u64 *)emalloc(h->num_ticks * sizeof(u64));
+	for (u32 t = 0; t < h->num_ticks && ok; ++t) {
+		ok = fread(&replay->buttons[t], sizeof(u32), 1, fh) == 1
+		  && fread(&replay->hashes[t], sizeof(u64), 1, fh) == 1;
+	}
+
+	if (!ok) {
+		log_print(MAJOR_ERROR_LOG, "Input recording %s is truncated.", path);
+		free_input_replay(replay);
+		return false;
+	}
+
+	replay->tick           = 0;
+	replay->first_mismatch = h->num_ticks;
+
+	return true;
+}
+
+// Sets up the next tick's input. Returns false once the recording has run out.
+bool
+replay_next_tick(Input_Replay *replay, Input *in)
+{
+	if (replay->tick >= replay->header.num_ticks) {
+		return false;
+	}
+	set_game_buttons(replay->buttons[replay->tick], in);
+	return true;
+}
+
+// Called after each replayed tick's update(). Returns false on the first tick the state hash disagrees with the recording.
+bool
+check_replay_tick(Input_Replay *replay, Game_State *gs)
+{
+	u32 t = replay->tick;
+	replay->tick += 1;
+
+	if (replay->first_mismatch != replay->header.num_ticks) {
+		return true;
+	}
+
+	u64 hash = hash_game_state(gs);
+	if (hash != replay->hashes[t]) {
+		replay->first_mismatch = t;
+		log_print(MAJOR_ERROR_LOG, "Replay diverged from the recording at tick %u: hash %016llx, recorded %016llx.", t + 1, (unsigned long long)hash, (unsigned long long)replay->hashes[t]);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,572 @@
+//
+// Sample conversion. Sounds get decoded from whatever sample format their file has to floats, mixed to the device's
+// channels, linearly resampled to the device's rate and encoded back to 16 bit. The decode, resample and encode steps have
+// SIMD kernels, picked at startup like the collision kernels, with the scalar kernels as the reference they have to agree
+// with exactly.
+//
+// The asset packer includes this too, so the sounds it packs come out exactly as the game would have converted them.
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAMPLE_KERNELS_X86
+#endif
+
+#define SAMPLE_CONVERSION_BLOCK_FRAMES 2048 // Source frames converted at a time.
+#define MAX_SAMPLE_CHANNELS            8
+
+enum Sample_Format {
+	SAMPLE_FORMAT_U8,
+	SAMPLE_FORMAT_S16,
+	SAMPLE_FORMAT_S24,
+	SAMPLE_FORMAT_F32,
+};
+
+typedef void (*Sample_Decode_Kernel)(f32 *out, const char *in, u32 num_samples);
+typedef void (*Sample_Encode_Kernel)(s16 *out, const f32 *in, u32 num_samples);
+// Positions are 32.32 fixed point source frames, step is how far the position moves per output frame.
+typedef void (*Resample_Kernel)(f32 *out, const f32 *in, u32 num_channels, u64 position, u64 step, u32 num_frames);
+
+//
+// Scalar kernels.
+//
+
+void
+decode_u8_samples_scalar(f32 *out, const char *in, u32 num_samples)
+{
+	for (u32 i = 0; i < num_samples; ++i) {
+		out[i] = ((s32)(u8)in[i] - 128) * (1.0f / 128.0f);
+	}
+}
+
+void
+decode_s16_samples_scalar(f32 *out, const char *in, u32 num_samples)
+{
+	const s16 *samples = (const s16 *)in;
+	for (u32 i = 0; i < num_samples; ++i) {
+		out[i] = samples[i] * (1.0f / 32768.0f);
+	}
+}
+
+void
+decode_s24_samples_scalar(f32 *out, const char *in, u32 num_samples)
+{
+	const u8 *bytes = (const u8 *)in;
+	for (u32 i = 0; i < num_samples; ++i) {
+		s32 sample = (s32)(((u32)bytes[i * 3] << 8) | ((u32)bytes[i * 3 + 1] << 16) | ((u32)bytes[i * 3 + 2] << 24)) >> 8;
+		out[i] = sample * (1.0f / 8388608.0f);
+	}
+}
+
+void
+decode_f32_samples(f32 *out, const char *in, u32 num_samples)
+{
+	memcpy(out, in, num_samples * sizeof(f32));
+}
+
+// Rounds to nearest, clamping first so the SIMD conversions never see a value out of range.
+void
+encode_s16_samples_scalar(s16 *out, const f32 *in, u32 num_samples)
+{
+	for (u32 i = 0; i < num_samples; ++i) {
+		out[i] = lrintf(fmin(fmax(in[i] * 32768.0f, -32768.0f), 32767.0f));
+	}
+}
+
+void
+resample_linear_scalar(f32 *out, const f32 *in, u32 num_channels, u64 position, u64 step, u32 num_frames)
+{
+	for (u32 i = 0; i < num_frames; ++i, position += step) {
+		const f32 *a = &in[(position >> 32) * num_channels];
+		const f32 *b = a + num_channels;
+		f32        t = ((u32)position >> 8) * (1.0f / 16777216.0f); // The top 24 bits of the fraction, so it converts exactly.
+		for (u32 c = 0; c < num_channels; ++c) {
+			out[(i * num_channels) + c] = a[c] + ((b[c] - a[c]) * t);
+		}
+	}
+}
+
+#ifdef SAMPLE_KERNELS_X86
+
+//
+// SSE kernels. The s24 decode needs SSSE3's shuffle, so the whole set does.
+//
+
+void
+decode_u8_samples_sse(f32 *out, const char *in, u32 num_samples)
+{
+	__m128i zero  = _mm_setzero_si128();
+	__m128i bias  = _mm_set1_epi32(128);
+	__m128  scale = _mm_set1_ps(1.0f / 128.0f);
+
+	u32 i = 0;
+	for (; i + 16 <= num_samples; i += 16) {
+		__m128i bytes = _mm_loadu_si128((__m128i *)&in[i]);
+		__m128i lo    = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi    = _mm_unpackhi_epi8(bytes, zero);
+		_mm_storeu_ps(&out[i],      _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpacklo_epi16(lo, zero), bias)), scale));
+		_mm_storeu_ps(&out[i + 4],  _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpackhi_epi16(lo, zero), bias)), scale));
+		_mm_storeu_ps(&out[i + 8],  _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpacklo_epi16(hi, zero), bias)), scale));
+		_mm_storeu_ps(&out[i + 12], _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpackhi_epi16(hi, zero), bias)), scale));
+	}
+	decode_u8_samples_scalar(&out[i], &in[i], num_samples - i);
+}
+
+void
+decode_s16_samples_sse(f32 *out, const char *in, u32 num_samples)
+{
+	const s16 *samples = (const s16 *)in;
+	__m128     scale   = _mm_set1_ps(1.0f / 32768.0f);
+
+	u32 i = 0;
+	for (; i + 8 <= num_samples; i += 8) {
+		__m128i s = _mm_loadu_si128((__m128i *)&samples[i]);
+		_mm_storeu_ps(&out[i],     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), scale));
+		_mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), scale));
+	}
+	decode_s16_samples_scalar(&out[i], (const char *)&samples[i], num_samples - i);
+}
+
+__attribute__((target("ssse3"))) void
+decode_s24_samples_ssse3(f32 *out, const char *in, u32 num_samples)
+{
+	// Puts each 3 byte sample in the top of a 32 bit lane, then shifts it down to sign extend it.
+	__m128i spread = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	__m128  scale  = _mm_set1_ps(1.0f / 8388608.0f);
+
+	// Each load reads 16 bytes for 12 bytes of samples, so stop while there's room for the extra 4.
+	u32 i = 0;
+	for (; i + 6 <= num_samples; i += 4) {
+		__m128i s = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&in[i * 3]), spread), 8);
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+	}
+	decode_s24_samples_scalar(&out[i], &in[i * 3], num_samples - i);
+}
+
+void
+encode_s16_samples_sse(s16 *out, const f32 *in, u32 num_samples)
+{
+	__m128 scale = _mm_set1_ps(32768.0f);
+	__m128 lo    = _mm_set1_ps(-32768.0f);
+	__m128 hi    = _mm_set1_ps(32767.0f);
+
+	u32 i = 0;
+	for (; i + 8 <= num_samples; i += 8) {
+		__m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[i]),     scale), lo), hi));
+		__m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[i + 4]), scale), lo), hi));
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(a, b));
+	}
+	encode_s16_samples_scalar(&out[i], &in[i], num_samples - i);
+}
+
+// Only stereo has a SIMD path, anything else goes through the scalar kernel.
+void
+resample_linear_sse(f32 *out, const f32 *in, u32 num_channels, u64 position, u64 step, u32 num_frames)
+{
+	if (num_channels != 2) {
+		resample_linear_scalar(out, in, num_channels, position, step, num_frames);
+		return;
+	}
+
+	u32 i = 0;
+	for (; i + 2 <= num_frames; i += 2) {
+		u64 p0 = position + (i * step);
+		u64 p1 = p0 + step;
+
+		// A stereo frame is 8 bytes, so it loads as one double.
+		__m128 a  = _mm_castpd_ps(_mm_loadh_pd(_mm_load_sd((const double *)&in[(p0 >> 32) * 2]),     (const double *)&in[(p1 >> 32) * 2]));
+		__m128 b  = _mm_castpd_ps(_mm_loadh_pd(_mm_load_sd((const double *)&in[(p0 >> 32) * 2 + 2]), (const double *)&in[(p1 >> 32) * 2 + 2]));
+		__m128 t0 = _mm_set1_ps(((u32)p0 >> 8) * (1.0f / 16777216.0f));
+		__m128 t1 = _mm_set1_ps(((u32)p1 >> 8) * (1.0f / 16777216.0f));
+		__m128 t  = _mm_movelh_ps(t0, t1);
+		_mm_storeu_ps(&out[i * 2], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+	}
+	resample_linear_scalar(&out[i * 2], in, 2, position + (i * step), step, num_frames - i);
+}
+
+//
+// AVX2 kernels.
+//
+
+__attribute__((target("avx2"))) void
+decode_u8_samples_avx2(f32 *out, const char *in, u32 num_samples)
+{
+	__m256i bias  = _mm256_set1_epi32(128);
+	__m256  scale = _mm256_set1_ps(1.0f / 128.0f);
+
+	u32 i = 0;
+	for (; i + 8 <= num_samples; i += 8) {
+		__m256i s = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)&in[i])), bias);
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(s), scale));
+	}
+	decode_u8_samples_scalar(&out[i], &in[i], num_samples - i);
+}
+
+__attribute__((target("avx2"))) void
+decode_s16_samples_avx2(f32 *out, const char *in, u32 num_samples)
+{
+	const s16 *samples = (const s16 *)in;
+	__m256     scale   = _mm256_set1_ps(1.0f / 32768.0f);
+
+	u32 i = 0;
+	for (; i + 8 <= num_samples; i += 8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)&samples[i]));
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(s), scale));
+	}
+	decode_s16_samples_scalar(&out[i], (const char *)&samples[i], num_samples - i);
+}
+
+__attribute__((target("avx2"))) void
+encode_s16_samples_avx2(s16 *out, const f32 *in, u32 num_samples)
+{
+	__m256 scale = _mm256_set1_ps(32768.0f);
+	__m256 lo    = _mm256_set1_ps(-32768.0f);
+	__m256 hi    = _mm256_set1_ps(32767.0f);
+
+	u32 i = 0;
+	for (; i + 16 <= num_samples; i += 16) {
+		__m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&in[i]),     scale), lo), hi));
+		__m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&in[i + 8]), scale), lo), hi));
+		// The pack works within 128 bit lanes, so put the halves back in order after.
+		_mm256_storeu_si256((__m256i *)&out[i], _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	encode_s16_samples_scalar(&out[i], &in[i], num_samples - i);
+}
+
+__attribute__((target("avx2"))) void
+resample_linear_avx2(f32 *out, const f32 *in, u32 num_channels, u64 position, u64 step, u32 num_frames)
+{
+	if (num_channels != 2) {
+		resample_linear_scalar(out, in, num_channels, position, step, num_frames);
+		return;
+	}
+
+	__m256i positions     = _mm256_set_epi64x(position + (3 * step), position + (2 * step), position + step, position);
+	__m256i advance       = _mm256_set1_epi64x(4 * step);
+	__m256i fraction_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+	__m256  scale         = _mm256_set1_ps(1.0f / 16777216.0f);
+
+	u32 i = 0;
+	for (; i + 4 <= num_frames; i += 4) {
+		// Gathers whole stereo frames as doubles, the bits come through untouched.
+		__m256i frames = _mm256_srli_epi64(positions, 32);
+		__m256  a      = _mm256_castpd_ps(_mm256_i64gather_pd((const double *)in,     frames, 8));
+		__m256  b      = _mm256_castpd_ps(_mm256_i64gather_pd((const double *)in + 1, frames, 8));
+
+		// The fraction sits in the low half of each 64 bit lane, copy it to the high half for the right channel.
+		__m256i fractions = _mm256_srli_epi64(_mm256_and_si256(positions, fraction_mask), 8);
+		__m256  t         = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_shuffle_epi32(fractions, _MM_SHUFFLE(2, 2, 0, 0))), scale);
+
+		_mm256_storeu_ps(&out[i * 2], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t)));
+		positions = _mm256_add_epi64(positions, advance);
+	}
+	resample_linear_scalar(&out[i * 2], in, 2, position + (i * step), step, num_frames - i);
+}
+
+#endif
+
+// The scalar kernels until select_sample_kernels finds faster ones.
+Sample_Decode_Kernel decode_u8_samples  = decode_u8_samples_scalar;
+Sample_Decode_Kernel decode_s16_samples = decode_s16_samples_scalar;
+Sample_Decode_Kernel decode_s24_samples = decode_s24_samples_scalar;
+Sample_Encode_Kernel encode_s16_samples = encode_s16_samples_scalar;
+Resample_Kernel      resample_linear    = resample_linear_scalar;
+
+void
+select_sample_kernels()
+{
+#ifdef SAMPLE_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		decode_u8_samples  = decode_u8_samples_avx2;
+		decode_s16_samples = decode_s16_samples_avx2;
+		decode_s24_samples = decode_s24_samples_ssse3;
+		encode_s16_samples = encode_s16_samples_avx2;
+		resample_linear    = resample_linear_avx2;
+		log_print(STANDARD_LOG, "Using the AVX2 sample kernels.");
+	} else if (__builtin_cpu_supports("ssse3")) {
+		decode_u8_samples  = decode_u8_samples_sse;
+		decode_s16_samples = decode_s16_samples_sse;
+		decode_s24_samples = decode_s24_samples_ssse3;
+		encode_s16_samples = encode_s16_samples_sse;
+		resample_linear    = resample_linear_sse;
+		log_print(STANDARD_LOG, "Using the SSE sample kernels.");
+	} else {
+		log_print(STANDARD_LOG, "Using the scalar sample kernels.");
+	}
+#else
+	log_print(STANDARD_LOG, "Using the scalar sample kernels.");
+#endif
+}
+
+//
+// Conversion.
+//
+
+// Mixes frames between channel counts: mono gets copied to every channel, going down to mono averages, and anything else
+// keeps the first channels.
+void
+mix_sample_channels(f32 *out, u32 out_channels, const f32 *in, u32 in_channels, u32 num_frames)
+{
+	if (in_channels == out_channels) {
+		memcpy(out, in, num_frames * in_channels * sizeof(f32));
+	} else if (in_channels == 1) {
+		for (u32 i = 0; i < num_frames; ++i) {
+			for (u32 c = 0; c < out_channels; ++c) {
+				out[(i * out_channels) + c] = in[i];
+			}
+		}
+	} else if (out_channels == 1) {
+		for (u32 i = 0; i < num_frames; ++i) {
+			f32 sum = 0.0f;
+			for (u32 c = 0; c < in_channels; ++c) {
+				sum += in[(i * in_channels) + c];
+			}
+			out[i] = sum / in_channels;
+		}
+	} else {
+		for (u32 i = 0; i < num_frames; ++i) {
+			for (u32 c = 0; c < out_channels; ++c) {
+				out[(i * out_channels) + c] = (c < in_channels) ? in[(i * in_channels) + c] : 0.0f;
+			}
+		}
+	}
+}
+
+struct Sample_Source {
+	Sample_Format format;
+	u32           num_channels;
+	u32           bytes_per_frame;
+	u32           num_frames;
+	const char *  samples;
+
+	u64 step;              // Source frames per output frame, 32.32 fixed point.
+	u32 num_output_frames; // How long it is at the output rate.
+};
+
+void
+set_sample_source_output_rate(Sample_Source *s, u32 sample_rate, u32 output_rate)
+{
+	s->step              = ((u64)sample_rate << 32) / output_rate;
+	s->num_output_frames = s->num_frames ? ((((u64)(s->num_frames - 1) << 32) / s->step) + 1) : 0;
+}
+
+// Converts a run of output frames, counted from the start of the source, so a source can be converted a piece at a time
+// in any order and always come out the same. Output frames are interleaved 16 bit samples with out_channels channels.
+void
+convert_sample_frames(s16 *out, u32 out_channels, Sample_Source *s, u32 first_frame, u32 num_frames)
+{
+	// Already in the output's format, so it's just a copy.
+	if (s->format == SAMPLE_FORMAT_S16 && s->num_channels == out_channels && s->step == ((u64)1 << 32)) {
+		memcpy(out, s->samples + ((size_t)first_frame * s->bytes_per_frame), (size_t)num_frames * s->bytes_per_frame);
+		return;
+	}
+
+	f32 decoded[SAMPLE_CONVERSION_BLOCK_FRAMES * MAX_SAMPLE_CHANNELS];
+	f32 mixed[SAMPLE_CONVERSION_BLOCK_FRAMES * MAX_SAMPLE_CHANNELS];
+	f32 resampled[SAMPLE_CONVERSION_BLOCK_FRAMES * MAX_SAMPLE_CHANNELS];
+
+	// As many output frames as fit in a block of source frames, with room for the frame after the last to interpolate to.
+	u32 block_frames = u32_min(SAMPLE_CONVERSION_BLOCK_FRAMES, ((u64)(SAMPLE_CONVERSION_BLOCK_FRAMES - 2) << 32) / s->step);
+
+	while (num_frames > 0) {
+		u32 n            = u32_min(num_frames, block_frames);
+		u64 position     = (u64)first_frame * s->step;
+		u32 first_source = position >> 32;
+		u32 last_source  = ((position + ((u64)(n - 1) * s->step)) >> 32) + 1;
+		u32 num_source   = u32_min(last_source, s->num_frames - 1) - first_source + 1;
+
+		const char *in = s->samples + ((size_t)first_source * s->bytes_per_frame);
+		switch (s->format) {
+		case SAMPLE_FORMAT_U8:  decode_u8_samples(decoded, in, num_source * s->num_channels); break;
+		case SAMPLE_FORMAT_S16: decode_s16_samples(decoded, in, num_source * s->num_channels); break;
+		case SAMPLE_FORMAT_S24: decode_s24_samples(decoded, in, num_source * s->num_channels); break;
+		case SAMPLE_FORMAT_F32: decode_f32_samples(decoded, in, num_source * s->num_channels); break;
+		}
+		mix_sample_channels(mixed, out_channels, decoded, s->num_channels, num_source);
+
+		// Past the end of the source, interpolate towards the last frame.
+		if (first_source + num_source <= last_source) {
+			memcpy(&mixed[num_source * out_channels], &mixed[(num_source - 1) * out_channels], out_channels * sizeof(f32));
+		}
+
+		const f32 *converted = mixed;
+		if (s->step != ((u64)1 << 32)) {
+			resample_linear(resampled, mixed, out_channels, position - ((u64)first_source << 32), s->step, n);
+			converted = resampled;
+		}
+		encode_s16_samples(out, converted, n * out_channels);
+
+		out         += n * out_channels;
+		first_frame += n;
+		num_frames  -= n;
+	}
+}
+
+//
+// Wav files.
+//
+
+// Finds the format and the samples in a wav file and sets it up to be converted to the output rate. Returns false,
+// having logged why, if it isn't a format that can be converted.
+bool
+parse_wav(const char *path, const char *file, size_t file_size, u32 output_rate, Sample_Source *source)
+{
+	if (file_size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+		log_print(MAJOR_ERROR_LOG, "%s is not a wav file.", path);
+		return false;
+	}
+
+	u32  sample_rate = 0;
+	bool have_format = false;
+	for (size_t offset = 12; offset + 8 <= file_size;) {
+		const char *chunk        = file + offset;
+		const char *chunk_data   = chunk + 8;
+		u32         chunk_length = u32_min(*(u32 *)(chunk + 4), file_size - offset - 8); // Play what there is of a cut off file.
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunk_length >= 16) {
+			u16 format_type     = READ_AND_ADVANCE_STREAM(u16, chunk_data);
+			u16 num_channels    = READ_AND_ADVANCE_STREAM(u16, chunk_data);
+			sample_rate         = READ_AND_ADVANCE_STREAM(u32, chunk_data);
+			chunk_data += 4; // Bytes per second.
+			u16 bytes_per_frame = READ_AND_ADVANCE_STREAM(u16, chunk_data);
+			u16 bits_per_sample = READ_AND_ADVANCE_STREAM(u16, chunk_data);
+
+			// The extensible format keeps the real format type at the start of its sub format.
+			if (format_type == 0xFFFE && chunk_length >= 40) {
+				format_type = *(u16 *)(chunk + 8 + 24);
+			}
+
+			if (format_type == 1 && bits_per_sample == 8) {
+				source->format = SAMPLE_FORMAT_U8;
+			} else if (format_type == 1 && bits_per_sample == 16) {
+				source->format = SAMPLE_FORMAT_S16;
+			} else if (format_type == 1 && bits_per_sample == 24) {
+				source->format = SAMPLE_FORMAT_S24;
+			} else if (format_type == 3 && bits_per_sample == 32) {
+				source->format = SAMPLE_FORMAT_F32;
+			} else {
+				log_print(MAJOR_ERROR_LOG, "The wav file %s has format %u with %u bit samples, which can't be converted.", path, format_type, bits_per_sample);
+				return false;
+			}
+			if (num_channels == 0 || num_channels > MAX_SAMPLE_CHANNELS || bytes_per_frame != num_channels * (bits_per_sample / 8)) {
+				log_print(MAJOR_ERROR_LOG, "The wav file %s has %u channels in %u byte frames, which can't be converted.", path, num_channels, bytes_per_frame);
+				return false;
+			}
+			if (sample_rate < 1000 || sample_rate > 384000) {
+				log_print(MAJOR_ERROR_LOG, "The wav file %s has a sample rate of %u Hz, which can't be converted.", path, sample_rate);
+				return false;
+			}
+			source->num_channels    = num_channels;
+			source->bytes_per_frame = bytes_per_frame;
+			have_format = true;
+		} else if (memcmp(chunk, "data", 4) == 0 && have_format) {
+			source->samples    = chunk_data;
+			source->num_frames = chunk_length / source->bytes_per_frame;
+			set_sample_source_output_rate(source, sample_rate, output_rate);
+			return true;
+		}
+
+		offset += 8 + chunk_length + (chunk_length & 1); // Chunks are padded to an even length.
+	}
+
+	log_print(MAJOR_ERROR_LOG, "The wav file %s has no samples.", path);
+	return false;
+}
+
+#ifndef ASSET_PACKER // The packer has no platform layer to time with.
+
+//
+// Benchmark.
+//
+
+// Times every available kernel over a second or so of random samples and logs the cost. They also get checked against the
+// scalar kernels, since they have to agree exactly.
+void
+benchmark_sample_kernels()
+{
+	struct Kernel_Set {
+		const char *         name;
+		Sample_Decode_Kernel decode_u8;
+		Sample_Decode_Kernel decode_s16;
+		Sample_Decode_Kernel decode_s24;
+		Sample_Encode_Kernel encode_s16;
+		Resample_Kernel      resample;
+	};
+	Kernel_Set sets[3];
+	u32 num_sets = 0;
+	sets[num_sets++] = { "scalar", decode_u8_samples_scalar, decode_s16_samples_scalar, decode_s24_samples_scalar, encode_s16_samples_scalar, resample_linear_scalar };
+#ifdef SAMPLE_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		sets[num_sets++] = { "sse", decode_u8_samples_sse, decode_s16_samples_sse, decode_s24_samples_ssse3, encode_s16_samples_sse, resample_linear_sse };
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		sets[num_sets++] = { "avx2", decode_u8_samples_avx2, decode_s16_samples_avx2, decode_s24_samples_ssse3, encode_s16_samples_avx2, resample_linear_avx2 };
+	}
+#endif
+
+	const u32 num_samples = 96000; // A second of 48 kHz stereo, resampled to 44.1 kHz.
+	const u64 step        = ((u64)48000 << 32) / 44100;
+	const u32 num_frames  = ((u64)(num_samples / 2 - 2) << 32) / step;
+
+	u32   seed    = 0x9E3779B9;
+	char *in      = (char *)emalloc(num_samples * 3);
+	f32 * floats  = (f32 *)emalloc(num_samples * sizeof(f32));
+	for (u32 i = 0; i < num_samples * 3; ++i) {
+		in[i] = benchmark_random_f32(&seed, 0.0f, 256.0f);
+	}
+	for (u32 i = 0; i < num_samples; ++i) {
+		floats[i] = benchmark_random_f32(&seed, -1.2f, 1.2f); // Some out of range, to check the clamping.
+	}
+
+	f32 *reference_f32 = (f32 *)emalloc(num_samples * sizeof(f32));
+	f32 *out_f32       = (f32 *)emalloc(num_samples * sizeof(f32));
+	s16 *reference_s16 = (s16 *)emalloc(num_samples * sizeof(s16));
+	s16 *out_s16       = (s16 *)emalloc(num_samples * sizeof(s16));
+
+	auto check = [&](Kernel_Set *set, const char *kernel, bool matched, u64 elapsed) {
+		if (!matched) {
+			log_print(MAJOR_ERROR_LOG, "The %s %s kernel disagrees with the scalar one.", set->name, kernel);
+		}
+		log_print(STANDARD_LOG, "%-6s %-10s: %6lu us, %.3f ns per sample.", set->name, kernel, elapsed, (elapsed * 1000.0) / num_samples);
+	};
+
+	for (u32 k = 0; k < num_sets; ++k) {
+		Kernel_Set *set = &sets[k];
+		struct {
+			const char *         name;
+			Sample_Decode_Kernel kernel;
+			Sample_Decode_Kernel reference;
+		} decodes[] = {
+			{ "u8 decode",  set->decode_u8,  decode_u8_samples_scalar },
+			{ "s16 decode", set->decode_s16, decode_s16_samples_scalar },
+			{ "s24 decode", set->decode_s24, decode_s24_samples_scalar },
+		};
+		for (auto &d : decodes) {
+			d.reference(reference_f32, in, num_samples);
+			u64 start = platform_get_time_us();
+			d.kernel(out_f32, in, num_samples);
+			check(set, d.name, memcmp(reference_f32, out_f32, num_samples * sizeof(f32)) == 0, platform_get_time_us() - start);
+		}
+
+		encode_s16_samples_scalar(reference_s16, floats, num_samples);
+		u64 start = platform_get_time_us();
+		set->encode_s16(out_s16, floats, num_samples);
+		check(set, "s16 encode", memcmp(reference_s16, out_s16, num_samples * sizeof(s16)) == 0, platform_get_time_us() - start);
+
+		resample_linear_scalar(reference_f32, floats, 2, 0, step, num_frames);
+		start = platform_get_time_us();
+		set->resample(out_f32, floats, 2, 0, step, num_frames);
+		check(set, "resample", memcmp(reference_f32, out_f32, num_frames * 2 * sizeof(f32)) == 0, platform_get_time_us() - start);
+	}
+
+	free(in);
+	free(floats);
+	free(reference_f32);
+	free(out_f32);
+	free(reference_s16);
+	free(out_s16);
+}
+
+#endif
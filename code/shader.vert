@@ -1,15 +1,22 @@
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec2 uv;
+// Per-instance sprite quad. See Render_Command.
+layout (location = 0) in vec2  position;
+layout (location = 1) in vec2  size;
+layout (location = 2) in vec4  texture_scissor;
+layout (location = 3) in float texture_layer;
 
 uniform mat4 projection_matrix;
 
-out vec2 frag_uv;
+out vec3 frag_uv;
 
 void main()
 {
-	gl_Position = projection_matrix * vec4(position, 1.0f);
-	//gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
-	//frag_color  = color;
-	frag_uv     = uv;
-}
+	// Triangle strip corners: (0, 0), (1, 0), (0, 1), (1, 1).
+	vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+
+	gl_Position = projection_matrix * vec4(position + (corner * size), 0.0f, 1.0f);
 
+	// The sprite sheets are stored top row first, so flip v.
+	frag_uv = vec3(texture_scissor.x + (corner.x * texture_scissor.z),
+	               texture_scissor.y + ((1.0f - corner.y) * texture_scissor.w),
+	               texture_layer);
+}
@@ -1,144 +1,695 @@
+//
+// Sound. A mixer thread owns the PCM device. It mixes every playing voice into one period at a time, straight into the
+// device's buffer where it can be mapped, and blocks until there's room for the next, so a slow frame on the main thread never
+// starves the device. The game only ever pushes commands onto a single producer, single consumer queue, which the mixer drains
+// at the start of every period.
+//
+// Long sounds, like music, are streamed: a stream thread copies them out of their mapped file a chunk at a time into a ring
+// the mixer plays from, keeping just ahead of it, so they take the same memory however long they are.
+//
+// Sounds packed into the asset file are already in the device's format, so short ones are mixed straight out of the mapped
+// file and long ones are streamed out of it with nothing to convert.
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIX_KERNELS_X86
+#endif
+
+#define MAX_SOUNDS                 64
+#define MAX_SOUND_VOICES           64
+#define SOUND_COMMAND_QUEUE_LENGTH 256 // Has to be a power of two.
+#define SOUND_STREAM_RING_FRAMES   16384 // Has to be a power of two.
+#define SOUND_STREAM_CHUNK_FRAMES  4096
+#define SOUND_STREAM_MIN_SECONDS   5 // Packed sounds at least this long are streamed.
+#define SOUND_FRAMES_PER_PERIOD    256 // Sounds start about a period after they're played, and the buffer is this many periods.
+#define SOUND_PERIODS_PER_BUFFER   4
+
 typedef u32 Sound_Handle;
+#define NO_SOUND ((Sound_Handle)-1)
+
+typedef u32 Voice_Id;
+#define NO_VOICE_ID 0
+
+// Only one voice plays a stream at a time. Playing it again starts it over.
+struct Sound_Stream {
+	const char *  file;
+	size_t        file_size;
+	Sample_Source source;
 
+	s16 *        ring;        // SOUND_STREAM_RING_FRAMES frames in the device's format.
+	volatile u32 write_frame; // Frames put in the ring since it was last started over, only the stream thread moves it.
+	volatile u32 read_frame;  // Frames taken out of the ring since it was last started over, only the mixer moves it.
+	volatile u32 rewind_generation;  // Bumped by the mixer to start over.
+	volatile u32 rewound_generation; // Set by the stream thread once the start for that generation is in the ring.
+	volatile bool loop;              // Set by the mixer before it starts the stream over.
+
+	// Stream thread only.
+	u32    frame; // The next frame to convert out of the file.
+	bool   looping;
+	size_t released_offset; // The file's pages before this have been handed back.
+};
+
+// Samples are interleaved and already in the device's format, so voices can be mixed straight from them.
 struct Sound {
-	u32 num_frames;
-	//u16 bytes_per_frame;
-	char *samples;
+	u32            num_frames;
+	s16 *          samples;
+	Sound_Stream * stream; // Instead of the samples, for streamed sounds.
+};
+
+enum Sound_Command_Type {
+	PLAY_SOUND_COMMAND,
+	STOP_VOICE_COMMAND,
+	SET_VOICE_COMMAND,
+};
+
+struct Sound_Command {
+	Sound_Command_Type type;
+	Voice_Id           voice_id;
+	Sound_Handle       sound;
+	f32                gain;
+	f32                pan;
+	bool               loop;
+};
+
+struct Voice {
+	Voice_Id     id;
+	Sound_Handle sound;
+	u32          frame;
+	s16          gains[2]; // Left and right, Q15.
+	bool         loop;
 };
 
-Array<Sound> sound_data = make_array<Sound>(256, 0); // @TEMP
+struct Mixer {
+	// Filled in before any command that plays them is pushed, and never moved after.
+	Sound        sounds[MAX_SOUNDS];
+	volatile u32 num_sounds;
+	char *       sound_names[MAX_SOUNDS]; // Game thread only.
+
+	Semaphore_Handle stream_semaphore; // Posted by the mixer when a stream wants filling.
+	volatile u32     num_dry_frames;   // Frames streams came up short by, counted by the mixer for the game thread to report.
+
+	Sound_Command    commands[SOUND_COMMAND_QUEUE_LENGTH];
+	volatile u32     command_read_head;
+	volatile u32     command_write_head;
+	Voice_Id         next_voice_id; // Game thread only.
+
+	// Mixer thread only.
+	Voice voices[MAX_SOUND_VOICES];
+	u32   num_voices;
+
+	bool running;
+} mixer;
+
+Sound_Handle debug_sound = NO_SOUND;
+Sound_Handle debug_track = NO_SOUND;
+
+//
+// Mix kernels. Each adds a run of interleaved stereo samples, scaled by a Q15 gain per channel, onto the output with
+// saturation. They all round the same way, so they give bit for bit the same output.
+//
+
+typedef void (*Mix_Kernel)(s16 *out, const s16 *in, u32 num_samples, s16 left_gain, s16 right_gain);
 
 void
-sound_load(const char *path, Memory_Arena *ma)
+mix_samples_scalar(s16 *out, const s16 *in, u32 num_samples, s16 left_gain, s16 right_gain)
 {
-	String wav_file_string = read_entire_file(path, ma);
-	const char *wav_file = wav_file_string.data;
+	for (u32 i = 0; i < num_samples; ++i) {
+		s32 gain   = (i & 1) ? right_gain : left_gain;
+		s32 scaled = ((in[i] * gain) + 0x4000) >> 15;
+		s32 sum    = out[i] + scaled;
+		out[i] = (sum > 32767) ? 32767 : (sum < -32768) ? -32768 : sum;
+	}
+}
 
-	wav_file += 4;
+#ifdef MIX_KERNELS_X86
+
+__attribute__((target("ssse3"))) void
+mix_samples_ssse3(s16 *out, const s16 *in, u32 num_samples, s16 left_gain, s16 right_gain)
+{
+	__m128i gains = _mm_set_epi16(right_gain, left_gain, right_gain, left_gain, right_gain, left_gain, right_gain, left_gain);
+
+	u32 i = 0;
+	for (; i + 8 <= num_samples; i += 8) {
+		__m128i scaled = _mm_mulhrs_epi16(_mm_loadu_si128((__m128i *)&in[i]), gains);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_adds_epi16(_mm_loadu_si128((__m128i *)&out[i]), scaled));
+	}
+	mix_samples_scalar(&out[i], &in[i], num_samples - i, left_gain, right_gain);
+}
+
+__attribute__((target("avx2"))) void
+mix_samples_avx2(s16 *out, const s16 *in, u32 num_samples, s16 left_gain, s16 right_gain)
+{
+	__m256i gains = _mm256_set1_epi32(((u32)(u16)right_gain << 16) | (u16)left_gain);
+
+	u32 i = 0;
+	for (; i + 16 <= num_samples; i += 16) {
+		__m256i scaled = _mm256_mulhrs_epi16(_mm256_loadu_si256((__m256i *)&in[i]), gains);
+		_mm256_storeu_si256((__m256i *)&out[i], _mm256_adds_epi16(_mm256_loadu_si256((__m256i *)&out[i]), scaled));
+	}
+	mix_samples_scalar(&out[i], &in[i], num_samples - i, left_gain, right_gain);
+}
+
+#endif
+
+Mix_Kernel mix_samples = NULL;
+
+void
+select_mix_kernel()
+{
+#ifdef MIX_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		mix_samples = mix_samples_avx2;
+		log_print(STANDARD_LOG, "Using the AVX2 mix kernel.");
+	} else if (__builtin_cpu_supports("ssse3")) {
+		mix_samples = mix_samples_ssse3;
+		log_print(STANDARD_LOG, "Using the SSSE3 mix kernel.");
+	} else {
+		mix_samples = mix_samples_scalar;
+		log_print(STANDARD_LOG, "Using the scalar mix kernel.");
+	}
+#else
+	mix_samples = mix_samples_scalar;
+	log_print(STANDARD_LOG, "Using the scalar mix kernel.");
+#endif
+}
+
+//
+// Loading.
+//
+
+Sound_Handle
+add_sound(const char *name, Sound s)
+{
+	if (mixer.num_sounds == MAX_SOUNDS) {
+		log_print(MAJOR_ERROR_LOG, "Ran out of sounds loading %s.", name);
+		return NO_SOUND;
+	}
 
-	u32 wav_file_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
+	u32 handle = mixer.num_sounds;
+	mixer.sounds[handle]      = s;
+	mixer.sound_names[handle] = (char *)emalloc(strlen(name) + 1);
+	strcpy(mixer.sound_names[handle], name);
+	__atomic_store_n(&mixer.num_sounds, handle + 1, __ATOMIC_RELEASE);
+	return handle;
+}
 
-	wav_file += 8;
+// Looks a sound up by the name it was loaded with, its path or its name in the asset file.
+Sound_Handle
+get_sound(const char *name)
+{
+	for (u32 i = 0; i < mixer.num_sounds; ++i) {
+		if (strcmp(name, mixer.sound_names[i]) == 0) {
+			return i;
+		}
+	}
 
-	u32 format_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u16 format_type        = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u16 num_channels       = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u32 sample_rate        = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u32 bytes_per_second   = READ_AND_ADVANCE_STREAM(u32, wav_file);
-	u16 bytes_per_frame    = READ_AND_ADVANCE_STREAM(u16, wav_file);
-	u16 bits_per_sample    = READ_AND_ADVANCE_STREAM(u16, wav_file);
+	log_print(MINOR_ERROR_LOG, "Tried to get sound that was not loaded: %s.", name);
+	return NO_SOUND;
+}
 
-	char chunk_name[5] = {};
-	strncpy(chunk_name, wav_file, 4);
+extern const char *asset_file_path;
 
-	while (strcmp(chunk_name, "data") != 0) {
-		wav_file += 4;
-		u32 chunk_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
-		wav_file += chunk_data_length;
+// Adds every sound in the asset file. The packer already converted them to the format the device is asked for, so when the
+// device took it short sounds are played straight out of the mapped file, with nothing parsed or converted, and long ones are
+// streamed out of it a chunk at a time like a long wav file. Returns false, having logged why, if there were no sounds to add.
+// The file stays mapped for as long as the game runs.
+bool
+sound_load_packed(const char *path)
+{
+	size_t file_size = 0;
+	const char *file = platform_map_file(path, &file_size);
+	if (!file) {
+		log_print(MINOR_ERROR_LOG, "Could not read the asset file %s.", path);
+		return false;
+	}
 
-		strncpy(chunk_name, wav_file, 4);
+	const Asset_File_Footer *footer     = (const Asset_File_Footer *)(file + file_size - sizeof(Asset_File_Footer));
+	u32                      num_assets = (file_size >= sizeof(Asset_File_Footer)) ? footer->num_assets : 0;
+	if (file_size < sizeof(Asset_File_Footer)
+	 || footer->asset_offsets_start + ((u64)num_assets * sizeof(File_Offset)) > file_size
+	 || footer->asset_types_start + ((u64)num_assets * sizeof(Asset_Type)) > file_size
+	 || footer->asset_names_start > file_size) {
+		log_print(MAJOR_ERROR_LOG, "The asset file %s is cut off.", path);
+		platform_unmap_file(file, file_size);
+		return false;
 	}
 
-	wav_file += 4;
+	const File_Offset *offsets   = (const File_Offset *)(file + footer->asset_offsets_start);
+	const Asset_Type * types     = (const Asset_Type *)(file + footer->asset_types_start);
+	const char *       names     = file + footer->asset_names_start;
+	const char *       names_end = file + file_size - sizeof(Asset_File_Footer);
+	size_t             page_size = platform_get_page_size();
 
-	u32 sample_data_length = READ_AND_ADVANCE_STREAM(u32, wav_file);
+	u32 num_loaded = 0;
+	for (u32 i = 0; i < num_assets && names + 8 <= names_end; ++i) {
+		u32 name_length = READ_AND_ADVANCE_STREAM(u32, names);
+		u32 id          = READ_AND_ADVANCE_STREAM(u32, names);
+		const char *name_start = names;
+		names += name_length;
+		if (names > names_end || id >= num_assets || types[id] != SOUND_ASSET_TYPE) {
+			continue;
+		}
 
-	printf("%u\n%u\n%u\n%u\n%u\n%u\n%u\n%u\n", format_data_length, format_type, num_channels, sample_rate, bytes_per_second, bytes_per_frame, bits_per_sample, sample_data_length); 
+		char name[256];
+		snprintf(name, sizeof(name), "%.*s", name_length, name_start);
 
-	assert((num_channels == 1 || num_channels == 2) && num_channels <= pcm_playback_info.num_channels);
+		const Sound_Header *header  = (const Sound_Header *)(file + offsets[id]);
+		const char *        samples = (const char *)(header + 1);
+		if (offsets[id] + sizeof(Sound_Header) > file_size
+		 || header->bits_per_sample != 16 || header->num_channels == 0 || header->num_channels > MAX_SAMPLE_CHANNELS
+		 || offsets[id] + sizeof(Sound_Header) + ((u64)header->num_frames * header->num_channels * sizeof(s16)) > file_size) {
+			log_print(MAJOR_ERROR_LOG, "The sound %s in the asset file %s is corrupt.", name, path);
+			continue;
+		}
 
-	Sound s;
-	s.num_frames = sample_data_length / bytes_per_frame;
-	//s.bytes_per_frame = bytes_per_frame;
+		Sample_Source source = {};
+		source.format          = SAMPLE_FORMAT_S16;
+		source.num_channels    = header->num_channels;
+		source.bytes_per_frame = header->num_channels * sizeof(s16);
+		source.num_frames      = header->num_frames;
+		source.samples         = samples;
+		set_sample_source_output_rate(&source, header->sample_rate, pcm_playback_info.sample_rate);
 
-	if (num_channels == pcm_playback_info.num_channels) {
-		s.samples = (char *)malloc(sample_data_length);
-		memcpy(s.samples, wav_file, sample_data_length);
-	} else if (num_channels == 1 && pcm_playback_info.num_channels == 2) {
-		s.samples = (char *)malloc(sample_data_length * 2);
+		Sound s = {};
+		s.num_frames = source.num_output_frames;
+		if (source.num_output_frames >= SOUND_STREAM_MIN_SECONDS * pcm_playback_info.sample_rate) {
+			Sound_Stream *st = (Sound_Stream *)emalloc(sizeof(Sound_Stream));
+			*st = {};
+			st->file      = file;
+			st->file_size = file_size;
+			st->source    = source;
+			st->ring      = (s16 *)emalloc(SOUND_STREAM_RING_FRAMES * pcm_playback_info.bytes_per_frame);
+			s.stream = st;
+		} else if (header->num_channels == pcm_playback_info.num_channels && header->sample_rate == pcm_playback_info.sample_rate && (offsets[id] & 1) == 0) {
+			s.samples = (s16 *)samples;
 
-		s16 *stored_samples = (s16 *)s.samples;
-		s16 *file_samples   = (s16 *)wav_file;
+			// Read every page in now, rather than on the mixer thread the first time the sound plays.
+			size_t num_bytes = (size_t)s.num_frames * pcm_playback_info.bytes_per_frame;
+			for (size_t j = 0; j < num_bytes; j += page_size) {
+				(void)((volatile const char *)samples)[j];
+			}
+		} else {
+			// The device came up in some other format.
+			s.samples = (s16 *)emalloc(s.num_frames * pcm_playback_info.bytes_per_frame);
+			convert_sample_frames(s.samples, pcm_playback_info.num_channels, &source, 0, s.num_frames);
+		}
 
-		for (u32 i = 0; i < s.num_frames; ++i) {
-			stored_samples[i * 2]     = *file_samples;
-			stored_samples[i * 2 + 1] = *file_samples;
-			++file_samples;
+		if (add_sound(name, s) != NO_SOUND) {
+			num_loaded += 1;
 		}
-	} else {
-		_abort("The wav file '%s' has %u channels, while the PCM has %u channels. This is unexpected and the sound code will probably not work.", path, num_channels, pcm_playback_info.num_channels);
 	}
 
-	sound_data.push(s);
+	if (num_loaded == 0) {
+		log_print(MINOR_ERROR_LOG, "The asset file %s has no sounds in it.", path);
+		platform_unmap_file(file, file_size);
+		return false;
+	}
+
+	log_print(STANDARD_LOG, "Loaded %u packed sounds from %s.", num_loaded, path);
+	return true;
+}
+
+// Loads all of the sound's samples, for short sounds.
+Sound_Handle
+sound_load(const char *path)
+{
+	size_t file_size = 0;
+	const char *file = platform_map_file(path, &file_size);
+	if (!file) {
+		log_print(MAJOR_ERROR_LOG, "Could not read the wav file %s.", path);
+		return NO_SOUND;
+	}
+	DEFER(platform_unmap_file(file, file_size));
+
+	Sample_Source source;
+	if (!parse_wav(path, file, file_size, pcm_playback_info.sample_rate, &source)) {
+		return NO_SOUND;
+	}
+
+	Sound s = {};
+	s.num_frames = source.num_output_frames;
+	s.samples    = (s16 *)emalloc(s.num_frames * pcm_playback_info.bytes_per_frame);
+	convert_sample_frames(s.samples, pcm_playback_info.num_channels, &source, 0, s.num_frames);
+
+	return add_sound(path, s);
 }
 
+// Keeps the file mapped and streams the sound out of it, for long sounds.
+Sound_Handle
+sound_load_stream(const char *path)
+{
+	size_t file_size = 0;
+	const char *file = platform_map_file(path, &file_size);
+	if (!file) {
+		log_print(MAJOR_ERROR_LOG, "Could not read the wav file %s.", path);
+		return NO_SOUND;
+	}
+
+	Sound_Stream *st = (Sound_Stream *)emalloc(sizeof(Sound_Stream));
+	*st = {};
+	if (!parse_wav(path, file, file_size, pcm_playback_info.sample_rate, &st->source)) {
+		platform_unmap_file(file, file_size);
+		free(st);
+		return NO_SOUND;
+	}
+	st->file      = file;
+	st->file_size = file_size;
+	st->ring      = (s16 *)emalloc(SOUND_STREAM_RING_FRAMES * pcm_playback_info.bytes_per_frame);
+
+	Sound s = {};
+	s.num_frames = st->source.num_output_frames;
+	s.stream     = st;
+
+	return add_sound(path, s);
+}
+
+//
+// Stream thread.
+//
+
+// Converts chunks out of the file until the ring is as full as it can get without overwriting what the mixer hasn't played.
 void
-sound_do()
-{
-	Sound fur_elise = sound_data[0];
-	Sound speech = sound_data[1];
-
-	static u32 frames_written = 0;
-	static char *fe_samples = fur_elise.samples;
-	//static s16 *sp_samples = (s16 *)speech.samples;
-	static char *sp_samples = speech.samples;
-	static u32 ii = 0;
-
-	s16 period_buffer[pcm_playback_info.bytes_per_period];
-
-	//if (frames_written < fur_elise.num_frames && platform_pcm_less_than_one_period_left_in_buffer()) {
-	if (frames_written < fur_elise.num_frames && platform_pcm_less_than_one_period_left_in_buffer()) {
-		u32 num_frames_to_write = u32_min(pcm_playback_info.frames_per_period, speech.num_frames - frames_written);
-		u32 num_bytes_to_write = num_frames_to_write * pcm_playback_info.bytes_per_frame;
-		printf("%u %u\n", num_bytes_to_write, pcm_playback_info.bytes_per_period);
-		memcpy(period_buffer, fe_samples, pcm_playback_info.bytes_per_period);
-
-		//if (frames_written > fur_elise.num_frames / 30) {
-		s16 *this_sp = (s16 *)sp_samples;
-		for (u32 i = 0; i < pcm_playback_info.frames_per_period * 2 && ii < speech.num_frames * 2; ++i) {
-			period_buffer[i] += *this_sp++;
-			++ii;
+fill_sound_stream(Sound_Stream *st)
+{
+	Sample_Source *source       = &st->source;
+	u32            num_channels = pcm_playback_info.num_channels;
+	size_t         page_size    = platform_get_page_size();
+
+	while (SOUND_STREAM_RING_FRAMES - (st->write_frame - __atomic_load_n(&st->read_frame, __ATOMIC_ACQUIRE)) >= SOUND_STREAM_CHUNK_FRAMES) {
+		if (st->frame == source->num_output_frames) {
+			if (!st->looping || source->num_output_frames == 0) {
+				break;
+			}
+			st->frame = 0;
 		}
-		//}
-
-		s32 frames_written_this_call = platform_pcm_write_period(period_buffer);
-		if (frames_written_this_call > 0) {
-			fe_samples += frames_written_this_call * pcm_playback_info.bytes_per_frame;
-		//if (frames_written > fur_elise.num_frames / 30) {
-			sp_samples += frames_written_this_call * pcm_playback_info.bytes_per_frame;
-		//}
-			frames_written += frames_written_this_call;
+
+		u32 num_frames = u32_min(SOUND_STREAM_CHUNK_FRAMES, source->num_output_frames - st->frame);
+
+		// The chunk can run off the end of the ring and carry on at the start.
+		u32 ring_frame    = st->write_frame & (SOUND_STREAM_RING_FRAMES - 1);
+		u32 num_first_run = u32_min(num_frames, SOUND_STREAM_RING_FRAMES - ring_frame);
+		convert_sample_frames(&st->ring[ring_frame * num_channels], num_channels, source, st->frame, num_first_run);
+		convert_sample_frames(st->ring, num_channels, source, st->frame + num_first_run, num_frames - num_first_run);
+		st->frame += num_frames;
+
+		// Hand back the pages that have been converted out, or the whole file would end up resident as it played. Only the
+		// sound's own pages, since a packed sound shares the file with the other assets.
+		u32    source_frame   = ((u64)st->frame * source->step) >> 32;
+		size_t samples_offset = source->samples - st->file;
+		size_t copied_offset  = samples_offset + ((size_t)source_frame * source->bytes_per_frame);
+		if (st->released_offset < samples_offset || copied_offset < st->released_offset) {
+			st->released_offset = samples_offset; // Just started, or looped back to the start.
 		}
+		platform_release_mapped_pages(st->file, st->released_offset, copied_offset - st->released_offset);
+		st->released_offset = copied_offset & ~(page_size - 1);
+
+		__atomic_store_n(&st->write_frame, st->write_frame + num_frames, __ATOMIC_RELEASE);
+	}
+}
 
-		if (frames_written == fur_elise.num_frames) {
-			platform_pcm_close_device();
+void *
+sound_stream_thread_start(void *)
+{
+	while (true) {
+		platform_wait_semaphore(&mixer.stream_semaphore);
+
+		u32 num_sounds = __atomic_load_n(&mixer.num_sounds, __ATOMIC_ACQUIRE);
+		for (u32 i = 0; i < num_sounds; ++i) {
+			Sound_Stream *st = mixer.sounds[i].stream;
+			if (!st) {
+				continue;
+			}
+
+			// The mixer doesn't touch the ring while it's starting over. If it's played again while this start is being filled,
+			// the generation will have moved on again and it starts over once more, with that play's loop flag.
+			u32 generation = __atomic_load_n(&st->rewind_generation, __ATOMIC_ACQUIRE);
+			if (generation != st->rewound_generation) {
+				st->frame       = 0;
+				st->looping     = st->loop;
+				st->write_frame = 0;
+				st->read_frame  = 0;
+				fill_sound_stream(st);
+				__atomic_store_n(&st->rewound_generation, generation, __ATOMIC_RELEASE);
+			} else {
+				fill_sound_stream(st);
+			}
 		}
-#if 0
-		//s32 frames_written_this_call = snd_pcm_writei(linux_context.pcm_handle, samples, pcm_playback_info.frames_per_period);
-
-		if (frames_written_this_call == -EPIPE) {
-			log_print(MINOR_ERROR_LOG, "PCM underrun occurred.\n");
-			snd_pcm_prepare(linux_context.pcm_handle);
-			// @TODO: Exit early?
-		} else if (frames_written_this_call < 0) {
-			log_print(MINOR_ERROR_LOG, "Error from snd_pcm_writei: %s.\n", snd_strerror(frames_written_this_call));
-			// @TODO: Exit early?
-		} else {
-			if (frames_written_this_call != (s32)pcm_playback_info.frames_per_period) {
-				log_print(MINOR_ERROR_LOG, "PCM short write, wrote %d frames and expected %d.\n", frames_written_this_call, (s32)pcm_playback_info.frames_per_period);
+	}
+
+	return NULL;
+}
+
+//
+// Game side.
+//
+
+bool
+push_sound_command(Sound_Command c)
+{
+	if (!mixer.running) {
+		return false;
+	}
+
+	u32 write_head = mixer.command_write_head;
+	if (write_head - __atomic_load_n(&mixer.command_read_head, __ATOMIC_ACQUIRE) == SOUND_COMMAND_QUEUE_LENGTH) {
+		log_print(MINOR_ERROR_LOG, "The sound command queue is full, dropping a command.");
+		return false;
+	}
+
+	mixer.commands[write_head % SOUND_COMMAND_QUEUE_LENGTH] = c;
+	__atomic_store_n(&mixer.command_write_head, write_head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Pan goes from -1 (left) to 1 (right). Returns the id to stop or change the voice with, or NO_VOICE_ID if it won't play.
+Voice_Id
+play_sound(Sound_Handle sound, f32 gain = 1.0f, f32 pan = 0.0f, bool loop = false)
+{
+	if (sound == NO_SOUND) {
+		return NO_VOICE_ID;
+	}
+
+	mixer.next_voice_id += 1;
+	if (mixer.next_voice_id == NO_VOICE_ID) {
+		mixer.next_voice_id += 1;
+	}
+
+	Sound_Command c = { PLAY_SOUND_COMMAND, mixer.next_voice_id, sound, gain, pan, loop };
+	return push_sound_command(c) ? c.voice_id : NO_VOICE_ID;
+}
+
+void
+stop_voice(Voice_Id id)
+{
+	push_sound_command({ STOP_VOICE_COMMAND, id, NO_SOUND, 0.0f, 0.0f, false });
+}
+
+void
+set_voice_gain_and_pan(Voice_Id id, f32 gain, f32 pan)
+{
+	push_sound_command({ SET_VOICE_COMMAND, id, NO_SOUND, gain, pan, false });
+}
+
+//
+// Mixer thread.
+//
+
+void
+set_voice_gains(Voice *v, f32 gain, f32 pan)
+{
+	gain = clamp(gain, 0.0f, 1.0f);
+	pan  = clamp(pan, -1.0f, 1.0f);
+
+	v->gains[0] = fmin(gain * (1.0f - pan), gain) * 32767.0f;
+	v->gains[1] = fmin(gain * (1.0f + pan), gain) * 32767.0f;
+}
+
+Voice *
+find_voice(Voice_Id id)
+{
+	for (u32 i = 0; i < mixer.num_voices; ++i) {
+		if (mixer.voices[i].id == id) {
+			return &mixer.voices[i];
+		}
+	}
+	return NULL;
+}
+
+void
+do_sound_commands()
+{
+	u32 read_head  = mixer.command_read_head;
+	u32 write_head = __atomic_load_n(&mixer.command_write_head, __ATOMIC_ACQUIRE);
+
+	for (; read_head != write_head; ++read_head) {
+		Sound_Command *c = &mixer.commands[read_head % SOUND_COMMAND_QUEUE_LENGTH];
+
+		switch (c->type) {
+		case PLAY_SOUND_COMMAND: {
+			Sound_Stream *st = mixer.sounds[c->sound].stream;
+			if (st) {
+				for (u32 i = 0; i < mixer.num_voices;) {
+					if (mixer.voices[i].sound == c->sound) {
+						mixer.voices[i] = mixer.voices[--mixer.num_voices];
+					} else {
+						++i;
+					}
+				}
+				st->loop = c->loop;
+				__atomic_store_n(&st->rewind_generation, st->rewind_generation + 1, __ATOMIC_RELEASE);
+				platform_post_semaphore(&mixer.stream_semaphore);
+			}
+
+			if (mixer.num_voices == MAX_SOUND_VOICES) {
+				log_print(MINOR_ERROR_LOG, "Ran out of voices, not playing sound %u.", c->sound);
+				break;
+			}
+			Voice *v = &mixer.voices[mixer.num_voices++];
+			v->id    = c->voice_id;
+			v->sound = c->sound;
+			v->frame = 0;
+			v->loop  = c->loop;
+			set_voice_gains(v, c->gain, c->pan);
+		} break;
+
+		case STOP_VOICE_COMMAND: {
+			Voice *v = find_voice(c->voice_id);
+			if (v) {
+				*v = mixer.voices[--mixer.num_voices];
 			}
+		} break;
+
+		case SET_VOICE_COMMAND: {
+			Voice *v = find_voice(c->voice_id);
+			if (v) {
+				set_voice_gains(v, c->gain, c->pan);
+			}
+		} break;
 		}
-#endif
 	}
+
+	__atomic_store_n(&mixer.command_read_head, read_head, __ATOMIC_RELEASE);
 }
 
 void
-sound_init()
+mix_period(s16 *out, u32 num_frames)
+{
+	u32 num_channels = pcm_playback_info.num_channels;
+
+	memset(out, 0, num_frames * num_channels * sizeof(s16));
+
+	bool streamed = false;
+	for (u32 i = 0; i < mixer.num_voices;) {
+		Voice *v = &mixer.voices[i];
+		Sound *s = &mixer.sounds[v->sound];
+
+		if (s->stream) {
+			Sound_Stream *st = s->stream;
+			streamed = true;
+
+			// Stays quiet until the start of the stream is in the ring.
+			if (__atomic_load_n(&st->rewound_generation, __ATOMIC_ACQUIRE) != st->rewind_generation) {
+				++i;
+				continue;
+			}
+
+			u32 read_frame    = st->read_frame;
+			u32 n             = u32_min(num_frames, __atomic_load_n(&st->write_frame, __ATOMIC_ACQUIRE) - read_frame);
+			u32 ring_frame    = read_frame & (SOUND_STREAM_RING_FRAMES - 1);
+			u32 num_first_run = u32_min(n, SOUND_STREAM_RING_FRAMES - ring_frame);
+			mix_samples(out, &st->ring[ring_frame * num_channels], num_first_run * num_channels, v->gains[0], v->gains[1]);
+			mix_samples(&out[num_first_run * num_channels], st->ring, (n - num_first_run) * num_channels, v->gains[0], v->gains[1]);
+			__atomic_store_n(&st->read_frame, read_frame + n, __ATOMIC_RELEASE);
+
+			if (!v->loop && read_frame + n == s->num_frames) {
+				*v = mixer.voices[--mixer.num_voices];
+				continue;
+			}
+			if (n < num_frames) {
+				__atomic_add_fetch(&mixer.num_dry_frames, num_frames - n, __ATOMIC_RELAXED); // No logging on the mixer thread.
+			}
+			++i;
+			continue;
+		}
+
+		u32 frames_mixed = 0;
+		while (frames_mixed < num_frames && v->frame < s->num_frames) {
+			u32 n = u32_min(num_frames - frames_mixed, s->num_frames - v->frame);
+			mix_samples(&out[frames_mixed * num_channels], &s->samples[v->frame * num_channels], n * num_channels, v->gains[0], v->gains[1]);
+
+			frames_mixed += n;
+			v->frame     += n;
+			if (v->loop && v->frame == s->num_frames) {
+				v->frame = 0;
+			}
+		}
+
+		if (v->frame == s->num_frames) {
+			*v = mixer.voices[--mixer.num_voices];
+		} else {
+			++i;
+		}
+	}
+
+	if (streamed) {
+		platform_post_semaphore(&mixer.stream_semaphore);
+	}
+}
+
+void *
+mixer_thread_start(void *)
 {
-	platform_pcm_open_device();
+	while (true) {
+		do_sound_commands();
+
+		u32 num_frames = 0;
+		s16 *out = platform_pcm_begin_period(&num_frames); // Blocks until the device has room for the period.
+		if (!out) {
+			log_print(MAJOR_ERROR_LOG, "Lost the sound device, stopping the mixer.");
+			__atomic_store_n(&mixer.running, false, __ATOMIC_RELAXED);
+			break;
+		}
+		mix_period(out, num_frames);
+		platform_pcm_end_period(num_frames);
+	}
 
-	auto ma = mem_make_arena();
-	sound_load("../data/sounds/fur_elise.wav", &ma);
-	sound_load("../data/sounds/edited_random_sound.wav", &ma);
+	return NULL;
 }
 
+// Called once a frame on the game thread, to report what the mixer thread can't without risking an underrun.
+void
+sound_update()
+{
+	u32 num_dry_frames = __atomic_exchange_n(&mixer.num_dry_frames, 0, __ATOMIC_RELAXED);
+	if (num_dry_frames > 0) {
+		log_print(MINOR_ERROR_LOG, "Sound streams ran dry, %u frames short since the last frame.", num_dry_frames);
+	}
+}
+
+void
+sound_init()
+{
+	if (!platform_pcm_open_device(SOUND_FRAMES_PER_PERIOD, SOUND_PERIODS_PER_BUFFER)) {
+		log_print(MAJOR_ERROR_LOG, "Running without sound.");
+		return;
+	}
+
+	select_mix_kernel();
+	select_sample_kernels();
+
+	// Falls back to converting the wav files when the assets haven't been packed.
+	if (sound_load_packed(asset_file_path)) {
+		debug_sound = get_sound("RANDOM_SOUND_SOUND");
+		debug_track = get_sound("EDITED_RANDOM_SOUND_SOUND");
+	} else {
+		debug_sound = sound_load("../data/sounds/random_sound.wav");
+		debug_track = sound_load_stream("../data/sounds/edited_random_sound.wav");
+	}
+
+	mixer.stream_semaphore = platform_make_semaphore(0);
+	mixer.running          = true;
+	platform_create_thread(sound_stream_thread_start, NULL);
+	platform_create_thread(mixer_thread_start, NULL);
+}
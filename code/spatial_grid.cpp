@@ -0,0 +1,243 @@
+#define NO_SPATIAL_GRID_CELL ((u32)-1)
+
+Spatial_Grid
+make_spatial_grid(f32 cell_side, u32 initial_table_size = 1024)
+{
+	assert(cell_side > 0.0f);
+	assert((initial_table_size & (initial_table_size - 1)) == 0);
+
+	Spatial_Grid g;
+	g.cell_side    = cell_side;
+	g.cells        = make_array<Spatial_Grid_Cell>(initial_table_size / 2, 0);
+	g.table        = make_array<u32>(initial_table_size, initial_table_size);
+	g.query_stamps = make_array<u32>(256, 0);
+	g.query_stamp  = 0;
+	g.num_id_lists = 0;
+
+	memset(g.table.data, 0xFF, g.table.size * sizeof(u32));
+
+	return g;
+}
+
+u32
+spatial_grid_hash(s32 x, s32 y)
+{
+	return ((u32)x * 73856093u) ^ ((u32)y * 19349663u);
+}
+
+void
+spatial_grid_grow_table(Spatial_Grid *g)
+{
+	size_t new_size = g->table.size * 2;
+	g->table.resize(new_size);
+	memset(g->table.data, 0xFF, new_size * sizeof(u32));
+
+	u32 mask = new_size - 1;
+	for (u32 i = 0; i < g->cells.size; ++i) {
+		u32 slot = spatial_grid_hash(g->cells[i].x, g->cells[i].y) & mask;
+		while (g->table[slot] != NO_SPATIAL_GRID_CELL) {
+			slot = (slot + 1) & mask;
+		}
+		g->table[slot] = i;
+	}
+}
+
+// Returns NULL if the cell doesn't exist and create is false.
+Spatial_Grid_Cell *
+spatial_grid_find_cell(Spatial_Grid *g, s32 x, s32 y, bool create)
+{
+	u32 mask = g->table.size - 1;
+	u32 slot = spatial_grid_hash(x, y) & mask;
+
+	while (g->table[slot] != NO_SPATIAL_GRID_CELL) {
+		Spatial_Grid_Cell *c = &g->cells[g->table[slot]];
+		if (c->x == x && c->y == y) {
+			return c;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	// Keep the load factor under a half so probe runs stay short.
+	if ((g->cells.size + 1) * 2 > g->table.size) {
+		spatial_grid_grow_table(g);
+		return spatial_grid_find_cell(g, x, y, true);
+	}
+
+	// Reuse the id list an emptied cell left behind, so something moving around the world doesn't keep allocating.
+	Array<u32> ids;
+	if (g->cells.size < g->num_id_lists) {
+		ids      = g->cells.data[g->cells.size].ids;
+		ids.size = 0;
+	} else {
+		ids = make_array<u32>(4, 0);
+		g->num_id_lists += 1;
+	}
+
+	g->table[slot] = g->cells.size;
+	array_add(&g->cells, (Spatial_Grid_Cell){ x, y, ids });
+
+	return &g->cells.last();
+}
+
+u32
+spatial_grid_find_slot(Spatial_Grid *g, s32 x, s32 y)
+{
+	u32 mask = g->table.size - 1;
+	u32 slot = spatial_grid_hash(x, y) & mask;
+	while (g->cells[g->table[slot]].x != x || g->cells[g->table[slot]].y != y) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Drops an empty cell. The table entry is deleted by shifting the rest of its probe run back, so lookups never need
+// tombstones. The last cell is swapped into the hole, and the dropped cell's id list is parked just past the end for
+// spatial_grid_find_cell() to pick up.
+void
+spatial_grid_free_cell(Spatial_Grid *g, s32 x, s32 y)
+{
+	u32 mask  = g->table.size - 1;
+	u32 hole  = spatial_grid_find_slot(g, x, y);
+	u32 index = g->table[hole];
+
+	g->table[hole] = NO_SPATIAL_GRID_CELL;
+	for (u32 next = (hole + 1) & mask; g->table[next] != NO_SPATIAL_GRID_CELL; next = (next + 1) & mask) {
+		Spatial_Grid_Cell *c = &g->cells[g->table[next]];
+		u32 home = spatial_grid_hash(c->x, c->y) & mask;
+
+		// The entry can move back if the hole sits between its home slot and where it is now.
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			g->table[hole] = g->table[next];
+			g->table[next] = NO_SPATIAL_GRID_CELL;
+			hole = next;
+		}
+	}
+
+	u32 last = g->cells.size - 1;
+	if (index != last) {
+		g->table[spatial_grid_find_slot(g, g->cells[last].x, g->cells[last].y)] = index;
+
+		Spatial_Grid_Cell freed = g->cells[index];
+		g->cells[index] = g->cells[last];
+		g->cells[last]  = freed;
+	}
+	g->cells.size -= 1;
+}
+
+// Drops every id. The cells' id lists stay parked for reuse.
+void
+spatial_grid_clear(Spatial_Grid *g)
+{
+	g->cells.size = 0;
+	memset(g->table.data, 0xFF, g->table.size * sizeof(u32));
+}
+
+// Inclusive range of cells touched by the rectangle. Two rectangles that overlap or touch always share at least one cell.
+void
+spatial_grid_cell_range(Spatial_Grid *g, Rectangle r, s32 *min_x, s32 *min_y, s32 *max_x, s32 *max_y)
+{
+	assert(!isnan(r.x) && !isnan(r.y) && !isnan(r.w) && !isnan(r.h));
+
+	*min_x = floor(r.x / g->cell_side);
+	*min_y = floor(r.y / g->cell_side);
+	*max_x = floor((r.x + r.w) / g->cell_side);
+	*max_y = floor((r.y + r.h) / g->cell_side);
+}
+
+void
+spatial_grid_insert(Spatial_Grid *g, u32 id, Rectangle r)
+{
+	if (id >= g->query_stamps.size) {
+		size_t old_size = g->query_stamps.size;
+		g->query_stamps.resize(id + 1);
+		memset(&g->query_stamps.data[old_size], 0, (g->query_stamps.size - old_size) * sizeof(u32));
+	}
+
+	s32 min_x, min_y, max_x, max_y;
+	spatial_grid_cell_range(g, r, &min_x, &min_y, &max_x, &max_y);
+
+	for (s32 y = min_y; y <= max_y; ++y) {
+		for (s32 x = min_x; x <= max_x; ++x) {
+			array_add(&spatial_grid_find_cell(g, x, y, true)->ids, id);
+		}
+	}
+}
+
+// The rectangle has to be the same one the id was inserted (or last moved) with.
+void
+spatial_grid_remove(Spatial_Grid *g, u32 id, Rectangle r)
+{
+	s32 min_x, min_y, max_x, max_y;
+	spatial_grid_cell_range(g, r, &min_x, &min_y, &max_x, &max_y);
+
+	for (s32 y = min_y; y <= max_y; ++y) {
+		for (s32 x = min_x; x <= max_x; ++x) {
+			Spatial_Grid_Cell *c = spatial_grid_find_cell(g, x, y, false);
+			assert(c);
+
+			for (u32 i = 0; i < c->ids.size; ++i) {
+				if (c->ids[i] == id) {
+					c->ids[i] = c->ids.last();
+					c->ids.size -= 1;
+					break;
+				}
+			}
+
+			if (c->ids.size == 0) {
+				spatial_grid_free_cell(g, x, y);
+			}
+		}
+	}
+}
+
+void
+spatial_grid_move(Spatial_Grid *g, u32 id, Rectangle old_r, Rectangle new_r)
+{
+	s32 old_min_x, old_min_y, old_max_x, old_max_y;
+	s32 new_min_x, new_min_y, new_max_x, new_max_y;
+	spatial_grid_cell_range(g, old_r, &old_min_x, &old_min_y, &old_max_x, &old_max_y);
+	spatial_grid_cell_range(g, new_r, &new_min_x, &new_min_y, &new_max_x, &new_max_y);
+
+	// Most moves stay inside the same cells.
+	if (old_min_x == new_min_x && old_min_y == new_min_y && old_max_x == new_max_x && old_max_y == new_max_y) {
+		return;
+	}
+
+	spatial_grid_remove(g, id, old_r);
+	spatial_grid_insert(g, id, new_r);
+}
+
+// Appends the ids of everything in the cells the rectangle touches. That's a superset of what actually overlaps it, so the
+// caller still has to do the exact test. Ids come back in no particular order.
+void
+spatial_grid_query(Spatial_Grid *g, Rectangle r, Array<u32> *results)
+{
+	g->query_stamp += 1;
+	if (g->query_stamp == 0) {
+		memset(g->query_stamps.data, 0, g->query_stamps.size * sizeof(u32));
+		g->query_stamp = 1;
+	}
+
+	s32 min_x, min_y, max_x, max_y;
+	spatial_grid_cell_range(g, r, &min_x, &min_y, &max_x, &max_y);
+
+	for (s32 y = min_y; y <= max_y; ++y) {
+		for (s32 x = min_x; x <= max_x; ++x) {
+			Spatial_Grid_Cell *c = spatial_grid_find_cell(g, x, y, false);
+			if (!c) {
+				continue;
+			}
+
+			for (u32 id : c->ids) {
+				if (g->query_stamps[id] != g->query_stamp) {
+					g->query_stamps[id] = g->query_stamp;
+					array_add(results, id);
+				}
+			}
+		}
+	}
+}
@@ -1,5 +1,6 @@
 Job_Queue job_queue;
 
+#ifndef HEADLESS
 void
 gpu_make_texture_job_callback(void *job_data)
 {
@@ -8,6 +9,7 @@ gpu_make_texture_job_callback(void *job_data)
 	*(j->output_gpu_texture_handle) = gpu_make_texture(j->gl_tex_unit, j->texture_format, j->pixel_format, j->pixel_width, j->pixel_height, j->pixels);
 	*(j->asset_load_status)         = ASSET_LOADED;
 }
+#endif
 
 void
 load_asset_callback(void *callback_data)
@@ -19,7 +21,9 @@ load_asset_callback(void *callback_data)
 		load_ase(j->ase.path);
 	} break;
 	case LOAD_TEXTURE: {
+#ifndef HEADLESS
 		load_texture(j->texture.path, j->texture.base_name);
+#endif
 	} break;
 	case LOAD_SPRITE: {
 		load_sprite(j->sprite.sprite_path, j->sprite.collider_path, j->sprite.base_name);
@@ -56,7 +60,9 @@ do_all_jobs(Job_Queue *jq)
 void *
 job_thread_start(void *job_thread_data)
 {
+#ifndef HEADLESS
 	auto gl_context = platform_make_job_thread_opengl_context();
+#endif
 
 	Job_Queue *jq = (Job_Queue *)job_thread_data;
 
@@ -92,6 +98,7 @@ job_get_queue_index_for_new_job()
 }
 #endif
 
+#ifndef HEADLESS
 void
 add_gpu_make_texture_job(u32 gl_tex_unit, s32 texture_format, s32 pixel_format, s32 pixel_width, s32 pixel_height, u8 *pixels, Asset_Load_Status *als, Gpu_Texture_Handle *tid)
 {
@@ -107,6 +114,7 @@ add_gpu_make_texture_job(u32 gl_tex_unit, s32 texture_format, s32 pixel_format,
 
 	add_job(j, gpu_make_texture_job_callback, &job_queue);
 }
+#endif
 
 void *
 get_job_queue()
@@ -0,0 +1,413 @@
+#define NO_TILE_REGION ((u32)-1)
+
+Tile_Collision_Map
+make_tile_collision_map(f32 tile_side, u32 initial_table_size)
+{
+	assert(tile_side > 0.0f);
+	assert((initial_table_size & (initial_table_size - 1)) == 0);
+
+	Tile_Collision_Map m;
+	m.tile_side     = tile_side;
+	m.regions       = make_array<Tile_Region>(initial_table_size / 2, 0);
+	m.table         = make_array<u32>(initial_table_size, initial_table_size);
+	m.dirty_regions = make_array<u32>(16, 0);
+
+	memset(m.table.data, 0xFF, m.table.size * sizeof(u32));
+
+	return m;
+}
+
+void
+tile_collision_grow_table(Tile_Collision_Map *m)
+{
+	size_t new_size = m->table.size * 2;
+	m->table.resize(new_size);
+	memset(m->table.data, 0xFF, new_size * sizeof(u32));
+
+	u32 mask = new_size - 1;
+	for (u32 i = 0; i < m->regions.size; ++i) {
+		u32 slot = spatial_grid_hash(m->regions[i].x, m->regions[i].y) & mask;
+		while (m->table[slot] != NO_TILE_REGION) {
+			slot = (slot + 1) & mask;
+		}
+		m->table[slot] = i;
+	}
+}
+
+// Returns the index of the region, creating it if it doesn't exist yet.
+u32
+tile_collision_find_region(Tile_Collision_Map *m, s32 x, s32 y)
+{
+	u32 mask = m->table.size - 1;
+	u32 slot = spatial_grid_hash(x, y) & mask;
+
+	while (m->table[slot] != NO_TILE_REGION) {
+		Tile_Region *r = &m->regions[m->table[slot]];
+		if (r->x == x && r->y == y) {
+			return m->table[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if ((m->regions.size + 1) * 2 > m->table.size) {
+		tile_collision_grow_table(m);
+		return tile_collision_find_region(m, x, y);
+	}
+
+	Tile_Region r;
+	r.x             = x;
+	r.y             = y;
+	r.colliders     = make_array<Collider_Id>(8, 0);
+	r.corners       = make_array<V2>(8, 0);
+	r.dirty         = false;
+	r.corners_dirty = false;
+	memset(r.solid, 0, sizeof(r.solid));
+
+	m->table[slot] = m->regions.size;
+	array_add(&m->regions, r);
+
+	return m->regions.size - 1;
+}
+
+// The table slot holding the region, or the empty slot it would go in.
+u32
+tile_collision_find_slot(Tile_Collision_Map *m, s32 x, s32 y)
+{
+	u32 mask = m->table.size - 1;
+	u32 slot = spatial_grid_hash(x, y) & mask;
+
+	while (m->table[slot] != NO_TILE_REGION) {
+		Tile_Region *r = &m->regions[m->table[slot]];
+		if (r->x == x && r->y == y) {
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Like tile_collision_find_region(), but returns NO_TILE_REGION rather than creating the region.
+u32
+tile_collision_lookup_region(Tile_Collision_Map *m, s32 x, s32 y)
+{
+	return m->table[tile_collision_find_slot(m, x, y)];
+}
+
+// Drops a region with no tiles left, the same way spatial_grid_free_cell() drops a grid cell: the table entry's probe run
+// is shifted back over it and the last region is swapped into its place.
+void
+tile_collision_free_region(Tile_Collision_Map *m, u32 region_index)
+{
+	Tile_Region *r = &m->regions[region_index];
+	assert(r->colliders.size == 0);
+	free(r->colliders.data);
+	free(r->corners.data);
+
+	u32 mask = m->table.size - 1;
+	u32 hole = tile_collision_find_slot(m, r->x, r->y);
+
+	m->table[hole] = NO_TILE_REGION;
+	for (u32 next = (hole + 1) & mask; m->table[next] != NO_TILE_REGION; next = (next + 1) & mask) {
+		Tile_Region *moving = &m->regions[m->table[next]];
+		u32 home = spatial_grid_hash(moving->x, moving->y) & mask;
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			m->table[hole] = m->table[next];
+			m->table[next] = NO_TILE_REGION;
+			hole = next;
+		}
+	}
+
+	u32 last = m->regions.size - 1;
+	if (region_index != last) {
+		m->table[tile_collision_find_slot(m, m->regions[last].x, m->regions[last].y)] = region_index;
+		m->regions[region_index] = m->regions[last];
+	}
+	m->regions.size -= 1;
+}
+
+// Tiles sit on the grid, but their positions are products of floats, so round rather than floor.
+u8 *
+tile_collision_cell(Tile_Collision_Map *m, V2 tile_position)
+{
+	s32 tile_x = lround(tile_position.x / m->tile_side);
+	s32 tile_y = lround(tile_position.y / m->tile_side);
+	s32 region_x = floor(tile_x / (f32)TILE_REGION_SIDE);
+	s32 region_y = floor(tile_y / (f32)TILE_REGION_SIDE);
+
+	u32 region_index = tile_collision_find_region(m, region_x, region_y);
+
+	Tile_Region *r = &m->regions[region_index];
+	if (!r->dirty) {
+		r->dirty = true;
+		array_add(&m->dirty_regions, region_index);
+	}
+
+	u32 local_x = tile_x - (region_x * TILE_REGION_SIDE);
+	u32 local_y = tile_y - (region_y * TILE_REGION_SIDE);
+	return &r->solid[(local_y * TILE_REGION_SIDE) + local_x];
+}
+
+void
+tile_collision_add(Tile_Collision_Map *m, V2 tile_position)
+{
+	u8 *cell = tile_collision_cell(m, tile_position);
+	assert(*cell < 255);
+	*cell += 1;
+}
+
+void
+tile_collision_remove(Tile_Collision_Map *m, V2 tile_position)
+{
+	u8 *cell = tile_collision_cell(m, tile_position);
+	assert(*cell > 0);
+	*cell -= 1;
+}
+
+inline bool
+tile_cell_open(Tile_Region *r, bool *covered, u32 x, u32 y)
+{
+	u32 i = (y * TILE_REGION_SIDE) + x;
+	return r->solid[i] && !covered[i];
+}
+
+// Greedy meshing: take the first uncovered solid cell in row order, grow it right as far as it goes, then grow that span up
+// while the whole row above is solid and uncovered.
+void
+merge_tile_region(Tile_Region *r, f32 tile_side, Collider_Store *colliders)
+{
+	for (Collider_Id id : r->colliders) {
+		remove_collider(id, colliders);
+	}
+	r->colliders.size = 0;
+
+	bool covered[TILE_REGION_SIDE * TILE_REGION_SIDE] = {};
+
+	for (u32 y = 0; y < TILE_REGION_SIDE; ++y) {
+		for (u32 x = 0; x < TILE_REGION_SIDE; ++x) {
+			if (!tile_cell_open(r, covered, x, y)) {
+				continue;
+			}
+
+			u32 w = 1;
+			while (x + w < TILE_REGION_SIDE && tile_cell_open(r, covered, x + w, y)) {
+				w += 1;
+			}
+
+			u32 h = 1;
+			for (; y + h < TILE_REGION_SIDE; ++h) {
+				bool row_open = true;
+				for (u32 i = 0; i < w && row_open; ++i) {
+					row_open = tile_cell_open(r, covered, x + i, y + h);
+				}
+				if (!row_open) {
+					break;
+				}
+			}
+
+			for (u32 j = 0; j < h; ++j) {
+				for (u32 i = 0; i < w; ++i) {
+					covered[((y + j) * TILE_REGION_SIDE) + x + i] = true;
+				}
+			}
+
+			f32 world_x = ((r->x * TILE_REGION_SIDE) + (s32)x) * tile_side;
+			f32 world_y = ((r->y * TILE_REGION_SIDE) + (s32)y) * tile_side;
+			array_add(&r->colliders, add_collider(world_x, world_y, w * tile_side, h * tile_side, colliders));
+		}
+	}
+}
+
+#define CORNER_GRID_SIDE (TILE_REGION_SIDE + 2)
+
+// The rope only ever bends around convex corners: tile corners where the tile is the only solid one of the four that meet
+// there. Corners inside merged geometry, along flat edges or in concave nooks can't be wrapped around, so they never go in
+// the index. Each corner belongs to its one solid tile, so neighbouring regions never list it twice. The corners are pushed
+// COLLISION_GAP out diagonally so a rope bent around one doesn't touch the tile.
+void
+build_tile_region_corners(Tile_Collision_Map *m, u32 region_index)
+{
+	Tile_Region *r = &m->regions[region_index];
+
+	// The region's cells with a one cell border borrowed from the neighbours.
+	bool solid[CORNER_GRID_SIDE * CORNER_GRID_SIDE] = {};
+	for (s32 ny = -1; ny <= 1; ++ny) {
+		for (s32 nx = -1; nx <= 1; ++nx) {
+			u32 neighbour_index = tile_collision_lookup_region(m, r->x + nx, r->y + ny);
+			if (neighbour_index == NO_TILE_REGION) {
+				continue;
+			}
+			Tile_Region *neighbour = &m->regions[neighbour_index];
+			for (s32 y = -1; y <= TILE_REGION_SIDE; ++y) {
+				for (s32 x = -1; x <= TILE_REGION_SIDE; ++x) {
+					s32 local_x = x - (nx * TILE_REGION_SIDE);
+					s32 local_y = y - (ny * TILE_REGION_SIDE);
+					if (local_x < 0 || local_x >= TILE_REGION_SIDE || local_y < 0 || local_y >= TILE_REGION_SIDE) {
+						continue;
+					}
+					solid[((y + 1) * CORNER_GRID_SIDE) + x + 1] = neighbour->solid[(local_y * TILE_REGION_SIDE) + local_x] > 0;
+				}
+			}
+		}
+	}
+	auto is_solid = [&](s32 x, s32 y) { return solid[((y + 1) * CORNER_GRID_SIDE) + x + 1]; };
+
+	r->corners.size = 0;
+	f32 side = m->tile_side;
+	for (s32 y = 0; y < TILE_REGION_SIDE; ++y) {
+		for (s32 x = 0; x < TILE_REGION_SIDE; ++x) {
+			if (!is_solid(x, y)) {
+				continue;
+			}
+			f32 l = ((r->x * TILE_REGION_SIDE) + x) * side;
+			f32 b = ((r->y * TILE_REGION_SIDE) + y) * side;
+
+			for (s32 dy = -1; dy <= 1; dy += 2) {
+				for (s32 dx = -1; dx <= 1; dx += 2) {
+					if (is_solid(x + dx, y) || is_solid(x, y + dy) || is_solid(x + dx, y + dy)) {
+						continue;
+					}
+					V2 corner = { (dx < 0) ? l - COLLISION_GAP : l + side + COLLISION_GAP,
+					              (dy < 0) ? b - COLLISION_GAP : b + side + COLLISION_GAP };
+					array_add(&r->corners, corner);
+				}
+			}
+		}
+	}
+}
+
+// Appends the convex tile corners inside the area.
+void
+query_tile_corners(Tile_Collision_Map *m, Rectangle area, Array<V2> *results)
+{
+	f32 region_side = TILE_REGION_SIDE * m->tile_side;
+	s32 min_x = floor(area.x / region_side);
+	s32 min_y = floor(area.y / region_side);
+	s32 max_x = floor((area.x + area.w) / region_side);
+	s32 max_y = floor((area.y + area.h) / region_side);
+
+	for (s32 y = min_y; y <= max_y; ++y) {
+		for (s32 x = min_x; x <= max_x; ++x) {
+			u32 region_index = tile_collision_lookup_region(m, x, y);
+			if (region_index == NO_TILE_REGION) {
+				continue;
+			}
+			for (V2 c : m->regions[region_index].corners) {
+				if (c.x >= area.x && c.x <= area.x + area.w && c.y >= area.y && c.y <= area.y + area.h) {
+					array_add(results, c);
+				}
+			}
+		}
+	}
+}
+
+// Drops every tile in the region at once, for unloading a part of the level. The region goes at the next
+// update_tile_colliders().
+void
+clear_tile_region(Tile_Collision_Map *m, s32 x, s32 y)
+{
+	u32 region_index = tile_collision_lookup_region(m, x, y);
+	if (region_index == NO_TILE_REGION) {
+		return;
+	}
+
+	Tile_Region *r = &m->regions[region_index];
+	memset(r->solid, 0, sizeof(r->solid));
+	if (!r->dirty) {
+		r->dirty = true;
+		array_add(&m->dirty_regions, region_index);
+	}
+}
+
+// Installs rectangles merged ahead of time (by save_level()) as the region's colliders, in place of merging its tiles at the
+// next update_tile_colliders(). The region's tiles have to be added first. Positions are in tiles.
+void
+set_tile_region_colliders(Tile_Collision_Map *m, s32 x, s32 y, const Level_File_Collider *rects, u32 num_rects, Collider_Store *colliders)
+{
+	u32 region_index = tile_collision_lookup_region(m, x, y);
+	if (region_index == NO_TILE_REGION) {
+		return;
+	}
+
+	Tile_Region *r = &m->regions[region_index];
+	for (Collider_Id id : r->colliders) {
+		remove_collider(id, colliders);
+	}
+	r->colliders.size = 0;
+
+	f32 side = m->tile_side;
+	for (u32 i = 0; i < num_rects; ++i) {
+		array_add(&r->colliders, add_collider(rects[i].x * side, rects[i].y * side, rects[i].w * side, rects[i].h * side, colliders));
+	}
+
+	// Still listed in dirty_regions, so its corners get built.
+	r->dirty = false;
+}
+
+// Rebuilds the colliders of every region touched since the last call. Edits only mark regions, so a box edit over many tiles
+// still merges each region once.
+void
+update_tile_colliders(Collider_Store *colliders)
+{
+	Tile_Collision_Map *m = &colliders->tiles;
+
+	static Array<u32> corner_regions = make_array<u32>(16, 0);
+	static Array<u32> empty_regions  = make_array<u32>(16, 0);
+	corner_regions.size = 0;
+	empty_regions.size  = 0;
+
+	for (u32 region_index : m->dirty_regions) {
+		Tile_Region *r = &m->regions[region_index];
+		if (r->dirty) {
+			merge_tile_region(r, m->tile_side, colliders);
+			r->dirty = false;
+			if (r->colliders.size == 0) {
+				array_add(&empty_regions, region_index);
+			}
+		}
+
+		// A tile on the region's edge can change the corners of the tiles next to it in the neighbouring regions.
+		for (s32 ny = -1; ny <= 1; ++ny) {
+			for (s32 nx = -1; nx <= 1; ++nx) {
+				u32 neighbour_index = tile_collision_lookup_region(m, r->x + nx, r->y + ny);
+				if (neighbour_index != NO_TILE_REGION && !m->regions[neighbour_index].corners_dirty) {
+					m->regions[neighbour_index].corners_dirty = true;
+					array_add(&corner_regions, neighbour_index);
+				}
+			}
+		}
+	}
+	m->dirty_regions.size = 0;
+
+	for (u32 region_index : corner_regions) {
+		build_tile_region_corners(m, region_index);
+		m->regions[region_index].corners_dirty = false;
+	}
+
+	// Highest index first, so the region swapped into each hole is never one still waiting to be freed.
+	qsort(empty_regions.data, empty_regions.size, sizeof(u32), [](const void *a, const void *b) {
+		return (*(const u32 *)b > *(const u32 *)a) - (*(const u32 *)b < *(const u32 *)a);
+	});
+	for (u32 region_index : empty_regions) {
+		tile_collision_free_region(m, region_index);
+	}
+}
+
+// Drops every tile and the colliders merged from them.
+void
+clear_tile_colliders(Collider_Store *colliders)
+{
+	Tile_Collision_Map *m = &colliders->tiles;
+
+	for (Tile_Region &r : m->regions) {
+		for (Collider_Id id : r.colliders) {
+			remove_collider(id, colliders);
+		}
+		free(r.colliders.data);
+		free(r.corners.data);
+	}
+	m->regions.size = 0;
+	m->dirty_regions.size = 0;
+	memset(m->table.data, 0xFF, m->table.size * sizeof(u32));
+
+	spatial_grid_clear(&colliders->tile_grid);
+}
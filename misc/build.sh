@@ -35,6 +35,11 @@ fi
 
 /usr/bin/time --format='Build time: %es.' gcc -std=c++17 $COMPILER_FLAGS cge.cpp $LINKER_FLAGS -o ../build/cge
 
+# The headless build needs sprite data exported by a normal run.
+if [ "$#" -eq 1 ] && [ "$1" == "headless" ]; then
+	/usr/bin/time --format='Headless build time: %es.' gcc -std=c++17 $COMPILER_FLAGS -DHEADLESS cge.cpp -lm -lpthread -o ../build/cge_headless
+fi
+
 popd >& /dev/null
 
 #../build/cge